@@ -0,0 +1,283 @@
+// Replay an allocation trace natively against kernel/slab.c and
+// kernel/buddy.c.
+//
+//   (in xv6)  atrace run /trace sh -c ...; atrace print /trace
+//   (host)    make host-bench
+//             host/atreplay console.log [window]
+//
+// Reads the text records "atrace print" writes to the console
+// ("at op cpu ts cache size addr"), ignoring other lines.  Each
+// traced cache gets a fresh cache of the same object size, kmalloc
+// and kfree replay as themselves, and top-level page allocations go
+// to a separate buddy allocator standing in for the kernel's.
+// Records marked AT_NESTED were the slab allocator feeding itself
+// and are skipped; the replay does that work again on its own.
+//
+// Every window records (default 10000) it prints mean and worst
+// latency, bytes live as the trace asked for them, bytes of slab
+// pages holding them, and the fragmentation that leaves
+// (1 - live/held).  At the end it prints latency percentiles for
+// each kind of call.  Latencies include one clock_gettime().
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "kernel/types.h"
+#include "kernel/spinlock.h"
+#include "kernel/slab.h"
+#include "kernel/buddy.h"
+#include "kernel/atrace.h"
+#include "host/host.h"
+
+#define NBLOCKS  32768          // 128 MB for the slab allocator
+#define NPAGES   32768          // and as much for page allocations
+#define NMAP     (1 << 20)      // live objects tracked; a power of two
+#define NCACHES  256
+#define NHIST    40             // log2 ns latency buckets
+
+struct live {
+    uint64 key;                 // address in the trace; 0 if empty
+    void *obj;
+    int op;                     // what allocated it
+    kmem_cache_t *cache;
+    uint64 size;                // bytes asked for, or page order
+};
+
+static struct live *map;
+static uint64 nlive, livebytes;
+
+static struct { uint64 id; kmem_cache_t *c; } caches[NCACHES];
+static int ncaches;
+
+static struct buddy_allocator pages;
+
+static const char *opname[] = {
+    "", "cache_alloc", "cache_free", "kmalloc", "kfree", "page_alloc", "page_free",
+};
+#define NOP 7
+
+static struct {
+    uint64 n, sum, max;
+    uint64 hist[NHIST];
+} lat[NOP];
+
+static uint64 now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64 hash(uint64 k)
+{
+    return ((k >> 3) * 0x9e3779b97f4a7c15ULL >> 40) & (NMAP - 1);
+}
+
+static struct live *lookup(uint64 key)
+{
+    for (uint64 i = hash(key); map[i].key; i = (i + 1) & (NMAP - 1))
+        if (map[i].key == key)
+            return &map[i];
+    return 0;
+}
+
+static int insert(uint64 key, void *obj, int op, kmem_cache_t *c, uint64 size)
+{
+    uint64 i;
+
+    if (nlive >= NMAP - NMAP / 4)
+        return -1;
+    for (i = hash(key); map[i].key; i = (i + 1) & (NMAP - 1))
+        ;
+    map[i] = (struct live){ key, obj, op, c, size };
+    nlive++;
+    livebytes += op == AT_PALLOC ? 0 : size;
+    return 0;
+}
+
+static void delete(struct live *e)
+{
+    uint64 i = e - map, j = i;
+
+    nlive--;
+    livebytes -= e->op == AT_PALLOC ? 0 : e->size;
+    for (;;) {
+        map[i].key = 0;
+        for (;;) {
+            j = (j + 1) & (NMAP - 1);
+            if (map[j].key == 0)
+                return;
+            uint64 h = hash(map[j].key);
+            if (i <= j ? (i < h && h <= j) : (i < h || h <= j))
+                continue;
+            break;
+        }
+        map[i] = map[j];
+        i = j;
+    }
+}
+
+static kmem_cache_t *replay_cache(uint64 id, uint64 size)
+{
+    for (int i = 0; i < ncaches; i++)
+        if (caches[i].id == id)
+            return caches[i].c;
+    if (ncaches == NCACHES)
+        return 0;
+    kmem_cache_t *c = kmem_cache_create("replay", size, 0, 0);
+    if (c) {
+        caches[ncaches].id = id;
+        caches[ncaches].c = c;
+        ncaches++;
+    }
+    return c;
+}
+
+static void note(int op, uint64 ns)
+{
+    int b = 0;
+
+    lat[op].n++;
+    lat[op].sum += ns;
+    if (ns > lat[op].max)
+        lat[op].max = ns;
+    while (b < NHIST - 1 && (1ULL << (b + 1)) <= ns)
+        b++;
+    lat[op].hist[b]++;
+}
+
+// upper bound of the bucket holding the p'th percentile.
+static uint64 percentile(int op, int p)
+{
+    uint64 want = (lat[op].n * p + 99) / 100, seen = 0;
+    for (int b = 0; b < NHIST; b++) {
+        seen += lat[op].hist[b];
+        if (seen >= want)
+            return 1ULL << (b + 1);
+    }
+    return lat[op].max;
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *f;
+    char line[256];
+    long window = 10000;
+    uint64 done = 0, skipped = 0, orphans = 0, failed = 0;
+    uint64 wn = 0, wsum = 0, wmax = 0;
+
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: atreplay trace.txt [window]\n");
+        exit(2);
+    }
+    if ((f = fopen(argv[1], "r")) == 0) {
+        perror(argv[1]);
+        exit(1);
+    }
+    if (argc == 3)
+        window = atol(argv[2]);
+    if ((map = calloc(NMAP, sizeof(struct live))) == 0) {
+        fprintf(stderr, "atreplay: out of memory\n");
+        exit(1);
+    }
+
+    host_kmem_init(NBLOCKS);
+    void *space = host_region(NPAGES);
+    buddy_init(&pages, space, (char *)space + (uint64)NPAGES * BLOCK_SIZE);
+    atrace_on = 1;      // count slab pages
+
+    printf("%12s %10s %10s %12s %12s %7s\n",
+           "records", "mean_ns", "max_ns", "live_KB", "slab_KB", "frag%");
+
+    while (fgets(line, sizeof(line), f)) {
+        int op, cpu;
+        uint64 ts, id, addr, t0, ns;
+        uint size;
+        struct live *e;
+        void *obj = 0;
+        kmem_cache_t *c = 0;
+
+        if (sscanf(line, "at %d %d %lu %lx %u %lx",
+                   &op, &cpu, &ts, &id, &size, &addr) != 6)
+            continue;
+        if ((op & AT_NESTED) || op < AT_ALLOC || op > AT_PFREE) {
+            skipped++;
+            continue;
+        }
+
+        switch (op) {
+        case AT_ALLOC:
+            if ((c = replay_cache(id, size)) == 0) {
+                failed++;
+                continue;
+            }
+            t0 = now_ns();
+            obj = kmem_cache_alloc(c);
+            ns = now_ns() - t0;
+            break;
+        case AT_KMALLOC:
+            t0 = now_ns();
+            obj = kmalloc(size);
+            ns = now_ns() - t0;
+            break;
+        case AT_PALLOC:
+            t0 = now_ns();
+            obj = buddy_alloc(&pages, size);
+            ns = now_ns() - t0;
+            break;
+        default:    // the frees
+            if ((e = lookup(addr)) == 0) {
+                orphans++;
+                continue;
+            }
+            t0 = now_ns();
+            if (e->op == AT_ALLOC)
+                kmem_cache_free(e->cache, e->obj);
+            else if (e->op == AT_KMALLOC)
+                kfree(e->obj);
+            else
+                buddy_free(&pages, e->obj, e->size);
+            ns = now_ns() - t0;
+            delete(e);
+            break;
+        }
+        if ((op == AT_ALLOC || op == AT_KMALLOC || op == AT_PALLOC) &&
+            (obj == 0 || insert(addr, obj, op, c, size) < 0)) {
+            failed++;
+            continue;
+        }
+
+        note(op, ns);
+        done++;
+        wn++;
+        wsum += ns;
+        if (ns > wmax)
+            wmax = ns;
+        if (wn == (uint64)window) {
+            uint64 held = host_slab_pages * BLOCK_SIZE;
+            printf("%12lu %10.1f %10lu %12lu %12lu %6.1f%%\n",
+                   done, (double)wsum / wn, wmax, livebytes / 1024, held / 1024,
+                   held ? 100.0 * (1.0 - (double)livebytes / held) : 0.0);
+            wn = wsum = wmax = 0;
+        }
+    }
+    fclose(f);
+
+    printf("\nreplayed %lu records; skipped %lu nested/unknown, "
+           "%lu frees of untraced objects, %lu failed\n",
+           done, skipped, orphans, failed);
+    printf("live at end: %lu objects, %lu KB in %lu KB of slab pages\n\n",
+           nlive, livebytes / 1024, host_slab_pages * BLOCK_SIZE / 1024);
+    printf("%-12s %10s %10s %10s %10s %10s\n",
+           "call", "count", "mean_ns", "p50_ns<", "p99_ns<", "max_ns");
+    for (int op = AT_ALLOC; op < NOP; op++) {
+        if (lat[op].n == 0)
+            continue;
+        printf("%-12s %10lu %10.1f %10lu %10lu %10lu\n", opname[op], lat[op].n,
+               (double)lat[op].sum / lat[op].n, percentile(op, 50),
+               percentile(op, 99), lat[op].max);
+    }
+    return 0;
+}
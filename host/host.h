@@ -0,0 +1,10 @@
+#ifndef _HOST_HOST_H
+#define _HOST_HOST_H
+
+// shim.c
+extern volatile int atrace_on;
+extern uint64 host_slab_pages;  // held by slab, counted while atrace_on
+void *host_region(int nblocks);
+void host_kmem_init(int nblocks);
+
+#endif // _HOST_HOST_H
@@ -0,0 +1,132 @@
+// Host stand-ins for the kernel routines slab.c and buddy.c call,
+// so the allocators can be built and timed as ordinary Linux code.
+//
+// Spinlocks spin on real cores with the same test-and-set the kernel
+// uses.  kalloc_order(), pgfree_order() and kalloc_stat(), used by
+// slab.c when built with -DSLAB_KERNEL, go to a second buddy
+// allocator standing in for the kernel's global one.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernel/types.h"
+#include "kernel/spinlock.h"
+#include "kernel/slab.h"
+#include "kernel/buddy.h"
+#include "kernel/atrace.h"
+#include "host/host.h"
+
+void *host_memset(void *dst, int c, uint n)
+{
+    return memset(dst, c, n);
+}
+
+void panic(char *s)
+{
+    fprintf(stderr, "panic: %s\n", s);
+    abort();
+}
+
+void initlock(struct spinlock *lk, char *name)
+{
+    lk->name = name;
+    lk->locked = 0;
+    lk->cpu = 0;
+}
+
+void acquire(struct spinlock *lk)
+{
+    while (__atomic_exchange_n(&lk->locked, 1, __ATOMIC_ACQUIRE) != 0) {
+        while (__atomic_load_n(&lk->locked, __ATOMIC_RELAXED) != 0) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+    }
+}
+
+void release(struct spinlock *lk)
+{
+    __atomic_store_n(&lk->locked, 0, __ATOMIC_RELEASE);
+}
+
+// The allocators' trace hooks.  There is no ring on the host; while
+// atrace_on is set they only keep count of the pages the slab
+// allocator holds, for host/atreplay.
+volatile int atrace_on;
+uint64 host_slab_pages;
+static __thread int host_nest;
+
+void atrace_nest(int d)
+{
+    host_nest += d;
+}
+
+void atrace_record(int op, void *id, uint64 size, void *addr)
+{
+    if (!host_nest)
+        return;
+    if (op == AT_PALLOC)
+        host_slab_pages += 1UL << size;
+    else if (op == AT_PFREE)
+        host_slab_pages -= 1UL << size;
+}
+
+#ifdef SLAB_KERNEL
+static struct buddy_allocator host_buddy;
+
+void *kalloc_order(int order)
+{
+    return buddy_alloc(&host_buddy, order);
+}
+
+void pgfree_order(void *pa, int order)
+{
+    buddy_free(&host_buddy, pa, order);
+}
+
+void kalloc_stat(struct buddystat *st)
+{
+    buddy_stat(&host_buddy, st);
+}
+#endif
+
+// kmalloc/kfree accounting; there are no processes to charge.
+void kmem_charge(long bytes)
+{
+    (void)bytes;
+}
+
+// Memory for nblocks BLOCK_SIZE blocks, aligned to the largest
+// power of two that fits, as the buddy allocator's address
+// arithmetic and slab.c's obj_to_slab() expect.
+void *host_region(int nblocks)
+{
+    uint64 size = (uint64)nblocks * BLOCK_SIZE;
+    uint64 align = BLOCK_SIZE;
+
+    while (align * 2 <= size)
+        align *= 2;
+    void *p = aligned_alloc(align, (size + align - 1) & ~(align - 1));
+    if (!p) {
+        fprintf(stderr, "host_region: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+// Set up the slab allocator over nblocks blocks of host memory,
+// the way kinit() does for whichever Deo the build is for.
+void host_kmem_init(int nblocks)
+{
+    void *space = host_region(nblocks);
+
+#ifdef SLAB_KERNEL
+    buddy_init(&host_buddy, space,
+               (char *)space + (uint64)nblocks * BLOCK_SIZE);
+    kmem_init(0, 0);
+#else
+    kmem_init(space, nblocks);
+#endif
+}
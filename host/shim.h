@@ -0,0 +1,15 @@
+// Forced ahead of kernel/slab.c and kernel/buddy.c (-include) when
+// they are built for the host.  The kernel's memset takes a uint
+// count where libc's takes a size_t, so send it to a wrapper in
+// shim.c; printf goes straight to libc, and acquire/release/initlock,
+// kalloc_order/pgfree_order/kalloc_stat and the atrace hooks are
+// defined in shim.c.
+
+#ifndef _HOST_SHIM_H
+#define _HOST_SHIM_H
+
+typedef unsigned long size_t;
+
+#define memset  host_memset
+
+#endif // _HOST_SHIM_H
@@ -0,0 +1,319 @@
+// Native benchmark of kernel/slab.c and kernel/buddy.c.
+//
+//   make host-bench                       build host/slabbench
+//   host/slabbench                        run everything
+//   host/slabbench --filter=cache         only names containing "cache"
+//   host/slabbench --min-time=1           run each case for >= 1 s
+//   perf stat -e cache-misses host/slabbench --filter=contended
+//
+// Like google-benchmark, each case's iteration count grows until
+// a run lasts min-time; the last run is reported as ns/op.  Where
+// the kernel allows perf_event_open(), cache misses and instructions
+// per op are reported too.  Contended cases run one pthread per
+// thread count on a shared cache; ns/op is wall time per operation
+// of a single thread.
+
+#define _GNU_SOURCE
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "kernel/types.h"
+#include "kernel/spinlock.h"
+#include "kernel/slab.h"
+#include "kernel/buddy.h"
+#include "host/host.h"
+
+#define NBLOCKS  16384          // 64 MB for the slab allocator
+#define BATCH    256
+#define MAXT     64
+
+static double min_time = 0.2;
+static const char *filter;
+static int max_threads = 8;
+
+// ---- timing and counters ----
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int perf_open(uint64 config)
+{
+    struct perf_event_attr pe;
+
+    memset(&pe, 0, sizeof(pe));
+    pe.type = PERF_TYPE_HARDWARE;
+    pe.size = sizeof(pe);
+    pe.config = config;
+    pe.disabled = 1;
+    pe.inherit = 1;             // count the worker threads too
+    pe.exclude_kernel = 1;
+    pe.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+}
+
+static int fd_misses = -1, fd_insns = -1;
+
+static void perf_start(void)
+{
+    if (fd_misses >= 0) {
+        ioctl(fd_misses, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd_misses, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    if (fd_insns >= 0) {
+        ioctl(fd_insns, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd_insns, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+static long long perf_stop(int fd)
+{
+    long long v = -1;
+
+    if (fd < 0)
+        return -1;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &v, sizeof(v)) != sizeof(v))
+        return -1;
+    return v;
+}
+
+// ---- harness ----
+
+// A case runs fn(arg, iters) and returns how many operations it did.
+typedef long (*bench_fn)(void *arg, long iters);
+
+static void run_case(const char *name, bench_fn fn, void *arg)
+{
+    long iters = 1, ops;
+    double t;
+
+    if (filter && !strstr(name, filter))
+        return;
+
+    for (;;) {
+        perf_start();
+        double t0 = now();
+        ops = fn(arg, iters);
+        t = now() - t0;
+        if (t >= min_time || iters >= (1L << 40))
+            break;
+        // aim a little past min_time, but at most 10x at a time.
+        long next = t > 0 ? (long)(iters * min_time * 1.4 / t) : iters * 10;
+        if (next > iters * 10)
+            next = iters * 10;
+        if (next <= iters)
+            next = iters * 2;
+        iters = next;
+    }
+    long long misses = perf_stop(fd_misses);
+    long long insns = perf_stop(fd_insns);
+
+    printf("%-40s %12ld %10.1f ns/op", name, ops, t * 1e9 / ops);
+    if (misses >= 0)
+        printf(" %8.2f miss/op", (double)misses / ops);
+    if (insns >= 0)
+        printf(" %8.1f insn/op", (double)insns / ops);
+    printf("\n");
+}
+
+static unsigned long long rnd_state = 88172645463325252ULL;
+
+static unsigned rnd(void)
+{
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return (unsigned)rnd_state;
+}
+
+// ---- buddy ----
+
+static struct buddy_allocator bench_buddy;
+
+static long bm_buddy_pair(void *arg, long iters)
+{
+    int order = (int)(long)arg;
+    for (long i = 0; i < iters; i++) {
+        void *p = buddy_alloc(&bench_buddy, order);
+        buddy_free(&bench_buddy, p, order);
+    }
+    return iters * 2;
+}
+
+// allocate a batch of single blocks, free them in random order,
+// so frees have to search the free lists for their buddies.
+static long bm_buddy_scatter(void *arg, long iters)
+{
+    void *b[BATCH];
+    (void)arg;
+    for (long i = 0; i < iters; i++) {
+        for (int k = 0; k < BATCH; k++)
+            b[k] = buddy_alloc(&bench_buddy, 0);
+        for (int k = BATCH - 1; k > 0; k--) {
+            int j = rnd() % (k + 1);
+            void *t = b[k]; b[k] = b[j]; b[j] = t;
+        }
+        for (int k = 0; k < BATCH; k++)
+            buddy_free(&bench_buddy, b[k], 0);
+    }
+    return iters * BATCH * 2;
+}
+
+// ---- caches ----
+
+static long bm_cache_pair(void *arg, long iters)
+{
+    kmem_cache_t *c = arg;
+    for (long i = 0; i < iters; i++) {
+        void *p = kmem_cache_alloc(c);
+        kmem_cache_free(c, p);
+    }
+    return iters * 2;
+}
+
+static long bm_cache_batch(void *arg, long iters)
+{
+    kmem_cache_t *c = arg;
+    void *b[BATCH];
+    for (long i = 0; i < iters; i++) {
+        for (int k = 0; k < BATCH; k++)
+            b[k] = kmem_cache_alloc(c);
+        for (int k = 0; k < BATCH; k++)
+            kmem_cache_free(c, b[k]);
+    }
+    return iters * BATCH * 2;
+}
+
+static long bm_kmalloc_mixed(void *arg, long iters)
+{
+    void *b[BATCH];
+    (void)arg;
+    for (long i = 0; i < iters; i++) {
+        for (int k = 0; k < BATCH; k++)
+            b[k] = kmalloc(16 + rnd() % 2048);
+        for (int k = 0; k < BATCH; k++)
+            kfree(b[k]);
+    }
+    return iters * BATCH * 2;
+}
+
+// ---- contended ----
+
+struct mt {
+    int nthreads;
+    kmem_cache_t *cache;        // 0: kmalloc
+    long iters;
+    pthread_barrier_t start;
+};
+
+static void *mt_worker(void *a)
+{
+    struct mt *m = a;
+    void *b[64];
+
+    pthread_barrier_wait(&m->start);
+    for (long i = 0; i < m->iters; i++) {
+        for (int k = 0; k < 64; k++)
+            b[k] = m->cache ? kmem_cache_alloc(m->cache) : kmalloc(256);
+        for (int k = 0; k < 64; k++) {
+            if (m->cache)
+                kmem_cache_free(m->cache, b[k]);
+            else
+                kfree(b[k]);
+        }
+    }
+    return 0;
+}
+
+static long bm_contended(void *arg, long iters)
+{
+    struct mt *m = arg;
+    pthread_t t[MAXT];
+
+    m->iters = iters;
+    pthread_barrier_init(&m->start, 0, m->nthreads);
+    for (int i = 1; i < m->nthreads; i++)
+        pthread_create(&t[i], 0, mt_worker, m);
+    mt_worker(m);
+    for (int i = 1; i < m->nthreads; i++)
+        pthread_join(t[i], 0);
+    pthread_barrier_destroy(&m->start);
+    return iters * 64 * 2;
+}
+
+int main(int argc, char *argv[])
+{
+    char name[64];
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--filter=", 9) == 0) {
+            filter = argv[i] + 9;
+        } else if (strncmp(argv[i], "--min-time=", 11) == 0) {
+            min_time = atof(argv[i] + 11);
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            max_threads = atoi(argv[i] + 10);
+            if (max_threads < 1 || max_threads > MAXT)
+                max_threads = MAXT;
+        } else {
+            fprintf(stderr, "usage: slabbench [--filter=substr] "
+                    "[--min-time=sec] [--threads=n]\n");
+            exit(2);
+        }
+    }
+
+    host_kmem_init(NBLOCKS);
+    void *space = host_region(NBLOCKS);
+    buddy_init(&bench_buddy, space, (char *)space + (uint64)NBLOCKS * BLOCK_SIZE);
+
+    fd_misses = perf_open(PERF_COUNT_HW_CACHE_MISSES);
+    fd_insns = perf_open(PERF_COUNT_HW_INSTRUCTIONS);
+    if (fd_misses < 0)
+        printf("(perf counters unavailable; see perf_event_paranoid)\n");
+#ifdef SLAB_KERNEL
+    printf("slab over kalloc_order (SLAB_KERNEL)\n");
+#else
+    printf("slab over its private buddy\n");
+#endif
+    printf("%-40s %12s %10s\n", "case", "ops", "time");
+
+    for (int o = 0; o <= 4; o += 2) {
+        snprintf(name, sizeof(name), "BM_buddy_pair/order:%d", o);
+        run_case(name, bm_buddy_pair, (void *)(long)o);
+    }
+    run_case("BM_buddy_scatter/batch:256", bm_buddy_scatter, 0);
+
+    static const int sizes[] = {32, 256, 1024, 4096};
+    for (int s = 0; s < 4; s++) {
+        kmem_cache_t *c = kmem_cache_create("bench", sizes[s], 0, 0);
+        snprintf(name, sizeof(name), "BM_cache_pair/size:%d", sizes[s]);
+        run_case(name, bm_cache_pair, c);
+        snprintf(name, sizeof(name), "BM_cache_batch/size:%d", sizes[s]);
+        run_case(name, bm_cache_batch, c);
+        kmem_cache_destroy(c);
+    }
+    run_case("BM_kmalloc_mixed/16-2064", bm_kmalloc_mixed, 0);
+
+    for (int n = 1; n <= max_threads; n *= 2) {
+        struct mt m = { .nthreads = n };
+        m.cache = kmem_cache_create("contended", 64, 0, 0);
+        snprintf(name, sizeof(name), "BM_cache_contended/threads:%d", n);
+        run_case(name, bm_contended, &m);
+        kmem_cache_destroy(m.cache);
+
+        m.cache = 0;
+        snprintf(name, sizeof(name), "BM_kmalloc_contended/threads:%d", n);
+        run_case(name, bm_contended, &m);
+    }
+    return 0;
+}
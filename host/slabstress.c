@@ -0,0 +1,361 @@
+// Randomized stress test of kernel/slab.c and kernel/buddy.c on the host.
+//
+//   make host-test                 build and run with a fixed seed
+//   host/slabstress [seed [ops]]   rerun a failing seed
+//
+// Every live allocation is filled with a tag derived from its
+// address and checked again before it is freed, so overlapping or
+// misplaced allocations show up as corruption.  Cache counters are
+// checked against the test's own count of live objects, and the
+// buddy allocator must merge back to what it started with.  The
+// last phase repeats the cache checks with several threads sharing
+// the caches.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernel/types.h"
+#include "kernel/spinlock.h"
+#include "kernel/slab.h"
+#include "kernel/buddy.h"
+#include "host/host.h"
+
+#define NBLOCKS   16384
+#define NLIVE     4096
+#define NCACHE    8
+#define NTHREAD   4
+
+static unsigned long long seed;
+static long nops = 200000;
+static int failures;
+
+static unsigned rnd(unsigned long long *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return (unsigned)*s;
+}
+
+#define FAIL(...) do {                                      \
+        printf("FAIL (seed %llu): ", seed);                 \
+        printf(__VA_ARGS__);                                \
+        printf("\n");                                       \
+        failures++;                                         \
+    } while (0)
+
+// ---- fill patterns ----
+
+static unsigned char tag(void *p)
+{
+    uint64 a = (uint64)p;
+    return (unsigned char)((a >> 3) ^ (a >> 11) ^ 0x5a);
+}
+
+// for big regions, tag the first and last bytes of every page.
+static void fill(void *p, uint64 n)
+{
+    unsigned char t = tag(p), *c = p;
+    if (n <= 2 * BLOCK_SIZE) {
+        memset(p, t, n);
+        return;
+    }
+    for (uint64 i = 0; i < n; i += BLOCK_SIZE) {
+        memset(c + i, t, 64);
+        memset(c + i + BLOCK_SIZE - 64, t, 64);
+    }
+}
+
+static int check(void *p, uint64 n)
+{
+    unsigned char t = tag(p), *c = p;
+    if (n <= 2 * BLOCK_SIZE) {
+        for (uint64 i = 0; i < n; i++)
+            if (c[i] != t)
+                return 0;
+        return 1;
+    }
+    for (uint64 i = 0; i < n; i += BLOCK_SIZE)
+        for (int k = 0; k < 64; k++)
+            if (c[i + k] != t || c[i + BLOCK_SIZE - 64 + k] != t)
+                return 0;
+    return 1;
+}
+
+// ---- buddy ----
+
+static uint64 buddy_free_bytes(struct buddy_allocator *b)
+{
+    uint64 n = 0;
+    for (int o = MIN_ORDER; o <= b->max_order; o++)
+        for (struct buddy_block *bl = b->free[o - MIN_ORDER]; bl; bl = bl->next)
+            n += (uint64)BLOCK_SIZE << o;
+    return n;
+}
+
+static void test_buddy(void)
+{
+    static struct buddy_allocator b;
+    static struct { void *p; int order; } live[NLIVE];
+    unsigned long long s = seed;
+    int nlive = 0;
+
+    void *space = host_region(NBLOCKS);
+    buddy_init(&b, space, (char *)space + (uint64)NBLOCKS * BLOCK_SIZE);
+    uint64 total = buddy_free_bytes(&b);
+
+    for (long i = 0; i < nops; i++) {
+        if (nlive < NLIVE && (nlive == 0 || rnd(&s) % 3 != 0)) {
+            // mostly small orders, now and then a big one.
+            int order = rnd(&s) % 16 == 0 ? rnd(&s) % 8 : rnd(&s) % 3;
+            void *p = buddy_alloc(&b, order);
+            if (!p)
+                continue;
+            uint64 size = (uint64)BLOCK_SIZE << order;
+            if ((uint64)p < (uint64)space ||
+                (uint64)p + size > (uint64)space + (uint64)NBLOCKS * BLOCK_SIZE ||
+                ((uint64)p - (uint64)space) % size != 0) {
+                FAIL("buddy: bad block %p order %d", p, order);
+                return;
+            }
+            fill(p, size);
+            live[nlive].p = p;
+            live[nlive].order = order;
+            nlive++;
+        } else {
+            int k = rnd(&s) % nlive;
+            uint64 size = (uint64)BLOCK_SIZE << live[k].order;
+            if (!check(live[k].p, size)) {
+                FAIL("buddy: block %p order %d corrupted", live[k].p, live[k].order);
+                return;
+            }
+            buddy_free(&b, live[k].p, live[k].order);
+            live[k] = live[--nlive];
+        }
+    }
+    while (nlive > 0) {
+        nlive--;
+        buddy_free(&b, live[nlive].p, live[nlive].order);
+    }
+
+    if (buddy_free_bytes(&b) != total)
+        FAIL("buddy: %lu bytes free after freeing everything, want %lu",
+             buddy_free_bytes(&b), total);
+    int top = 0;
+    for (int o = MIN_ORDER; o <= b.max_order; o++)
+        if (b.free[o - MIN_ORDER])
+            top = o;
+    if (top != b.max_order)
+        FAIL("buddy: did not merge back to order %d", b.max_order);
+}
+
+// ---- caches ----
+
+#define CTOR_MAGIC 0xc7
+
+static void ctor(void *p)
+{
+    *(unsigned char *)p = CTOR_MAGIC;
+}
+
+static int ndtor;
+
+static void dtor(void *p)
+{
+    (void)p;
+    __atomic_fetch_add(&ndtor, 1, __ATOMIC_RELAXED);
+}
+
+struct obj {
+    void *p;
+    int cache;      // index into caches[], or -1 for kmalloc
+    uint64 size;
+};
+
+static kmem_cache_t *caches[NCACHE];
+static uint64 csize[NCACHE];
+static int cctor[NCACHE];
+
+static void make_caches(unsigned long long *s)
+{
+    for (int c = 0; c < NCACHE; c++) {
+        // sizes from a few bytes up to past a page
+        csize[c] = 1 + rnd(s) % (c < NCACHE / 2 ? 256 : 6000);
+        cctor[c] = c % 3 == 0;
+        caches[c] = kmem_cache_create("stress", csize[c],
+                                      cctor[c] ? ctor : 0,
+                                      cctor[c] ? dtor : 0);
+        if (!caches[c])
+            FAIL("kmem_cache_create(%lu) failed", csize[c]);
+    }
+}
+
+static void *obj_alloc(struct obj *o, unsigned long long *s)
+{
+    if (rnd(s) % 4 == 0) {
+        o->cache = -1;
+        o->size = 1 + rnd(s) % (rnd(s) % 8 == 0 ? 131072 : 1024);
+        o->p = kmalloc(o->size);
+        if (o->p && ((uint64)o->p & 7) != 0)
+            FAIL("kmalloc(%lu) = %p, misaligned", o->size, o->p);
+    } else {
+        o->cache = rnd(s) % NCACHE;
+        o->size = csize[o->cache];
+        o->p = kmem_cache_alloc(caches[o->cache]);
+        if (o->p && cctor[o->cache] &&
+            *(unsigned char *)o->p != CTOR_MAGIC)
+            FAIL("cache object %p not constructed", o->p);
+    }
+    if (o->p)
+        fill(o->p, o->size);
+    return o->p;
+}
+
+static int obj_free(struct obj *o)
+{
+    if (!check(o->p, o->size)) {
+        FAIL("object %p (%lu bytes, cache %d) corrupted",
+             o->p, o->size, o->cache);
+        return 0;
+    }
+    if (o->cache < 0)
+        kfree(o->p);
+    else
+        kmem_cache_free(caches[o->cache], o->p);
+    return 1;
+}
+
+static void test_caches(void)
+{
+    static struct obj live[NLIVE];
+    static int per_cache[NCACHE];
+    unsigned long long s = seed * 31 + 7;
+    int nlive = 0;
+
+    make_caches(&s);
+    memset(per_cache, 0, sizeof(per_cache));
+
+    for (long i = 0; i < nops && failures == 0; i++) {
+        unsigned r = rnd(&s) % 100;
+        if (r == 0) {
+            if (rnd(&s) % 4)
+                kmem_cache_shrink(caches[rnd(&s) % NCACHE]);
+            else
+                kmem_cache_reap();
+        } else if (nlive < NLIVE && (nlive == 0 || r < 60)) {
+            if (obj_alloc(&live[nlive], &s)) {
+                if (live[nlive].cache >= 0)
+                    per_cache[live[nlive].cache]++;
+                nlive++;
+            }
+        } else {
+            int k = rnd(&s) % nlive;
+            if (!obj_free(&live[k]))
+                return;
+            if (live[k].cache >= 0)
+                per_cache[live[k].cache]--;
+            live[k] = live[--nlive];
+        }
+
+        if (i % 1000 == 0) {
+            for (int c = 0; c < NCACHE; c++) {
+                kmem_cache_t *cp = caches[c];
+                if (cp->total_objs - cp->free_objs != per_cache[c])
+                    FAIL("cache %d: %d objects in use, want %d",
+                         c, cp->total_objs - cp->free_objs, per_cache[c]);
+                if (cp->error)
+                    FAIL("cache %d: error %d", c, cp->error);
+            }
+        }
+    }
+
+    while (nlive > 0)
+        if (!obj_free(&live[--nlive]))
+            return;
+    for (int c = 0; c < NCACHE; c++) {
+        if (caches[c]->free_objs != caches[c]->total_objs)
+            FAIL("cache %d: not empty after freeing everything", c);
+        kmem_cache_shrink(caches[c]);     // first call only clears the flag
+        kmem_cache_shrink(caches[c]);
+        if (caches[c]->slab_count != 0)
+            FAIL("cache %d: %d slabs left after shrink",
+                 c, caches[c]->slab_count);
+        kmem_cache_destroy(caches[c]);
+    }
+}
+
+// ---- threads ----
+
+static void *mt_worker(void *a)
+{
+    static __thread struct obj live[NLIVE / NTHREAD];
+    unsigned long long s = seed + 1000 * (long)a + 1;
+    int nlive = 0;
+
+    for (long i = 0; i < nops / NTHREAD && failures == 0; i++) {
+        if (nlive < NLIVE / NTHREAD && (nlive == 0 || rnd(&s) % 2)) {
+            if (obj_alloc(&live[nlive], &s))
+                nlive++;
+        } else {
+            int k = rnd(&s) % nlive;
+            if (!obj_free(&live[k]))
+                return 0;
+            live[k] = live[--nlive];
+        }
+    }
+    while (nlive > 0)
+        if (!obj_free(&live[--nlive]))
+            return 0;
+    return 0;
+}
+
+static void test_threads(void)
+{
+    pthread_t t[NTHREAD];
+    unsigned long long s = seed * 17 + 3;
+
+    make_caches(&s);
+    ndtor = 0;
+    for (long i = 0; i < NTHREAD; i++)
+        pthread_create(&t[i], 0, mt_worker, (void *)i);
+    for (int i = 0; i < NTHREAD; i++)
+        pthread_join(t[i], 0);
+
+    for (int c = 0; c < NCACHE; c++) {
+        if (caches[c]->free_objs != caches[c]->total_objs)
+            FAIL("threads: cache %d not empty at the end", c);
+        if (caches[c]->error)
+            FAIL("threads: cache %d: error %d", c, caches[c]->error);
+        kmem_cache_destroy(caches[c]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    seed = argc > 1 ? strtoull(argv[1], 0, 0) : 1;
+    if (argc > 2)
+        nops = atol(argv[2]);
+    if (seed == 0)
+        seed = 1;
+
+    host_kmem_init(NBLOCKS);
+
+    printf("slabstress: seed %llu, %ld ops\n", seed, nops);
+    test_buddy();
+    printf("  buddy:   %s\n", failures ? "FAIL" : "ok");
+    int f = failures;
+    test_caches();
+    printf("  caches:  %s\n", failures > f ? "FAIL" : "ok");
+    f = failures;
+    test_threads();
+    printf("  threads: %s\n", failures > f ? "FAIL" : "ok");
+
+    if (failures) {
+        printf("slabstress: %d failures\n", failures);
+        return 1;
+    }
+    printf("slabstress: PASS\n");
+    return 0;
+}
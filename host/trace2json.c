@@ -0,0 +1,280 @@
+// Convert a kernel tracepoint dump to Chrome trace JSON, for
+// chrome://tracing or ui.perfetto.dev.
+//
+//   (in xv6)  ktrace run /tr all sh -c ...; ktrace print /tr
+//   (host)    make host-bench
+//             host/trace2json console.log > trace.json
+//
+// Reads the text records "ktrace print" writes to the console
+// ("tr ev cpu pid ts a b"), ignoring other lines, and sorts them by
+// time.  The timeline has three groups: one track per CPU showing
+// which process ran there, one track per process with its system
+// calls as slices and its wakeups, page faults and buffer cache
+// lookups as instants, and a disk group with each virtio request
+// as an async slice from submission to completion.  Times are in
+// microseconds from the first record, from the 10 MHz timer.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/syscall.h"
+#include "kernel/trace.h"
+
+#define TIMER_HZ  10000000
+#define MAXPID    65536         // larger pids get no syscall slices
+
+#define G_CPU   1               // Chrome "pid" of each group
+#define G_PROC  2
+#define G_DISK  3
+
+struct rec {
+    uint64 ts;
+    int ev, cpu, pid;
+    uint64 a, b;
+    long seq;                   // input order, to keep the sort stable
+};
+
+static const char *sysname[] = {
+    [SYS_fork] "fork", [SYS_exit] "exit", [SYS_wait] "wait",
+    [SYS_pipe] "pipe", [SYS_read] "read", [SYS_kill] "kill",
+    [SYS_exec] "exec", [SYS_fstat] "fstat", [SYS_chdir] "chdir",
+    [SYS_dup] "dup", [SYS_getpid] "getpid", [SYS_sbrk] "sbrk",
+    [SYS_pause] "pause", [SYS_uptime] "uptime", [SYS_open] "open",
+    [SYS_write] "write", [SYS_mknod] "mknod", [SYS_unlink] "unlink",
+    [SYS_link] "link", [SYS_mkdir] "mkdir", [SYS_close] "close",
+    [SYS_kmem_init] "kmem_init", [SYS_kmem_cache_create] "kmem_cache_create",
+    [SYS_kmem_cache_alloc] "kmem_cache_alloc",
+    [SYS_kmem_cache_free] "kmem_cache_free",
+    [SYS_kmem_cache_destroy] "kmem_cache_destroy",
+    [SYS_kmem_cache_shrink] "kmem_cache_shrink",
+    [SYS_kmem_cache_info] "kmem_cache_info",
+    [SYS_kmem_cache_error] "kmem_cache_error",
+    [SYS_kmalloc] "kmalloc", [SYS_kfree] "kfree",
+    [SYS_slab_write] "slab_write", [SYS_slab_read] "slab_read",
+    [SYS_clone] "clone", [SYS_join] "join",
+    [SYS_futex_wait] "futex_wait", [SYS_futex_wake] "futex_wake",
+    [SYS_atrace] "atrace", [SYS_ktrace] "ktrace",
+    [SYS_slabstat] "slabstat", [SYS_buddystat] "buddystat",
+    [SYS_getrusage] "getrusage", [SYS_procstat] "procstat",
+    [SYS_dmesg] "dmesg",
+    [SYS_fdlimit] "fdlimit", [SYS_sleepstat] "sleepstat",
+    [SYS_getdents] "getdents", [SYS_dirstat] "dirstat",
+    [SYS_irqaffinity] "irqaffinity", [SYS_irqstat] "irqstat",
+    [SYS_workstat] "workstat",
+};
+#define NSYSNAME (int)(sizeof(sysname) / sizeof(sysname[0]))
+
+static struct rec *recs;
+static long nrecs, cap;
+static uint64 t0;
+
+static int oncpu[NCPU];         // pid in the open slice on each CPU, or 0
+static unsigned char *insys;    // per pid: syscall slice open
+static unsigned char *seen;     // per pid: track already named
+static int first = 1;
+
+static int cmp(const void *x, const void *y)
+{
+    const struct rec *a = x, *b = y;
+    if (a->ts != b->ts)
+        return a->ts < b->ts ? -1 : 1;
+    return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+static double us(uint64 ts)
+{
+    return (double)(ts - t0) * 1e6 / TIMER_HZ;
+}
+
+// start an event: {"ph":"X","ts":T,"pid":G,"tid":N  -- the caller
+// adds the rest and the closing brace.
+static void event(const char *ph, uint64 ts, int group, int tid)
+{
+    printf("%s\n{\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+           first ? "" : ",", ph, us(ts), group, tid);
+    first = 0;
+}
+
+static void name_group(int group, const char *name, int order)
+{
+    event("M", t0, group, 0);
+    printf(",\"name\":\"process_name\",\"args\":{\"name\":\"%s\"}}", name);
+    event("M", t0, group, 0);
+    printf(",\"name\":\"process_sort_index\",\"args\":{\"sort_index\":%d}}", order);
+}
+
+static void name_track(int group, int tid, const char *fmt, int n)
+{
+    event("M", t0, group, tid);
+    printf(",\"name\":\"thread_name\",\"args\":{\"name\":\"");
+    printf(fmt, n);
+    printf("\"}}");
+}
+
+static void proc_track(int pid)
+{
+    if (pid > 0 && pid < MAXPID && !seen[pid]) {
+        seen[pid] = 1;
+        name_track(G_PROC, pid, "pid %d", pid);
+    }
+}
+
+static const char *syscall_name(int num, char *buf)
+{
+    if (num > 0 && num < NSYSNAME && sysname[num])
+        return sysname[num];
+    sprintf(buf, "sys %d", num);
+    return buf;
+}
+
+// instants go on the process's track, or its CPU's when no
+// process was running.
+static void instant(struct rec *r, const char *name)
+{
+    if (r->pid > 0) {
+        proc_track(r->pid);
+        event("i", r->ts, G_PROC, r->pid);
+    } else {
+        event("i", r->ts, G_CPU, r->cpu);
+    }
+    printf(",\"s\":\"t\",\"name\":\"%s\"", name);
+}
+
+static void convert(struct rec *r)
+{
+    char buf[32];
+
+    switch (r->ev) {
+    case TE_SWITCH_IN:
+        if (oncpu[r->cpu]) {
+            event("E", r->ts, G_CPU, r->cpu);
+            printf("}");
+        }
+        oncpu[r->cpu] = (int)r->a;
+        event("B", r->ts, G_CPU, r->cpu);
+        printf(",\"name\":\"pid %d\"}", (int)r->a);
+        break;
+    case TE_SWITCH_OUT:
+        if (oncpu[r->cpu]) {
+            event("E", r->ts, G_CPU, r->cpu);
+            printf(",\"args\":{\"state\":%d}}", (int)r->b);
+            oncpu[r->cpu] = 0;
+        }
+        break;
+    case TE_SYS_ENTER:
+        if (r->pid <= 0 || r->pid >= MAXPID)
+            break;
+        proc_track(r->pid);
+        event("B", r->ts, G_PROC, r->pid);
+        printf(",\"cat\":\"syscall\",\"name\":\"%s\"}", syscall_name((int)r->a, buf));
+        insys[r->pid] = 1;
+        break;
+    case TE_SYS_EXIT:
+        // slices that began before the trace did have no B.
+        if (r->pid <= 0 || r->pid >= MAXPID || !insys[r->pid])
+            break;
+        event("E", r->ts, G_PROC, r->pid);
+        printf(",\"args\":{\"ret\":%ld}}", (long)r->b);
+        insys[r->pid] = 0;
+        break;
+    case TE_WAKEUP:
+        proc_track((int)r->a);
+        event("i", r->ts, G_PROC, (int)r->a);
+        printf(",\"s\":\"t\",\"name\":\"wakeup\","
+               "\"args\":{\"by\":%d,\"chan\":\"0x%lx\"}}", r->pid, r->b);
+        break;
+    case TE_FAULT:
+        instant(r, "fault");
+        printf(",\"args\":{\"va\":\"0x%lx\",\"read\":%d}}", r->a, (int)r->b);
+        break;
+    case TE_BGET:
+        instant(r, r->b ? "bget hit" : "bget miss");
+        printf(",\"args\":{\"blockno\":%lu}}", r->a);
+        break;
+    case TE_DISK_SUBMIT:
+    case TE_DISK_DONE:
+        event(r->ev == TE_DISK_SUBMIT ? "b" : "e", r->ts, G_DISK, 0);
+        printf(",\"cat\":\"virtio\",\"id\":%lu,\"name\":\"%s\","
+               "\"args\":{\"blockno\":%lu}}",
+               r->b >> 1, r->ev == TE_DISK_SUBMIT && (r->b & 1) ? "write" : "read",
+               r->a);
+        break;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *f;
+    char line[256];
+    struct rec r;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: trace2json trace.txt > trace.json\n");
+        exit(2);
+    }
+    if ((f = fopen(argv[1], "r")) == 0) {
+        perror(argv[1]);
+        exit(1);
+    }
+    insys = calloc(MAXPID, 1);
+    seen = calloc(MAXPID, 1);
+    if (!insys || !seen) {
+        fprintf(stderr, "trace2json: out of memory\n");
+        exit(1);
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "tr %d %d %d %lu %lx %lx",
+                   &r.ev, &r.cpu, &r.pid, &r.ts, &r.a, &r.b) != 6)
+            continue;
+        if (r.ev <= 0 || r.ev >= TE_NEVENT || r.cpu < 0 || r.cpu >= NCPU)
+            continue;
+        if (nrecs == cap) {
+            cap = cap ? cap * 2 : 65536;
+            if ((recs = realloc(recs, cap * sizeof(*recs))) == 0) {
+                fprintf(stderr, "trace2json: out of memory\n");
+                exit(1);
+            }
+        }
+        r.seq = nrecs;
+        recs[nrecs++] = r;
+    }
+    fclose(f);
+    if (nrecs == 0) {
+        fprintf(stderr, "trace2json: no \"tr\" records in %s\n", argv[1]);
+        exit(1);
+    }
+    qsort(recs, nrecs, sizeof(*recs), cmp);
+    t0 = recs[0].ts;
+
+    printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    name_group(G_CPU, "CPUs", 0);
+    name_group(G_PROC, "processes", 1);
+    name_group(G_DISK, "disk", 2);
+    for (int c = 0; c < NCPU; c++)
+        name_track(G_CPU, c, "cpu %d", c);
+    name_track(G_DISK, 0, "virtio%d", 0);
+
+    for (long i = 0; i < nrecs; i++)
+        convert(&recs[i]);
+
+    // close what is still open at the end.
+    uint64 end = recs[nrecs - 1].ts;
+    for (int c = 0; c < NCPU; c++)
+        if (oncpu[c]) {
+            event("E", end, G_CPU, c);
+            printf("}");
+        }
+    for (int p = 1; p < MAXPID; p++)
+        if (insys[p]) {
+            event("E", end, G_PROC, p);
+            printf("}");
+        }
+    printf("\n]}\n");
+
+    fprintf(stderr, "trace2json: %ld records\n", nrecs);
+    return 0;
+}
@@ -0,0 +1,132 @@
+//
+// Allocation tracing.
+//
+// While tracing is on, kmem_cache_alloc/free, kmalloc/kfree and
+// buddy_alloc/free append a struct atrace to a ring, which user
+// space drains with atrace(ATRACE_READ, ...); see user/atrace.c.
+// Records made while the slab allocator is getting pages for
+// itself carry AT_NESTED, so a replay of the top-level calls
+// doesn't do that work twice.  A full ring drops new records
+// and counts them rather than overwrite ones not yet read.
+//
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "defs.h"
+#include "atrace.h"
+
+#define NATRACE 4096   // records in the ring; a power of two
+
+volatile int atrace_on;
+
+static struct {
+  struct spinlock lock;
+  struct atrace rec[NATRACE];
+  uint r;              // next to read
+  uint w;              // next to write
+  uint dropped;
+} ring;
+
+// depth of slab-internal page allocation on each CPU.
+static int nest[NCPU];
+
+void
+atraceinit(void)
+{
+  initlock(&ring.lock, "atrace");
+}
+
+void
+atrace_record(int op, void *id, uint64 size, void *addr)
+{
+  struct atrace *t;
+  int c;
+
+  acquire(&ring.lock);
+  c = cpuid();
+  if(ring.w - ring.r == NATRACE){
+    ring.dropped++;
+  } else {
+    t = &ring.rec[ring.w++ % NATRACE];
+    t->ts = r_time();
+    t->cache = (uint64)id;
+    t->addr = (uint64)addr;
+    t->size = size;
+    t->op = op | (nest[c] ? AT_NESTED : 0);
+    t->cpu = c;
+  }
+  release(&ring.lock);
+}
+
+// bracket the slab allocator's own page allocations, whose
+// records get AT_NESTED.  keeps the CPU from changing in between.
+void
+atrace_nest(int d)
+{
+  if(d > 0){
+    push_off();
+    nest[cpuid()]++;
+  } else {
+    nest[cpuid()]--;
+    pop_off();
+  }
+}
+
+// copy up to n records to user address dst; returns how many.
+static int
+atraceread(uint64 dst, int n)
+{
+  struct atrace buf[16];
+  int k, done = 0;
+
+  while(done < n){
+    acquire(&ring.lock);
+    for(k = 0; k < NELEM(buf) && done + k < n && ring.r != ring.w; k++)
+      buf[k] = ring.rec[ring.r++ % NATRACE];
+    release(&ring.lock);
+    if(k == 0)
+      break;
+    // copyout may fault in a page, which may be traced itself,
+    // so the ring lock can't be held here.
+    if(copyout(myproc()->pagetable, dst + done*sizeof(struct atrace),
+               (char*)buf, k*sizeof(struct atrace)) < 0)
+      return -1;
+    done += k;
+  }
+  return done;
+}
+
+uint64
+sys_atrace(void)
+{
+  int cmd, n;
+  uint64 buf;
+
+  argint(0, &cmd);
+  argaddr(1, &buf);
+  argint(2, &n);
+
+  switch(cmd){
+  case ATRACE_STOP:
+    atrace_on = 0;
+    return 0;
+  case ATRACE_START:
+    acquire(&ring.lock);
+    ring.r = ring.w = 0;
+    ring.dropped = 0;
+    release(&ring.lock);
+    atrace_on = 1;
+    return 0;
+  case ATRACE_READ:
+    if((n = atraceread(buf, n)) == 0 && !atrace_on)
+      return -1;
+    return n;
+  case ATRACE_DROPPED:
+    return ring.dropped;
+  }
+  return -1;
+}
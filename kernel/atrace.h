@@ -0,0 +1,28 @@
+// Allocation trace records, written by kernel/atrace.c and read
+// back with the atrace() system call.
+
+#define AT_ALLOC    1   // kmem_cache_alloc; size is the object size
+#define AT_FREE     2   // kmem_cache_free
+#define AT_KMALLOC  3   // kmalloc; size is the requested size
+#define AT_KFREE    4   // kfree
+#define AT_PALLOC   5   // buddy_alloc; size is the order
+#define AT_PFREE    6   // buddy_free
+#define AT_NESTED   0x80  // or'd into op: made by another traced call
+                          // (slab growth, kmalloc's cache); a replay skips it
+
+struct atrace {
+  uint64 ts;      // r_time() of the call
+  uint64 cache;   // kmem_cache_t or buddy_allocator address, as an id
+  uint64 addr;    // object or block returned / freed
+  uint size;
+  uchar op;
+  uchar cpu;
+  ushort pad;
+};
+
+// atrace() commands
+#define ATRACE_STOP     0
+#define ATRACE_START    1   // empty the ring and start recording
+#define ATRACE_READ     2   // move up to n records into buf; -1 once
+                            // stopped and empty
+#define ATRACE_DROPPED  3   // records lost to a full ring since START
@@ -22,6 +22,7 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "trace.h"
 #ifdef SLAB_KERNEL
 #include "slab.h"
 #endif
@@ -82,6 +83,7 @@ bget(uint dev, uint blockno)
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
       release(&bcache.lock);
+      TRACE(TC_BIO, TE_BGET, blockno, 1);
       acquiresleep(&b->lock);
       return b;
     }
@@ -96,6 +98,7 @@ bget(uint dev, uint blockno)
       b->valid = 0;
       b->refcnt = 1;
       release(&bcache.lock);
+      TRACE(TC_BIO, TE_BGET, blockno, 0);
       acquiresleep(&b->lock);
       return b;
     }
@@ -3,6 +3,8 @@
 #include "riscv.h"
 #include "buddy.h"
 #include "defs.h"
+#include "atrace.h"
+#include "slabstat.h"
 
 static inline int idx(int order)
 {
@@ -44,6 +46,20 @@ void buddy_dump(struct buddy_allocator *b)
     release(&b->lock);
 }
 
+// count the free blocks of each order.
+void buddy_stat(struct buddy_allocator *b, struct buddystat *st)
+{
+    memset(st, 0, sizeof(*st));
+    acquire(&b->lock);
+    st->start = b->start;
+    st->total_size = b->total_size;
+    st->max_order = b->max_order;
+    for (int o = MIN_ORDER; o <= b->max_order && idx(o) < BUDDYSTAT_ORDERS; o++)
+        for (struct buddy_block *bl = b->free[idx(o)]; bl; bl = bl->next)
+            st->nfree[idx(o)]++;
+    release(&b->lock);
+}
+
 void buddy_init(struct buddy_allocator *b, void *start, void *end)
 {
     initlock(&b->lock, "buddy");
@@ -125,6 +141,8 @@ void *buddy_alloc(struct buddy_allocator *b, int order)
     }
 
     release(&b->lock);
+    if (atrace_on)
+        atrace_record(AT_PALLOC, b, order, bl);
     return (void *)bl;
 }
 
@@ -142,6 +160,10 @@ void buddy_free(struct buddy_allocator *b, void *addr, int order)
         return;
     }
 
+    // traced under the lock, before the block can be reused.
+    if (atrace_on)
+        atrace_record(AT_PFREE, b, order, addr);
+
     uint64 block = (uint64)addr;
 
     while (order < b->max_order) {
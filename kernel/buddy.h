@@ -8,7 +8,7 @@
 #endif
 
 #define MIN_ORDER 0
-#define MAX_ORDER 15   // up to 128MB (2^15 * 4KB)
+#define MAX_ORDER 20   // up to 4GB (2^20 * 4KB)
 
 #define BUDDY_ORDERS (MAX_ORDER - MIN_ORDER + 1)
 
@@ -29,4 +29,7 @@ void *buddy_alloc(struct buddy_allocator *b, int order);
 void buddy_free(struct buddy_allocator *b, void *addr, int order);
 void buddy_dump(struct buddy_allocator *b);
 
+struct buddystat;
+void buddy_stat(struct buddy_allocator *b, struct buddystat *st);
+
 #endif
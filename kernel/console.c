@@ -142,7 +142,7 @@ consoleread(int user_dst, uint64 dst, int n)
 
 //
 // the console input interrupt handler.
-// uartintr() calls this for each input character.
+// uartsoftintr() calls this for each input character.
 // do erase/kill processing, append to cons.buf,
 // wake up consoleread() if a whole line has arrived.
 //
@@ -1,14 +1,27 @@
 struct buf;
 struct buddy_allocator;
+struct buddystat;
 struct context;
 struct file;
+struct irqstat;
+struct work;
+struct files;
+struct fsops;
 struct inode;
 struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
+struct rwsleeplock;
 struct stat;
 struct superblock;
+struct vmspace;
+
+// atrace.c
+extern volatile int atrace_on;
+void            atraceinit(void);
+void            atrace_record(int, void*, uint64, void*);
+void            atrace_nest(int);
 
 // bio.c
 void            binit(void);
@@ -26,6 +39,11 @@ void            consputc(int);
 // exec.c
 int             kexec(char*, char**);
 
+// fdt.c
+extern uint64   fdtpa;
+extern uint64   phystop;
+void            fdtinit(void);
+
 // file.c
 struct file*    filealloc(void);
 void            fileclose(struct file*);
@@ -34,6 +52,16 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filedirents(struct file*, uint64, int, int);
+void            fdinit(struct files*);
+int             fdinstall(struct files*, struct file*);
+void            fdset(struct files*, int, struct file*);
+void            fdrelease(struct files*, int);
+struct file*    fdget(struct files*, int);
+struct file*    fdremove(struct files*, int);
+int             fdcopy(struct files*, struct files*);
+void            fdcloseall(struct files*);
+int             fdlimit(struct files*, int);
 
 // fs.c
 void            fsinit(int);
@@ -41,8 +69,10 @@ int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+struct inode*   iget(uint, uint);
 void            iinit();
 void            ilock(struct inode*);
+void            ilockshared(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
@@ -55,18 +85,33 @@ void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
 void            ireclaim(int);
+int             mount(char*, uint, struct fsops*);
+int             ismount(struct inode*);
+struct inode*   dirfollow(struct inode*, char*, struct inode*);
+
+// futex.c
+void            futexinit(void);
+int             futexwait(uint64, int, int);
+int             futexwake(uint64, int);
 
 // kalloc.c
 void*           kalloc(void);
 void*           kalloc_order(int);
 void            pgfree(void *);
 void            pgfree_order(void *, int);
+void            kalloc_stat(struct buddystat*);
+#ifndef SLAB_KERNEL
+void*           kalloc_small(uint);
+void            pgfree_small(void *, uint);
+#endif
 void            kinit(void);
+void            kinithart(void);
 
 // slab.c
 void            kmem_init(void *, int);
 struct kmem_cache_s *kmem_cache_create(const char *, size_t, void (*)(void *), void (*)(void *));
 int             kmem_cache_shrink(struct kmem_cache_s *);
+int             kmem_cache_reap(void);
 void           *kmem_cache_alloc(struct kmem_cache_s *);
 void            kmem_cache_free(struct kmem_cache_s *, void *);
 void           *kmalloc(size_t);
@@ -87,6 +132,10 @@ void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
 
+// main.c
+void            bootphase(char*);
+void            bootreport(void);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
@@ -97,13 +146,17 @@ int             pipewrite(struct pipe*, uint64, int);
 int             printf(char*, ...) __attribute__ ((format (printf, 1, 2)));
 void            panic(char*) __attribute__((noreturn));
 void            printfinit(void);
+void            printfasync(void);
+int             lognext(char*, int);
 
 // proc.c
 int             cpuid(void);
 void            kexit(int);
 int             kfork(void);
-int             growproc(int);
-void            proc_mapstacks(pagetable_t);
+struct proc*    kthread_create(char*, void (*)(void*), void*, int);
+int             kclone(uint64, uint64, uint64);
+int             kjoin(int, uint64);
+int             growproc(int, uint64*);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kkill(int);
@@ -122,10 +175,18 @@ void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+void            kmem_charge(long);
+int             kgetrusage(int, uint64);
+int             kprocstat(uint64, int);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
 
+// softirq.c
+void            raisesoftirq(int);
+void            softirq(void);
+void            softirqstat(struct irqstat*, int);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
@@ -139,6 +200,11 @@ void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
+void            initrwsleeplock(struct rwsleeplock*, char*);
+void            acquiresleep_rw(struct rwsleeplock*, int);
+void            releasesleep_rw(struct rwsleeplock*);
+int             holdingsleep_rw(struct rwsleeplock*);
+int             sleepstats(uint64, int);
 
 // string.c
 int             memcmp(const void*, const void*, uint);
@@ -148,6 +214,9 @@ char*           safestrcpy(char*, const char*, int);
 int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
+#ifdef RVV
+extern volatile int rvv_enabled;
+#endif
 
 // syscall.c
 void            argint(int, int*);
@@ -157,6 +226,17 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// sysfile.c
+struct inode*   create(char*, short, short, short);
+
+// tmpfs.c
+void            tmpfsinit(void);
+
+// trace.c
+extern volatile uint trace_mask;
+void            traceinit(void);
+void            trace_emit(int, uint64, uint64);
+
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
@@ -168,18 +248,29 @@ extern struct spinlock *tickslock_ptr;
 extern struct spinlock tickslock;
 #endif
 void            prepare_return(void);
+void            ipisend(int);
 
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
+void            uartsoftintr(void);
 void            uartwrite(char [], int);
 void            uartputc_sync(int);
+void            uartkick(void);
+int             uartdrain(void);
 int             uartgetc(void);
 
 // vm.c
 void            kvminit(void);
 void            kvminithart(void);
+void            asidinit(void);
+uint64          uvmswitch(struct proc*);
+void            uvmleave(struct proc*);
+void            uvmshootdown(struct vmspace*);
+void            tlbintr(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
+int             kvmmapstack(uint64, uint64);
+void            kvmunmapstack(uint64);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 uint64          uvmalloc(pagetable_t, uint64, uint64, int);
@@ -199,6 +290,8 @@ uint64          vmfault(pagetable_t, uint64, int);
 // plic.c
 void            plicinit(void);
 void            plicinithart(void);
+int             plicaffinity(int, uint);
+void            plicstat(struct irqstat*);
 int             plic_claim(void);
 void            plic_complete(int);
 
@@ -206,6 +299,17 @@ void            plic_complete(int);
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
 void            virtio_disk_intr(void);
+void            virtio_disk_softintr(void);
+void            virtio_disk_stat(struct irqstat*);
+
+// workqueue.c
+void            workqinit(void);
+void            workqinithart(void);
+void            workinit(struct work*, void (*)(void*), void*);
+int             queuework(struct work*);
+int             queuework_on(int, struct work*);
+void            flushwork(int);
+int             workstats(uint64, int, int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -0,0 +1,181 @@
+// Find out how much RAM there is from the flattened device tree
+// that qemu leaves in memory for the kernel, with its address in
+// a1 at entry; start() saves it in fdtpa.
+//
+// Only the memory nodes under the root are looked at.  The kernel
+// uses the RAM range it was loaded into, and any ranges that
+// continue it without a gap (qemu gives one per NUMA node); other
+// ranges are reported and left alone.  The tree itself sits in RAM
+// the kernel is about to free, so fdtinit() must run before kinit().
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define FDT_MAGIC       0xd00dfeed
+#define FDT_BEGIN_NODE  1
+#define FDT_END_NODE    2
+#define FDT_PROP        3
+#define FDT_NOP         4
+#define FDT_END         9
+
+#define NRANGE   8               // memory ranges looked at
+
+// the most RAM used: its direct map takes 2 MB of page tables a GB.
+#define MAXPHYS  (KERNBASE + (16L << 30))
+
+// all fields big-endian.
+struct fdthdr {
+  uint magic;
+  uint totalsize;
+  uint off_struct;              // nodes and properties
+  uint off_strings;             // property names
+  uint off_rsvmap;
+  uint version;
+  uint last_comp_version;
+  uint boot_cpuid;
+  uint size_strings;
+  uint size_struct;
+};
+
+uint64 fdtpa;                   // where qemu put the tree
+uint64 phystop = KERNBASE + 128*1024*1024;  // until fdtinit()
+
+static struct {
+  uint64 base;
+  uint64 size;
+} ranges[NRANGE];
+static int nrange;
+
+static uint
+be32(void *p)
+{
+  uchar *b = p;
+
+  return ((uint)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+// an n-cell number.
+static uint64
+cells(uint *p, int n)
+{
+  uint64 v = 0;
+
+  while(n-- > 0)
+    v = (v << 32) | be32(p++);
+  return v;
+}
+
+// a memory node's reg property: (address, size) pairs.
+static void
+addranges(uint *reg, int len, int acells, int scells)
+{
+  for(int i = 0; i + acells + scells <= len / 4; i += acells + scells){
+    if(nrange == NRANGE)
+      return;
+    ranges[nrange].base = cells(reg + i, acells);
+    ranges[nrange].size = cells(reg + i + acells, scells);
+    nrange++;
+  }
+}
+
+// walk the tree, collecting memory ranges.  returns -1 if it
+// doesn't look like a device tree.
+static int
+fdtwalk(struct fdthdr *h)
+{
+  char *name, *strs;
+  uint *p, *val;
+  int depth = 0, inmem = 0, acells = 2, scells = 2;
+  uint len;
+
+  if(h == 0 || be32(&h->magic) != FDT_MAGIC)
+    return -1;
+  p = (uint*)((char*)h + be32(&h->off_struct));
+  strs = (char*)h + be32(&h->off_strings);
+
+  for(;;){
+    switch(be32(p++)){
+    case FDT_BEGIN_NODE:
+      name = (char*)p;
+      depth++;
+      inmem = depth == 2 && strncmp(name, "memory", 6) == 0 &&
+              (name[6] == 0 || name[6] == '@');
+      p += (strlen(name) + 4) / 4;
+      break;
+    case FDT_END_NODE:
+      depth--;
+      inmem = 0;
+      break;
+    case FDT_PROP:
+      // the root's properties come before its children, so the
+      // cell sizes are known by the time a memory node turns up.
+      len = be32(p);
+      name = strs + be32(p + 1);
+      val = p + 2;
+      p = val + (len + 3) / 4;
+      if(depth == 1 && strncmp(name, "#address-cells", 15) == 0)
+        acells = be32(val);
+      else if(depth == 1 && strncmp(name, "#size-cells", 12) == 0)
+        scells = be32(val);
+      else if(inmem && strncmp(name, "reg", 4) == 0)
+        addranges(val, len, acells, scells);
+      break;
+    case FDT_NOP:
+      break;
+    case FDT_END:
+      return 0;
+    default:
+      return -1;
+    }
+  }
+}
+
+// set phystop to the end of the RAM the kernel is in.
+void
+fdtinit(void)
+{
+  uint64 top;
+  int i, grew;
+
+  if(fdtwalk((struct fdthdr*)fdtpa) < 0 || nrange == 0){
+    printf("fdt: no memory in device tree at %p; assuming %ld MB\n",
+           (void*)fdtpa, (phystop - KERNBASE) >> 20);
+    return;
+  }
+
+  // the range holding the kernel, then any that continue it.
+  top = 0;
+  for(i = 0; i < nrange; i++)
+    if(ranges[i].base <= KERNBASE && KERNBASE < ranges[i].base + ranges[i].size)
+      top = ranges[i].base + ranges[i].size;
+  if(top == 0){
+    printf("fdt: no memory at %p; assuming %ld MB\n",
+           (void*)KERNBASE, (phystop - KERNBASE) >> 20);
+    return;
+  }
+  do {
+    grew = 0;
+    for(i = 0; i < nrange; i++){
+      if(ranges[i].base == top && ranges[i].size > 0){
+        top += ranges[i].size;
+        grew = 1;
+      }
+    }
+  } while(grew);
+
+  for(i = 0; i < nrange; i++)
+    if(ranges[i].base + ranges[i].size <= KERNBASE || ranges[i].base >= top)
+      printf("fdt: not using memory at %p, %ld MB\n",
+             (void*)ranges[i].base, ranges[i].size >> 20);
+
+  if(top > MAXPHYS){
+    printf("fdt: using only %ld of %ld MB\n",
+           (MAXPHYS - KERNBASE) >> 20, (top - KERNBASE) >> 20);
+    top = MAXPHYS;
+  }
+  phystop = PGROUNDDOWN(top);
+  printf("memory: %ld MB\n", (phystop - KERNBASE) >> 20);
+}
@@ -21,19 +21,14 @@ struct devsw *devsw;  // dynamically allocated via kmalloc
 #else
 struct devsw devsw[NDEV];
 #endif
-struct {
-  struct spinlock lock;
+
 #ifdef SLAB_KERNEL
-  struct file *file;   // dynamically allocated via kmalloc
-#else
-  struct file file[NFILE];  // static array (original xv6)
+static kmem_cache_t *file_cache;
 #endif
-} ftable;
 
 void
 fileinit(void)
 {
-  initlock(&ftable.lock, "ftable");
 #ifdef SLAB_KERNEL
   // Allocate devsw table dynamically
   if(!devsw) {
@@ -42,40 +37,37 @@ fileinit(void)
       panic("fileinit: kmalloc devsw");
     memset(devsw, 0, sizeof(struct devsw) * NDEV);
   }
-  ftable.file = (struct file*)kmalloc(sizeof(struct file) * NFILE);
-  if(!ftable.file)
-    panic("fileinit: kmalloc");
-  memset(ftable.file, 0, sizeof(struct file) * NFILE);
+  file_cache = kmem_cache_create("file", sizeof(struct file), 0, 0);
+  if(!file_cache)
+    panic("fileinit: cache create");
 #endif
 }
 
-// Allocate a file structure.
+// Allocate a file structure, with one reference.
 struct file*
 filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+#ifdef SLAB_KERNEL
+  f = (struct file*)kmem_cache_alloc(file_cache);
+#else
+  f = (struct file*)kalloc_small(sizeof(*f));
+#endif
+  if(f == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  initsleeplock(&f->offlock, "file off");
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
 struct file*
 filedup(struct file *f)
 {
-  acquire(&ftable.lock);
-  if(f->ref < 1)
+  if(__atomic_fetch_add(&f->ref, 1, __ATOMIC_RELAXED) < 1)
     panic("filedup");
-  f->ref++;
-  release(&ftable.lock);
   return f;
 }
 
@@ -84,18 +76,18 @@ void
 fileclose(struct file *f)
 {
   struct file ff;
+  int ref;
 
-  acquire(&ftable.lock);
-  if(f->ref < 1)
+  if((ref = __atomic_sub_fetch(&f->ref, 1, __ATOMIC_ACQ_REL)) < 0)
     panic("fileclose");
-  if(--f->ref > 0){
-    release(&ftable.lock);
+  if(ref > 0)
     return;
-  }
   ff = *f;
-  f->ref = 0;
-  f->type = FD_NONE;
-  release(&ftable.lock);
+#ifdef SLAB_KERNEL
+  kmem_cache_free(file_cache, (void*)f);
+#else
+  pgfree_small(f, sizeof(*f));
+#endif
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -115,7 +107,7 @@ filestat(struct file *f, uint64 addr)
   struct stat st;
   
   if(f->type == FD_INODE || f->type == FD_DEVICE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, &st);
     iunlock(f->ip);
     if(copyout(p->pagetable, addr, (char *)&st, sizeof(st)) < 0)
@@ -142,10 +134,15 @@ fileread(struct file *f, uint64 addr, int n)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
+    // readers of other opens of the file run alongside; ones
+    // sharing this f->off take turns.  a writer holds ilock()
+    // exclusively, so it can't move f->off underneath.
+    acquiresleep(&f->offlock);
+    ilockshared(f->ip);
     if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
       f->off += r;
     iunlock(f->ip);
+    releasesleep(&f->offlock);
   } else {
     panic("fileread");
   }
@@ -153,6 +150,83 @@ fileread(struct file *f, uint64 addr, int n)
   return r;
 }
 
+// Read up to n entries of directory f from f->off, skipping empty
+// slots, to user address addr: as struct dirents, or if withstat,
+// as struct dirstats, with what stat() on each name would return.
+// Returns the number read, 0 at the end of the directory.
+//
+// Entries are taken a batch of up to 8 at a time with the directory
+// locked once.  With withstat, the batch's inodes are referenced
+// then, so an unlink can't free them, and locked to stat only after
+// the directory is unlocked, since ".." is above it in the locking
+// order; the batch is stat'd in one transaction, unless some were
+// unlinked meanwhile and their iput()s free them.  The small batch
+// keeps a call to at most 8 references besides the directory's, so
+// that concurrent calls don't use up the inode table, which iget()
+// can't recover from.
+int
+filedirents(struct file *f, uint64 addr, int n, int withstat)
+{
+  struct proc *p = myproc();
+  struct inode *dp = f->ip, *ip, *ips[8];
+  struct dirent de[NELEM(ips)];
+  struct dirstat ds[NELEM(ips)];
+  int i, k, done = 0, err = 0;
+
+  if(f->type != FD_INODE || f->readable == 0 || n < 0)
+    return -1;
+
+  acquiresleep(&f->offlock);
+  while(done < n && !err){
+    ilockshared(dp);
+    if(dp->type != T_DIR){
+      iunlock(dp);
+      err = 1;
+      break;
+    }
+    for(k = 0; k < NELEM(de) && done + k < n && f->off < dp->size; f->off += sizeof(de[0])){
+      if(readi(dp, 0, (uint64)&de[k], f->off, sizeof(de[0])) != sizeof(de[0]))
+        panic("filedirents");
+      if(de[k].inum == 0)
+        continue;
+      if(withstat)
+        ips[k] = iget(dp->dev, de[k].inum);
+      k++;
+    }
+    iunlock(dp);
+    if(k == 0)
+      break;
+
+    if(!withstat){
+      if(copyout(p->pagetable, addr + done*sizeof(de[0]), (char*)de, k*sizeof(de[0])) < 0)
+        err = 1;
+    } else {
+      begin_op();
+      for(i = 0; i < k; i++){
+        memset(&ds[i], 0, sizeof(ds[i]));
+        memmove(ds[i].name, de[i].name, DIRSIZ);
+        if((ip = dirfollow(dp, ds[i].name, ips[i])) != 0){
+          ilockshared(ip);
+          stati(ip, &ds[i].st);
+          iunlockput(ip);
+          // that iput() may have freed an unlinked inode, which
+          // fills a transaction; start another for the rest.
+          if(ds[i].st.nlink == 0 && i + 1 < k){
+            end_op();
+            begin_op();
+          }
+        }
+      }
+      end_op();
+      if(copyout(p->pagetable, addr + done*sizeof(ds[0]), (char*)ds, k*sizeof(ds[0])) < 0)
+        err = 1;
+    }
+    done += k;
+  }
+  releasesleep(&f->offlock);
+  return err ? -1 : done;
+}
+
 // Write to file f.
 // addr is a user virtual address.
 int
@@ -202,3 +276,197 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+// Descriptor tables.  A table starts out in the NOFILE slots of
+// inofile[] and doubles when it runs out, up to fs->maxfd.
+// fdmap[] has a bit set for each descriptor in use, so the lowest
+// free one is found a word at a time.  A descriptor can be taken
+// before its file is ready: it reads as closed until fdset() fills
+// it in, so no other thread sees a half-made file.
+
+// Set up the empty descriptor table of a zeroed struct files.
+void
+fdinit(struct files *fs)
+{
+  fs->ofile = fs->inofile;
+  fs->nfd = NOFILE;
+  fs->maxfd = NOFILEMAX;
+}
+
+static void
+fdtabfree(struct files *fs)
+{
+  if(fs->ofile == fs->inofile)
+    return;
+#ifdef SLAB_KERNEL
+  kfree(fs->ofile);
+#else
+  pgfree((char*)fs->ofile);
+#endif
+  fs->ofile = fs->inofile;
+}
+
+// Grow fs's table to hold at least n descriptors.
+// Caller holds fs->lock, or has fs to itself.
+static int
+fdgrow(struct files *fs, int n)
+{
+  struct file **t;
+  int nfd = fs->nfd;
+
+  while(nfd < n)
+    nfd *= 2;
+  if(nfd > NOFILEMAX)
+    nfd = NOFILEMAX;
+#ifdef SLAB_KERNEL
+  t = (struct file**)kmalloc(nfd * sizeof(t[0]));
+#else
+  // NOFILEMAX pointers fit in a page.
+  t = (struct file**)kalloc();
+#endif
+  if(t == 0)
+    return -1;
+  memmove(t, fs->ofile, fs->nfd * sizeof(t[0]));
+  memset(t + fs->nfd, 0, (nfd - fs->nfd) * sizeof(t[0]));
+  fdtabfree(fs);
+  fs->ofile = t;
+  fs->nfd = nfd;
+  return 0;
+}
+
+// Install f at the lowest free descriptor in fs and return it,
+// taking over the caller's reference to f; if f is 0, just take the
+// descriptor, for fdset() or fdrelease().  Return -1 if fs is at
+// its limit or memory is short.
+int
+fdinstall(struct files *fs, struct file *f)
+{
+  int w, fd;
+
+  acquire(&fs->lock);
+  for(w = 0; w < NELEM(fs->fdmap); w++)
+    if(~fs->fdmap[w])
+      break;
+  fd = w < NELEM(fs->fdmap) ? w*64 + __builtin_ctzll(~fs->fdmap[w]) : NOFILEMAX;
+  if(fd >= fs->maxfd || (fd >= fs->nfd && fdgrow(fs, fd + 1) < 0)){
+    release(&fs->lock);
+    return -1;
+  }
+  fs->fdmap[fd/64] |= 1UL << (fd%64);
+  fs->ofile[fd] = f;
+  release(&fs->lock);
+  return fd;
+}
+
+// Fill in descriptor fd, taken by fdinstall(fs, 0), with f, taking
+// over the caller's reference.
+void
+fdset(struct files *fs, int fd, struct file *f)
+{
+  acquire(&fs->lock);
+  fs->ofile[fd] = f;
+  release(&fs->lock);
+}
+
+// Give back descriptor fd, taken by fdinstall(fs, 0) and not
+// filled in.
+void
+fdrelease(struct files *fs, int fd)
+{
+  acquire(&fs->lock);
+  fs->fdmap[fd/64] &= ~(1UL << (fd%64));
+  release(&fs->lock);
+}
+
+// Return the file open at descriptor fd in fs with a new reference,
+// which the caller drops with fileclose(), or 0 if fd isn't open.
+// The reference keeps the file alive if another thread closes fd.
+struct file*
+fdget(struct files *fs, int fd)
+{
+  struct file *f = 0;
+
+  acquire(&fs->lock);
+  if(fd >= 0 && fd < fs->nfd && (f = fs->ofile[fd]) != 0)
+    filedup(f);
+  release(&fs->lock);
+  return f;
+}
+
+// Take descriptor fd out of fs and return its file, passing the
+// table's reference to the caller, or 0 if fd isn't open.
+struct file*
+fdremove(struct files *fs, int fd)
+{
+  struct file *f = 0;
+
+  acquire(&fs->lock);
+  if(fd >= 0 && fd < fs->nfd && (f = fs->ofile[fd]) != 0){
+    fs->ofile[fd] = 0;
+    fs->fdmap[fd/64] &= ~(1UL << (fd%64));
+  }
+  release(&fs->lock);
+  return f;
+}
+
+// Give the empty table dst the descriptors and limit of src,
+// for fork().  dst is not yet visible to anyone else.
+int
+fdcopy(struct files *dst, struct files *src)
+{
+  acquire(&src->lock);
+  if(src->nfd > dst->nfd && fdgrow(dst, src->nfd) < 0){
+    release(&src->lock);
+    return -1;
+  }
+  dst->maxfd = src->maxfd;
+  // a descriptor taken but not yet filled in stays with src.
+  for(int fd = 0; fd < src->nfd; fd++){
+    if(src->ofile[fd]){
+      dst->ofile[fd] = filedup(src->ofile[fd]);
+      dst->fdmap[fd/64] |= 1UL << (fd%64);
+    }
+  }
+  release(&src->lock);
+  return 0;
+}
+
+// Close every descriptor in fs and free its table, once no thread
+// is using it.
+void
+fdcloseall(struct files *fs)
+{
+  for(int fd = 0; fd < fs->nfd; fd++){
+    if(fs->ofile[fd]){
+      fileclose(fs->ofile[fd]);
+      fs->ofile[fd] = 0;
+    }
+  }
+  memset(fs->fdmap, 0, sizeof(fs->fdmap));
+  fdtabfree(fs);
+  fs->nfd = NOFILE;
+}
+
+// Set the most descriptors fs may have open to n, if none at or
+// above n is open or taken, and return the old limit; n == 0 just
+// returns it.
+int
+fdlimit(struct files *fs, int n)
+{
+  int old;
+
+  if(n < 0 || n > NOFILEMAX)
+    return -1;
+  acquire(&fs->lock);
+  old = fs->maxfd;
+  if(n > 0){
+    for(int fd = n; fd < fs->nfd; fd++){
+      if(fs->fdmap[fd/64] & (1UL << (fd%64))){
+        release(&fs->lock);
+        return -1;
+      }
+    }
+    fs->maxfd = n;
+  }
+  release(&fs->lock);
+  return old;
+}
@@ -6,6 +6,7 @@ struct file {
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
+  struct sleeplock offlock; // FD_INODE; serializes reads, which share off
   short major;       // FD_DEVICE
 };
 
@@ -18,7 +19,8 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
-  struct sleeplock lock; // protects everything below here
+  struct fsops *op;   // Its file system's operations
+  struct rwsleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
   short type;         // copy of disk inode
@@ -29,6 +31,20 @@ struct inode {
   uint addrs[NDIRECT+1];
 };
 
+// What each kind of file system does for the generic inode code in
+// fs.c: the disk's are in fs.c, the RAM file system's in tmpfs.c.
+// All but ialloc() are called with ip locked.
+struct fsops {
+  struct inode* (*ialloc)(uint dev, short type);
+  void (*iload)(struct inode *ip);     // fill in ip->type, size, &c
+  void (*iupdate)(struct inode *ip);   // store them; type 0 frees it
+  void (*itrunc)(struct inode *ip);
+  int (*readi)(struct inode*, int, uint64, uint, uint);
+  int (*writei)(struct inode*, int, uint64, uint, uint);
+  // look for a name among the dirents in [off, end)
+  struct inode* (*dirlookup)(struct inode*, char*, uint off, uint end, uint*);
+};
+
 // map major device number to device functions.
 struct devsw {
   int (*read)(int, uint64, int);
@@ -15,8 +15,8 @@
 #include "param.h"
 #include "stat.h"
 #include "spinlock.h"
-#include "proc.h"
 #include "sleeplock.h"
+#include "proc.h"
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
@@ -34,6 +34,33 @@ struct superblock *sb_ptr;  // dynamically allocated via kmalloc
 struct superblock sb; 
 #endif
 
+static struct fsops diskfsops;
+
+// Mount table.  Entry 0 is the disk at /.  mount() adds the others
+// at boot, before any user process runs, and entries never change
+// after that, so they're read without a lock.  Every file system's
+// root directory is inode ROOTINO.
+static struct mount {
+  uint dev;
+  struct fsops *op;
+  struct inode *on;     // directory it covers, on the parent fs
+  struct inode *root;   // its root directory, held while mounted
+} mounts[NMOUNT] = {
+  { ROOTDEV, &diskfsops },
+};
+static int nmount = 1;
+
+static struct fsops*
+fsop(uint dev)
+{
+  struct mount *m;
+
+  for(m = mounts; m < &mounts[nmount]; m++)
+    if(m->dev == dev)
+      return m->op;
+  panic("fsop: no file system");
+}
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sbp)
@@ -183,10 +210,15 @@ bfree(int dev, uint b)
 // entries. Since ip->ref indicates whether an entry is free,
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold itable.lock while using any of those fields.
+// iget() also sets ip->op, the operations of the file system
+// (disk or tmpfs) that dev is, which everything else goes through.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
+// It is a reader/writer lock: ilockshared() lets paths that only
+// read the inode and its content (read(), exec, path lookup) run
+// together, while ilock() is needed to change anything.
 
 struct {
   struct spinlock lock;
@@ -213,18 +245,22 @@ iinit()
 #endif
 
   for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
+    initrwsleeplock(&itable.inode[i].lock, "inode");
   }
 }
 
-static struct inode* iget(uint dev, uint inum);
-
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
 // Returns an unlocked but allocated and referenced inode,
 // or NULL if there is no free inode.
 struct inode*
 ialloc(uint dev, short type)
+{
+  return fsop(dev)->ialloc(dev, type);
+}
+
+static struct inode*
+diskialloc(uint dev, short type)
 {
   int inum;
   struct buf *bp;
@@ -252,6 +288,12 @@ ialloc(uint dev, short type)
 // Caller must hold ip->lock.
 void
 iupdate(struct inode *ip)
+{
+  ip->op->iupdate(ip);
+}
+
+static void
+diskiupdate(struct inode *ip)
 {
   struct buf *bp;
   struct dinode *dip;
@@ -271,7 +313,7 @@ iupdate(struct inode *ip)
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
-static struct inode*
+struct inode*
 iget(uint dev, uint inum)
 {
   struct inode *ip, *empty;
@@ -297,6 +339,7 @@ iget(uint dev, uint inum)
   ip = empty;
   ip->dev = dev;
   ip->inum = inum;
+  ip->op = fsop(dev);
   ip->ref = 1;
   ip->valid = 0;
   release(&itable.lock);
@@ -320,38 +363,63 @@ idup(struct inode *ip)
 void
 ilock(struct inode *ip)
 {
-  struct buf *bp;
-  struct dinode *dip;
-
   if(ip == 0 || ip->ref < 1)
     panic("ilock");
 
-  acquiresleep(&ip->lock);
+  acquiresleep_rw(&ip->lock, 1);
 
   if(ip->valid == 0){
-    bp = bread(ip->dev, IBLOCK(ip->inum, sb));
-    dip = (struct dinode*)bp->data + ip->inum%IPB;
-    ip->type = dip->type;
-    ip->major = dip->major;
-    ip->minor = dip->minor;
-    ip->nlink = dip->nlink;
-    ip->size = dip->size;
-    memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
-    brelse(bp);
+    ip->op->iload(ip);
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
   }
 }
 
-// Unlock the given inode.
+static void
+diskiload(struct inode *ip)
+{
+  struct buf *bp;
+  struct dinode *dip;
+
+  bp = bread(ip->dev, IBLOCK(ip->inum, sb));
+  dip = (struct dinode*)bp->data + ip->inum%IPB;
+  ip->type = dip->type;
+  ip->major = dip->major;
+  ip->minor = dip->minor;
+  ip->nlink = dip->nlink;
+  ip->size = dip->size;
+  memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+  brelse(bp);
+}
+
+// Lock the given inode shared with other readers, for paths that
+// only look at it: readi(), stati(), dirlookup().  Reads the inode
+// from disk if necessary, under the exclusive lock.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  acquiresleep_rw(&ip->lock, 0);
+  if(ip->valid == 0){
+    // our reference keeps valid set once ilock() sets it.
+    releasesleep_rw(&ip->lock);
+    ilock(ip);
+    releasesleep_rw(&ip->lock);
+    acquiresleep_rw(&ip->lock, 0);
+  }
+}
+
+// Unlock the given inode, locked either way.
 void
 iunlock(struct inode *ip)
 {
-  if(ip == 0 || !holdingsleep(&ip->lock) || ip->ref < 1)
+  if(ip == 0 || !holdingsleep_rw(&ip->lock) || ip->ref < 1)
     panic("iunlock");
 
-  releasesleep(&ip->lock);
+  releasesleep_rw(&ip->lock);
 }
 
 // Drop a reference to an in-memory inode.
@@ -370,8 +438,8 @@ iput(struct inode *ip)
     // inode has no links and no other references: truncate and free.
 
     // ip->ref == 1 means no other process can have ip locked,
-    // so this acquiresleep() won't block (or deadlock).
-    acquiresleep(&ip->lock);
+    // so this acquiresleep_rw() won't block (or deadlock).
+    acquiresleep_rw(&ip->lock, 1);
 
     release(&itable.lock);
 
@@ -380,7 +448,7 @@ iput(struct inode *ip)
     iupdate(ip);
     ip->valid = 0;
 
-    releasesleep(&ip->lock);
+    releasesleep_rw(&ip->lock);
 
     acquire(&itable.lock);
   }
@@ -474,6 +542,12 @@ bmap(struct inode *ip, uint bn)
 // Caller must hold ip->lock.
 void
 itrunc(struct inode *ip)
+{
+  ip->op->itrunc(ip);
+}
+
+static void
+diskitrunc(struct inode *ip)
 {
   int i, j;
   struct buf *bp;
@@ -499,7 +573,7 @@ itrunc(struct inode *ip)
   }
 
   ip->size = 0;
-  iupdate(ip);
+  diskiupdate(ip);
 }
 
 // Copy stat information from inode.
@@ -520,6 +594,12 @@ stati(struct inode *ip, struct stat *st)
 // otherwise, dst is a kernel address.
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
+{
+  return ip->op->readi(ip, user_dst, dst, off, n);
+}
+
+static int
+diskreadi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
@@ -554,6 +634,12 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 // there was an error of some kind.
 int
 writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
+{
+  return ip->op->writei(ip, user_src, src, off, n);
+}
+
+static int
+diskwritei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
@@ -583,7 +669,7 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   // write the i-node back to disk even if the size didn't change
   // because the loop above might have called bmap() and added a new
   // block to ip->addrs[].
-  iupdate(ip);
+  diskiupdate(ip);
 
   return tot;
 }
@@ -596,18 +682,119 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Hashed directories.
+//
+// A directory starts out as a list of dirents.  When it fills
+// DIRLINEAR blocks, dirlink() turns it into a one-level hash tree:
+// block 0 becomes an index and the others leaves, blocks of
+// dirents whose names hash into a range.  The index is a count and
+// a list of (first hash, block) pairs sorted by hash, and a name's
+// leaf is the last one whose first hash is <= the name's, so a
+// lookup reads two blocks however big the directory is.  A full
+// leaf is split in two by hash into a new block at the end.  Leaves
+// are never merged.  The inode's minor, unused for directories,
+// says which format it's in.
+//
+// The index puts three pairs in each 16-byte slot, after two zero
+// bytes, so read as plain dirents the whole directory is still
+// valid: the index is all empty entries.  Everything goes through
+// readi() and writei(), so it works for any file system, and
+// converting or splitting writes at most a few blocks, which keeps
+// within a log transaction's MAXOPBLOCKS.
+
+#define DIRLINEAR  2        // blocks before hashing; (DIRLINEAR+2)*BSIZE <= PGSIZE
+#define LEAFN      (BSIZE / sizeof(struct dirent))    // entries in a leaf
+#define DXMAX      (3 * (LEAFN - 1))                  // leaves in an index
+
+// A name's hash: FNV-1a, folded to 16 bits.
+static uint
+namehash(char *name)
+{
+  uint h = 2166136261;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return (h ^ (h >> 16)) & 0xFFFF;
+}
+
+// In the index: the count is the ushort at byte 2; pair i is two
+// ushorts, its first hash and its block, at dxoff(i).
+#define DXCOUNT  2
+
+static uint
+dxoff(int i)
+{
+  return sizeof(struct dirent) * (1 + i/3) + sizeof(ushort) * (1 + 2*(i%3));
+}
+
+static uint
+dxread(struct inode *dp, uint off)
+{
+  ushort v;
+
+  if(readi(dp, 0, (uint64)&v, off, sizeof(v)) != sizeof(v))
+    panic("dxread");
+  return v;
+}
+
+// The pair for the leaf holding hash h.  Pair 0's first hash is 0.
+static int
+dxfind(struct inode *dp, uint h)
+{
+  int lo = 0, hi = dxread(dp, DXCOUNT) - 1, mid;
+
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(dxread(dp, dxoff(mid)) <= h)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+// Byte offset in dp of the leaf of pair i.
+static uint
+dxleaf(struct inode *dp, int i)
+{
+  return dxread(dp, dxoff(i) + sizeof(ushort)) * BSIZE;
+}
+
+static void
+dxset(char *idx, int i, uint h, uint b)
+{
+  ushort *p = (ushort*)(idx + dxoff(i));
+
+  p[0] = h;
+  p[1] = b;
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
-  struct dirent de;
+  uint off;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
+  if(dp->minor != DIR_HASHED)
+    return dp->op->dirlookup(dp, name, 0, dp->size, poff);
+  off = dxleaf(dp, dxfind(dp, namehash(name)));
+  return dp->op->dirlookup(dp, name, off, off + BSIZE, poff);
+}
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
+// Look for name among the entries in [off, end) of dp.
+static struct inode*
+diskdirlookup(struct inode *dp, char *name, uint off, uint end, uint *poff)
+{
+  uint inum;
+  struct dirent de;
+
+  for(; off < end; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
     if(de.inum == 0)
@@ -624,14 +811,184 @@ dirlookup(struct inode *dp, char *name, uint *poff)
   return 0;
 }
 
+static struct fsops diskfsops = {
+  .ialloc = diskialloc,
+  .iload = diskiload,
+  .iupdate = diskiupdate,
+  .itrunc = diskitrunc,
+  .readi = diskreadi,
+  .writei = diskwritei,
+  .dirlookup = diskdirlookup,
+};
+
+// Sort the n entries in de, whose hashes are in hs, by hash.
+static void
+dxsort(struct dirent *de, ushort *hs, int n)
+{
+  struct dirent t;
+  ushort h;
+  int i, j;
+
+  for(i = 1; i < n; i++){
+    t = de[i];
+    h = hs[i];
+    for(j = i; j > 0 && hs[j-1] > h; j--){
+      de[j] = de[j-1];
+      hs[j] = hs[j-1];
+    }
+    de[j] = t;
+    hs[j] = h;
+  }
+}
+
+// Turn dp, a full linear directory of DIRLINEAR blocks, into an
+// index and DIRLINEAR+1 leaves, a third full each.  The new layout
+// is built in one page, so it can be no bigger than that.
+static int
+dxconvert(struct inode *dp)
+{
+  enum { N = DIRLINEAR * LEAFN, NL = DIRLINEAR + 1 };
+  ushort hs[N];
+  struct dirent *de;
+  char *old, *new;
+  int i, k, n, pos, end;
+
+  old = kalloc();
+  new = kalloc();
+  if(old == 0 || new == 0)
+    goto bad;
+  if(readi(dp, 0, (uint64)old, 0, N * sizeof(*de)) != N * sizeof(*de))
+    panic("dxconvert read");
+  de = (struct dirent*)old;
+  for(i = n = 0; i < N; i++){
+    if(de[i].inum != 0){
+      de[n] = de[i];
+      hs[n++] = namehash(de[i].name);
+    }
+  }
+  dxsort(de, hs, n);
+
+  // lay out the index and leaves in new, splitting where the hash
+  // changes so equal hashes share a leaf.
+  memset(new, 0, PGSIZE);
+  ((ushort*)new)[DXCOUNT/sizeof(ushort)] = NL;
+  for(k = pos = 0; k < NL; k++){
+    end = k == NL-1 ? n : (k+1) * n / NL;
+    if(end < pos)
+      end = pos;
+    while(end > 0 && end < n && hs[end] == hs[end-1])
+      end++;
+    if(end - pos > LEAFN)
+      goto bad;
+    dxset(new, k, k == 0 ? 0 : (pos < n ? hs[pos] : 0xFFFF), k + 1);
+    memmove(new + (k+1)*BSIZE, &de[pos], (end - pos) * sizeof(*de));
+    pos = end;
+  }
+
+  // grow dp with zeros first: if that fails it's still a valid
+  // linear directory.
+  memset(old, 0, BSIZE);
+  for(i = DIRLINEAR; i < NL + 1; i++)
+    if(writei(dp, 0, (uint64)old, i*BSIZE, BSIZE) != BSIZE)
+      goto bad;
+  if(writei(dp, 0, (uint64)new, 0, (NL+1)*BSIZE) != (NL+1)*BSIZE)
+    panic("dxconvert write");
+  dp->minor = DIR_HASHED;
+  iupdate(dp);
+  pgfree(old);
+  pgfree(new);
+  return 0;
+
+bad:
+  if(old)
+    pgfree(old);
+  if(new)
+    pgfree(new);
+  return -1;
+}
+
+// Split the full leaf of pair i, moving the entries in the upper
+// half of its hashes to a new leaf at the end of dp.
+static int
+dxsplit(struct inode *dp, int i)
+{
+  ushort hs[LEAFN];
+  struct dirent *de, *nde;
+  char *pg, *idx, *zero;
+  uint start, m, nb, leaf, best, lo;
+  int j, k, n, nleaf;
+
+  nleaf = dxread(dp, DXCOUNT);
+  if(nleaf == DXMAX || (pg = kalloc()) == 0)
+    return -1;
+  // the page holds the leaf, the new leaf, the index and zeros.
+  de = (struct dirent*)pg;
+  nde = (struct dirent*)(pg + BSIZE);
+  idx = pg + 2*BSIZE;
+  zero = pg + 3*BSIZE;
+  memset(pg, 0, PGSIZE);
+  leaf = dxleaf(dp, i);
+  start = dxread(dp, dxoff(i));
+  if(readi(dp, 0, (uint64)de, leaf, BSIZE) != BSIZE ||
+     readi(dp, 0, (uint64)idx, 0, BSIZE) != BSIZE)
+    panic("dxsplit read");
+
+  // m: the hash above start that best halves the leaf.
+  for(j = 0; j < LEAFN; j++)
+    hs[j] = namehash(de[j].name);
+  m = 0;
+  best = LEAFN;
+  for(j = 0; j < LEAFN; j++){
+    if(hs[j] <= start)
+      continue;
+    for(k = 0, lo = 0; k < LEAFN; k++)
+      lo += hs[k] < hs[j];
+    if((lo > LEAFN/2 ? lo - LEAFN/2 : LEAFN/2 - lo) < best){
+      best = lo > LEAFN/2 ? lo - LEAFN/2 : LEAFN/2 - lo;
+      m = hs[j];
+    }
+  }
+  if(m == 0){
+    // every name in it hashes the same.
+    pgfree(pg);
+    return -1;
+  }
+
+  for(j = n = 0; j < LEAFN; j++){
+    if(hs[j] >= m){
+      nde[n++] = de[j];
+      memset(&de[j], 0, sizeof(de[j]));
+    }
+  }
+  nb = dp->size / BSIZE;
+  for(k = nleaf; k > i + 1; k--)
+    memmove(idx + dxoff(k), idx + dxoff(k-1), 2*sizeof(ushort));
+  dxset(idx, i + 1, m, nb);
+  ((ushort*)idx)[DXCOUNT/sizeof(ushort)] = nleaf + 1;
+
+  // allocate the new block with zeros first: if that fails,
+  // nothing refers to it or holds copies of entries.
+  if(writei(dp, 0, (uint64)zero, nb*BSIZE, BSIZE) != BSIZE){
+    pgfree(pg);
+    return -1;
+  }
+  if(writei(dp, 0, (uint64)nde, nb*BSIZE, BSIZE) != BSIZE ||
+     writei(dp, 0, (uint64)de, leaf, BSIZE) != BSIZE ||
+     writei(dp, 0, (uint64)idx, 0, BSIZE) != BSIZE)
+    panic("dxsplit write");
+  pgfree(pg);
+  return 0;
+}
+
 // Write a new directory entry (name, inum) into the directory dp.
 // Returns 0 on success, -1 on failure (e.g. out of disk blocks).
 int
 dirlink(struct inode *dp, char *name, uint inum)
 {
-  int off;
+  uint off, end;
   struct dirent de;
   struct inode *ip;
+  int i, split;
 
   // Check that name is not present.
   if((ip = dirlookup(dp, name, 0)) != 0){
@@ -639,12 +996,38 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
-  // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
-      break;
+  if(dp->minor != DIR_HASHED){
+    // Look for an empty dirent.
+    for(off = 0; off < dp->size; off += sizeof(de)){
+      if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirlink read");
+      if(de.inum == 0)
+        break;
+    }
+    // hash it once it fills exactly DIRLINEAR blocks.  dxconvert()
+    // only moves that many, so a linear directory that is already
+    // bigger (from an older mkfs, say) stays linear and grows.
+    if(off == dp->size && dp->size == DIRLINEAR*BSIZE && dxconvert(dp) < 0)
+      return -1;
+  }
+
+  if(dp->minor == DIR_HASHED){
+    // Look for an empty dirent in its leaf, splitting it if full.
+    // One split must make room unless the leaf's names nearly all
+    // hash alike; then the directory is full for this name.
+    for(split = 0; ; split = 1){
+      i = dxfind(dp, namehash(name));
+      for(off = dxleaf(dp, i), end = off + BSIZE; off < end; off += sizeof(de)){
+        if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+          panic("dirlink read");
+        if(de.inum == 0)
+          break;
+      }
+      if(off < end)
+        break;
+      if(split || dxsplit(dp, i) < 0)
+        return -1;
+    }
   }
 
   strncpy(de.name, name, DIRSIZ);
@@ -694,6 +1077,118 @@ skipelem(char *path, char *name)
   return path;
 }
 
+// Mount file system dev, whose operations are op, on the directory
+// path, making the directory if it isn't there.  For boot: the
+// mount table isn't locked.
+int
+mount(char *path, uint dev, struct fsops *op)
+{
+  struct inode *ip;
+  struct mount *m;
+
+  if(nmount == NMOUNT)
+    return -1;
+  begin_op();
+  if((ip = namei(path)) == 0 && (ip = create(path, T_DIR, 0, 0)) != 0)
+    iunlock(ip);
+  if(ip == 0){
+    end_op();
+    return -1;
+  }
+  ilock(ip);
+  if(ip->type != T_DIR){
+    iunlockput(ip);
+    end_op();
+    return -1;
+  }
+  iunlock(ip);
+  end_op();
+
+  m = &mounts[nmount];
+  m->dev = dev;
+  m->op = op;
+  m->on = ip;
+  nmount++;
+  m->root = iget(dev, ROOTINO);
+  return 0;
+}
+
+// Is ip a directory something is mounted on?
+int
+ismount(struct inode *ip)
+{
+  struct mount *m;
+
+  for(m = mounts; m < &mounts[nmount]; m++)
+    if(m->on == ip)
+      return 1;
+  return 0;
+}
+
+// Going down from path lookup: if a file system is mounted on ip,
+// swap ip for its root.
+static struct inode*
+mountdown(struct inode *ip)
+{
+  struct mount *m;
+
+  for(m = mounts; m < &mounts[nmount]; m++){
+    if(m->on == ip){
+      iput(ip);
+      return idup(m->root);
+    }
+  }
+  return ip;
+}
+
+// The directory that the file system whose root is ip is mounted
+// on, or 0 if ip isn't a mounted root.
+static struct inode*
+mountedon(struct inode *ip)
+{
+  struct mount *m;
+
+  for(m = mounts; m < &mounts[nmount]; m++)
+    if(m->on && m->root == ip)
+      return m->on;
+  return 0;
+}
+
+// Going up: ".." from a mounted root is ".." from the directory
+// it's mounted on, so swap ip for that.
+static struct inode*
+mountup(struct inode *ip)
+{
+  struct inode *on;
+
+  if((on = mountedon(ip)) == 0)
+    return ip;
+  iput(ip);
+  return idup(on);
+}
+
+// What path lookup would find for the entry name in directory dp,
+// given ip, the inode the entry holds: the root of a file system
+// mounted on ip, or for ".." in a mounted root, the directory above
+// the mount point.  Takes over the reference to ip; returns a
+// reference, or 0.  dp isn't locked.  Must be called inside a
+// transaction since it calls iput().
+struct inode*
+dirfollow(struct inode *dp, char *name, struct inode *ip)
+{
+  struct inode *on;
+
+  if(namecmp(name, "..") == 0 && (on = mountedon(dp)) != 0){
+    iput(ip);
+    // the mount holds a reference to on.
+    ilockshared(on);
+    ip = dirlookup(on, "..", 0);
+    iunlock(on);
+    return ip;
+  }
+  return mountdown(ip);
+}
+
 // Look up and return the inode for a path name.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
@@ -702,14 +1197,22 @@ static struct inode*
 namex(char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
+  struct files *fs;
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
-  else
-    ip = idup(myproc()->cwd);
+  else {
+    // sys_chdir() in another thread may be replacing cwd.
+    fs = myproc()->files;
+    acquire(&fs->lock);
+    ip = idup(fs->cwd);
+    release(&fs->lock);
+  }
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    if(namecmp(name, "..") == 0)
+      ip = mountup(ip);
+    ilockshared(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
       return 0;
@@ -724,7 +1227,7 @@ namex(char *path, int nameiparent, char *name)
       return 0;
     }
     iunlockput(ip);
-    ip = next;
+    ip = mountdown(next);
   }
   if(nameiparent){
     iput(ip);
@@ -51,7 +51,12 @@ struct dinode {
 #define BBLOCK(b, sb) ((b)/BPB + sb.bmapstart)
 
 // Directory is a file containing a sequence of dirent structures.
+// A big one is hashed, with an index in its first block that reads
+// as empty dirents; see dirlink() in kernel/fs.c.  A directory's
+// minor says which.
 #define DIRSIZ 14
+#define DIR_LINEAR  0
+#define DIR_HASHED  1
 
 // The name field may have DIRSIZ characters and not end in a NUL
 // character.
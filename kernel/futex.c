@@ -0,0 +1,181 @@
+//
+// Fast user-space mutexes: futex_wait() and futex_wake().
+//
+// A thread that finds a user lock busy sleeps in futex_wait()
+// on the lock word's address; the thread that releases the lock
+// calls futex_wake() on the same address.  Waiters are queued in
+// a hash table keyed by the word's physical address, so threads
+// agree on the queue whichever virtual address they use.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NFUTEX 64  // hash buckets; a power of two
+
+// a sleeping futex_wait(), on its kernel stack.
+struct futexw {
+  uint64 pa;              // physical address of the user word
+  void *chan;             // what it sleeps on
+  int woken;              // set by futex_wake()
+  struct futexw *next;
+};
+
+static struct {
+  struct spinlock lock;
+  struct futexw *head;
+} futextab[NFUTEX];
+
+void
+futexinit(void)
+{
+  for(int i = 0; i < NFUTEX; i++)
+    initlock(&futextab[i].lock, "futex");
+}
+
+static int
+futexhash(uint64 pa)
+{
+  return ((pa >> 2) ^ (pa >> 12)) & (NFUTEX - 1);
+}
+
+// Physical address of the aligned user int at va, faulting in
+// lazily allocated memory.  Return 0 if there is none.
+static uint64
+futexaddr(uint64 va)
+{
+  struct proc *p = myproc();
+  uint64 pa;
+
+  if(va % sizeof(int) != 0 || va >= p->vm->sz)
+    return 0;
+  pa = walkaddr(p->pagetable, PGROUNDDOWN(va));
+  if(pa == 0 && (pa = vmfault(p->pagetable, va, 1)) == 0)
+    return 0;
+  return pa + (va % PGSIZE);
+}
+
+static void
+futexunlink(struct futexw **head, struct futexw *w)
+{
+  struct futexw **pp;
+
+  for(pp = head; *pp; pp = &(*pp)->next){
+    if(*pp == w){
+      *pp = w->next;
+      break;
+    }
+  }
+}
+
+// If the int at user address va still holds val, sleep until a
+// futex_wake() on it, or for timeout ticks if timeout > 0.
+// Return 0 if woken, -1 if *va != val or va is bad, -2 on timeout.
+int
+futexwait(uint64 va, int val, int timeout)
+{
+  struct proc *p = myproc();
+  struct futexw w;
+  uint64 pa;
+  uint deadline = 0;
+  int h, r;
+
+  if((pa = futexaddr(va)) == 0)
+    return -1;
+  h = futexhash(pa);
+
+  w.pa = pa;
+  w.woken = 0;
+  // with a timeout, also wake on clock ticks; see clockintr().
+  w.chan = timeout > 0 ? (void*)&ticks : (void*)&w;
+  if(timeout > 0)
+    deadline = ticks + timeout;
+
+  acquire(&futextab[h].lock);
+  // futex_wake() takes the bucket lock too, so a waker that changed
+  // the word before we checked it can't slip past us.
+  if(*(volatile int*)pa != val){
+    release(&futextab[h].lock);
+    return -1;
+  }
+  w.next = futextab[h].head;
+  futextab[h].head = &w;
+
+  for(;;){
+    if(w.woken){
+      r = 0;
+      break;
+    }
+    if(killed(p)){
+      r = -1;
+      break;
+    }
+    if(timeout > 0 && (int)(ticks - deadline) >= 0){
+      r = -2;
+      break;
+    }
+    sleep(w.chan, &futextab[h].lock);
+  }
+  if(!w.woken)
+    futexunlink(&futextab[h].head, &w);
+  release(&futextab[h].lock);
+  return r;
+}
+
+// Wake up to n threads sleeping in futex_wait() on the int at
+// user address va.  Return how many were woken, or -1 if va is bad.
+int
+futexwake(uint64 va, int n)
+{
+  struct futexw **pp, *w;
+  uint64 pa;
+  int h, woken = 0;
+
+  if((pa = futexaddr(va)) == 0)
+    return -1;
+  h = futexhash(pa);
+
+  acquire(&futextab[h].lock);
+  for(pp = &futextab[h].head; *pp && woken < n; ){
+    w = *pp;
+    if(w->pa != pa){
+      pp = &w->next;
+      continue;
+    }
+    *pp = w->next;
+    w->woken = 1;
+    wakeup(w->chan);
+    woken++;
+  }
+  release(&futextab[h].lock);
+  return woken;
+}
+
+uint64
+sys_futex_wait(void)
+{
+  uint64 va;
+  int val, timeout;
+
+  argaddr(0, &va);
+  argint(1, &val);
+  argint(2, &timeout);
+  return futexwait(va, val, timeout);
+}
+
+uint64
+sys_futex_wake(void)
+{
+  uint64 va;
+  int n;
+
+  argaddr(0, &va);
+  argint(1, &n);
+  return futexwake(va, n);
+}
@@ -0,0 +1,31 @@
+// Device interrupt routing, counts and handler times, and disk
+// request latency, returned by the irqstat() system call; see
+// user/irqbench.c.
+
+#ifndef _KERNEL_IRQSTAT_H
+#define _KERNEL_IRQSTAT_H
+
+#define NIRQ 16       // PLIC interrupt sources tracked; virt's uart is 10
+#define ALLHARTS ((1 << NCPU) - 1)  // irqaffinity() mask of every hart
+
+struct irqstat {
+  uint mask[NIRQ];              // harts each IRQ is routed to
+  uint64 count[NCPU][NIRQ];     // interrupts taken, by hart and IRQ
+  // disk requests, from submission until the waiting process runs
+  // again, in r_time() units (10 MHz in qemu).
+  uint64 nio;
+  uint64 iotime;
+  uint64 iotime2;               // sum of squares, for the variance
+  uint64 iomax;                 // worst since the last irqstat()
+  // time in device interrupt handlers, with interrupts off, and in
+  // the work they deferred (softirq.c), with them on; summed over
+  // harts, in r_time() units.
+  uint64 hardtime;
+  uint64 hardmax;               // worst since the last irqstat()
+  uint64 nsoft;                 // runs of deferred work
+  uint64 softtime;
+  int defer;                    // is completion work deferred?
+  int pad;
+};
+
+#endif // _KERNEL_IRQSTAT_H
@@ -34,6 +34,13 @@ kinit()
   kmem_init(0, 0);
 }
 
+// buddy_init() has already put all of memory in a few big blocks;
+// there is nothing for the other harts to do.
+void
+kinithart(void)
+{
+}
+
 void
 pgfree(void *pa)
 {
@@ -64,16 +71,20 @@ pgfree_order(void *pa, int order)
   buddy_free(&global_buddy, pa, order);
 }
 
+void
+kalloc_stat(struct buddystat *st)
+{
+  buddy_stat(&global_buddy, st);
+}
+
 #else
 // -------------------------------------------------------
 //  Deo 1: original xv6 free-list (no buddy for kernel)
 //         slab initializes its own buddy in kmem_init
 // -------------------------------------------------------
 
-// Reserve top 32 MB for slab test buddy
-#define SLAB_RESERVE_BLOCKS  8192
-#define SLAB_RESERVE_SIZE    ((uint64)SLAB_RESERVE_BLOCKS * PGSIZE)
-#define SLAB_RESERVE_START   (PHYSTOP - SLAB_RESERVE_SIZE)
+// Reserve the top of memory for slab test buddy
+#define SLAB_RESERVE_START   (PHYSTOP - SLABRESERVE)
 
 struct run {
   struct run *next;
@@ -84,23 +95,89 @@ struct {
   struct run *freelist;
 } kmem;
 
-void freerange(void *pa_start, void *pa_end);
+// Free lists of small kernel objects (struct file, proc, ...),
+// one per size.  kalloc_small() carves a page into as many as fit
+// when its list is empty, and the pieces stay on that list, so
+// the page is never given back.
+#define NSMALL 8
+
+static struct {
+  struct spinlock lock;   // acquired before kmem.lock
+  struct {
+    uint size;
+    struct run *free;
+  } class[NSMALL];
+} small;
+
+// Boot puts free memory on the free list a chunk at a time, and
+// every hart that is up claims chunks and carves them, so the harts
+// share the work; see kinithart().  The pages aren't junk-filled as
+// they're carved, since kalloc() fills them anyway.
+#define NCHUNK 32
+
+static struct {
+  char *start;          // first page to carve
+  uint64 size;          // bytes in a chunk
+  int next;             // next chunk to claim
+  int done;             // chunks on the free list
+} carve;
 
 void
 kinit()
 {
+  uint64 npage;
+
   initlock(&kmem.lock, "kmem");
+  initlock(&small.lock, "small");
   // Only free pages BELOW the slab reserve region
-  freerange(end, (void*)SLAB_RESERVE_START);
+  carve.start = (char*)PGROUNDUP((uint64)end);
+  npage = (SLAB_RESERVE_START - (uint64)carve.start) / PGSIZE;
+  carve.size = (npage + NCHUNK - 1) / NCHUNK * PGSIZE;
+}
+
+// Claim the next chunk, if any, and put its pages on the free
+// list with one acquire.
+static void
+carveone(void)
+{
+  struct run *r, *head, *tail;
+  char *p, *e;
+  int i;
+
+  if((i = __sync_fetch_and_add(&carve.next, 1)) >= NCHUNK)
+    return;
+  p = carve.start + i * carve.size;
+  e = p + carve.size;
+  if(e > (char*)SLAB_RESERVE_START)
+    e = (char*)SLAB_RESERVE_START;
+  head = tail = 0;
+  for(; p + PGSIZE <= e; p += PGSIZE){
+    r = (struct run*)p;
+    r->next = head;
+    if(head == 0)
+      tail = r;
+    head = r;
+  }
+  if(head){
+    acquire(&kmem.lock);
+    tail->next = kmem.freelist;
+    kmem.freelist = head;
+    release(&kmem.lock);
+  }
+  __atomic_fetch_add(&carve.done, 1, __ATOMIC_RELEASE);
 }
 
+// Called by each hart as it boots, after kinit(): carve chunks
+// until none are left to claim.  Hart 0 calls it last, at the end
+// of boot, and waits for the others' chunks too.
 void
-freerange(void *pa_start, void *pa_end)
+kinithart(void)
 {
-  char *p;
-  p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    pgfree(p);
+  while(__atomic_load_n(&carve.next, __ATOMIC_RELAXED) < NCHUNK)
+    carveone();
+  if(cpuid() == 0)
+    while(__atomic_load_n(&carve.done, __ATOMIC_ACQUIRE) < NCHUNK)
+      ;
 }
 
 void
@@ -125,17 +202,75 @@ kalloc(void)
 {
   struct run *r;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  for(;;){
+    acquire(&kmem.lock);
+    r = kmem.freelist;
+    if(r)
+      kmem.freelist = r->next;
+    release(&kmem.lock);
+    // during boot, memory may still be waiting to be carved.
+    if(r || __atomic_load_n(&carve.done, __ATOMIC_ACQUIRE) == NCHUNK)
+      break;
+    carveone();
+  }
 
   if(r)
     memset((char*)r, 5, PGSIZE);
   return (void*)r;
 }
 
+// Allocate size bytes, several to a page.  Free with
+// pgfree_small() and the same size.  Returns 0 if memory is short.
+void *
+kalloc_small(uint size)
+{
+  struct run *r;
+  char *pa;
+  int i, n;
+
+  size = (size + sizeof(uint64) - 1) & ~(sizeof(uint64) - 1);
+  if(size < sizeof(struct run) || size > PGSIZE)
+    panic("kalloc_small: size");
+  acquire(&small.lock);
+  for(i = 0; i < NSMALL && small.class[i].size != size; i++)
+    if(small.class[i].size == 0){
+      small.class[i].size = size;
+      break;
+    }
+  if(i == NSMALL)
+    panic("kalloc_small: too many sizes");
+  if(small.class[i].free == 0 && (pa = kalloc()) != 0){
+    // lowest address on top.
+    for(n = PGSIZE / size; --n >= 0; ){
+      r = (struct run*)(pa + n * size);
+      r->next = small.class[i].free;
+      small.class[i].free = r;
+    }
+  }
+  if((r = small.class[i].free) != 0)
+    small.class[i].free = r->next;
+  release(&small.lock);
+  return (void*)r;
+}
+
+void
+pgfree_small(void *pa, uint size)
+{
+  struct run *r = (struct run*)pa;
+  int i;
+
+  size = (size + sizeof(uint64) - 1) & ~(sizeof(uint64) - 1);
+  memset(pa, 1, size);
+  acquire(&small.lock);
+  for(i = 0; i < NSMALL && small.class[i].size != size; i++)
+    ;
+  if(i == NSMALL)
+    panic("pgfree_small");
+  r->next = small.class[i].free;
+  small.class[i].free = r;
+  release(&small.lock);
+}
+
 // Not used by kernel in Deo 1, but needed for linking.
 // Slab uses its own buddy directly.
 void *
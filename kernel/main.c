@@ -4,8 +4,56 @@
 #include "riscv.h"
 #include "defs.h"
 
+// how far hart 0 has got; the other harts follow along.
+#define BOOTMEM   1   // kinit() done: help carve memory
+#define BOOTVM    2   // kernel page table built: turn on paging
+#define BOOTDONE  3   // first process made: start scheduling
+
 volatile static int started = 0;
 
+// times the boot phases ended, in r_time() units since reset
+// (10 MHz in qemu).  hart 0 and the first process mark them one
+// after another, so no lock.
+#define NPHASE 16
+
+static struct {
+  char *name;
+  uint64 t;
+} phases[NPHASE];
+static int nphase;
+
+void
+bootphase(char *name)
+{
+  if(nphase < NPHASE){
+    phases[nphase].name = name;
+    phases[nphase].t = r_time();
+    nphase++;
+  }
+}
+
+// print each phase's end and length, in microseconds.  called once
+// the first process is about to run /init.
+void
+bootreport(void)
+{
+  uint64 t0 = 0;
+
+  for(int i = 0; i < nphase; i++){
+    printf("boot: %s at %ld us (+%ld)\n", phases[i].name,
+           phases[i].t / 10, (phases[i].t - t0) / 10);
+    t0 = phases[i].t;
+  }
+}
+
+static void
+waitfor(int stage)
+{
+  while(started < stage)
+    ;
+  __sync_synchronize();
+}
+
 // start() jumps here in supervisor mode on all CPUs.
 void
 main()
@@ -16,11 +64,26 @@ main()
     printf("\n");
     printf("xv6 kernel is booting\n");
     printf("\n");
+#ifdef RVV
+    printf("string: %s memmove/memset/memcmp\n", rvv_enabled ? "RVV" : "scalar");
+#endif
+    bootphase("entry");
+    fdtinit();       // how much RAM; before kinit() frees the tree
     kinit();         // physical page allocator + slab init
+    __sync_synchronize();
+    started = BOOTMEM;
+    atraceinit();    // allocation trace ring
+    traceinit();     // tracepoint rings
     consoleinit();   // console (needs kmalloc for input buffer)
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
+    __sync_synchronize();
+    started = BOOTVM;
+    bootphase("kvminit");
+    asidinit();      // probe address-space identifiers
     procinit();      // process table
+    workqinit();     // per-CPU workqueues
+    futexinit();     // futex wait queues
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
@@ -28,18 +91,27 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    bootphase("tables");
     virtio_disk_init(); // emulated hard disk
+    bootphase("virtio");
+    kinithart();     // carve the rest of memory; wait for the others
+    bootphase("memory");
     userinit();      // first user process
+    workqinithart(); // this CPU's worker thread
     __sync_synchronize();
-    started = 1;
+    started = BOOTDONE;
+    printfasync();   // scheduler() turns interrupts on
   } else {
-    while(started == 0)
-      ;
-    __sync_synchronize();
-    printf("hart %d starting\n", cpuid());
-    kvminithart();    // turn on paging
+    // per-CPU setup that needs neither paging nor hart 0 first.
+    waitfor(BOOTMEM);
+    kinithart();      // carve free memory while hart 0 boots
     trapinithart();   // install kernel trap vector
-    plicinithart();   // ask PLIC for device interrupts
+    waitfor(BOOTVM);
+    kvminithart();    // turn on paging
+    waitfor(BOOTDONE);
+    plicinithart();   // ask PLIC for device interrupts routed here
+    workqinithart();  // this CPU's worker thread
+    printf("hart %d starting\n", cpuid());
   }
 
   scheduler();        
@@ -25,6 +25,10 @@
 #define VIRTIO0 0x10001000
 #define VIRTIO0_IRQ 1
 
+// core local interruptor (CLINT), for inter-processor interrupts.
+#define CLINT 0x2000000L
+#define CLINT_MSIP(hart) (CLINT + 4*(hart))
+
 // qemu puts platform-level interrupt controller (PLIC) here.
 #define PLIC 0x0c000000L
 #define PLIC_PRIORITY (PLIC + 0x0)
@@ -35,9 +39,14 @@
 
 // the kernel expects there to be RAM
 // for use by the kernel and user pages
-// from physical address 0x80000000 to PHYSTOP.
+// from physical address 0x80000000 to PHYSTOP,
+// which fdtinit() finds from the device tree.
 #define KERNBASE 0x80000000L
-#define PHYSTOP (KERNBASE + 128*1024*1024)
+#define PHYSTOP phystop
+
+// Deo 1 keeps the top quarter of RAM (32 MB of 128) out of kalloc()
+// for the slab allocator's own buddy; see kalloc.c and sysslab.c.
+#define SLABRESERVE (((PHYSTOP - KERNBASE) / 4) & ~0xfffL)
 
 // map the trampoline page to the highest address,
 // in both user and kernel space.
@@ -54,6 +63,9 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   trapframes of threads made by clone(), one page each
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define TRAPFRAMES(slot) (TRAPFRAME - (slot)*PGSIZE)
+#define MAXUSER TRAPFRAMES(NTHREAD-1) // user memory ends below this
@@ -1,10 +1,13 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC      4096  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
-#define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
+#define NTHREAD      16  // maximum threads per process
+#define NOFILE       16  // open files per process, before its table grows
+#define NOFILEMAX   512  // most open files per process
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
+#define TMPDEV        2  // device number of the RAM file system at /tmp
+#define NMOUNT        4  // maximum number of mounted file systems
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGBLOCKS    (MAXOPBLOCKS*3)  // max data blocks in on-disk log
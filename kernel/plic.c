@@ -2,33 +2,111 @@
 #include "param.h"
 #include "memlayout.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
 #include "defs.h"
+#include "irqstat.h"
 
 //
 // the riscv Platform Level Interrupt Controller (PLIC).
 //
+// Each device IRQ has an affinity mask of the harts it may be
+// delivered to, and a hart's enable bits are set from the masks.
+// The console goes to every hart.  The disk goes to hart 0 only,
+// so that its completions, and the wakeups they cause, stay on one
+// hart instead of going to whichever claims first.
+// irqaffinity() changes them.
+//
+
+static struct {
+  struct spinlock lock;
+  uint mask[NIRQ];      // harts each IRQ goes to; 0 if not a device
+  uint online;          // harts that have called plicinithart()
+} plic;
 
 void
 plicinit(void)
 {
+  initlock(&plic.lock, "plic");
+
   // set desired IRQ priorities non-zero (otherwise disabled).
   *(uint32*)(PLIC + UART0_IRQ*4) = 1;
   *(uint32*)(PLIC + VIRTIO0_IRQ*4) = 1;
+
+  plic.mask[UART0_IRQ] = ALLHARTS;
+  plic.mask[VIRTIO0_IRQ] = 1 << 0;
 }
 
+// the enable bits for hart's S-mode, from the masks.
+// caller holds plic.lock.
+static uint32
+enables(int hart)
+{
+  uint32 e = 0;
+
+  for(int irq = 1; irq < NIRQ; irq++)
+    if(plic.mask[irq] & (1 << hart))
+      e |= 1 << irq;
+  return e;
+}
+
+// call after plicinit().
 void
 plicinithart(void)
 {
   int hart = cpuid();
   
   // set enable bits for this hart's S-mode
-  // for the uart and virtio disk.
-  *(uint32*)PLIC_SENABLE(hart) = (1 << UART0_IRQ) | (1 << VIRTIO0_IRQ);
+  // for the devices routed to it.
+  acquire(&plic.lock);
+  plic.online |= 1 << hart;
+  *(uint32*)PLIC_SENABLE(hart) = enables(hart);
+  release(&plic.lock);
 
   // set this hart's S-mode priority threshold to 0.
   *(uint32*)PLIC_SPRIORITY(hart) = 0;
 }
 
+// route irq to the harts in mask and return the old mask; a mask
+// of 0 just returns it.  -1 if irq isn't a device's, if mask names
+// a hart at or above NCPU, or if none of the harts in mask is up.
+int
+plicaffinity(int irq, uint mask)
+{
+  uint old;
+
+  if(irq <= 0 || irq >= NIRQ || (mask & ~ALLHARTS) != 0)
+    return -1;
+  acquire(&plic.lock);
+  old = plic.mask[irq];
+  if(old == 0 || (mask != 0 && (mask & plic.online) == 0)){
+    release(&plic.lock);
+    return -1;
+  }
+  if(mask != 0){
+    plic.mask[irq] = mask;
+    for(int hart = 0; hart < NCPU; hart++)
+      if(plic.online & (1 << hart))
+        *(uint32*)PLIC_SENABLE(hart) = enables(hart);
+  }
+  release(&plic.lock);
+  return old;
+}
+
+// the masks and each hart's counts, for irqstat().
+void
+plicstat(struct irqstat *st)
+{
+  acquire(&plic.lock);
+  for(int irq = 0; irq < NIRQ; irq++)
+    st->mask[irq] = plic.mask[irq];
+  release(&plic.lock);
+  for(int c = 0; c < NCPU; c++)
+    for(int irq = 0; irq < NIRQ; irq++)
+      st->count[c][irq] = cpus[c].irqs[irq];
+}
+
 // ask the PLIC what interrupt we should serve.
 int
 plic_claim(void)
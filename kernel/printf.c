@@ -1,6 +1,17 @@
 //
 // formatted console output -- printf, panic.
 //
+// printf formats into a short buffer on the stack and appends the
+// text as a record to a log ring belonging to the calling CPU.
+// The UART's transmit interrupt drains the rings to the console
+// (lognext()), oldest record first across CPUs, so a CPU that
+// prints never waits for the UART unless its ring is full of text
+// not yet sent.  The rings also keep recent output for dmesg().
+// Until printfasync() says interrupts are on, there are no transmit
+// interrupts to do that, so printf sends its text itself; a hang
+// while booting still shows everything printed before it.
+// panic() drains the rings and prints synchronously.
+//
 
 #include <stdarg.h>
 
@@ -18,15 +29,169 @@
 volatile int panicking = 0; // printing a panic message
 volatile int panicked = 0; // spinning forever at end of a panic
 
-// lock to avoid interleaving concurrent printf's.
+#define LOGSIZE 16384   // bytes of log per CPU; a power of two
+#define LOGLINE 128     // printf appends a record every LOGLINE bytes
+
+struct loghdr {
+  uint64 ts;            // r_time() when appended
+  uint len;             // bytes of text after the header
+  uint cpu;
+};
+
+#define LOGREC(len) ((sizeof(struct loghdr) + (len) + 7) & ~7)
+
+// Each CPU appends to its own ring with interrupts off, so the
+// write side needs no lock.  Records lie between first and head;
+// those from tx on have not been sent to the UART yet.  Only the
+// owning CPU moves first and head, and only lognext() moves tx,
+// so first <= tx <= head.
+static struct logring {
+  uint first;           // oldest record kept
+  uint tx;              // next record to send
+  uint head;            // end of the newest record
+  char buf[LOGSIZE];
+} logs[NCPU];
+
+static volatile int logsync = 1;  // printf waits for the UART
+
+// the record being sent.
 static struct {
   struct spinlock lock;
-} pr;
+  int cpu;              // its ring, or -1 if none
+  uint off;             // next byte of it to send
+  uint left;            // bytes of it still to send
+} logtx;
 
 static char digits[] = "0123456789abcdef";
 
 static void
-printint(long long xx, int base, int sign)
+ringput(struct logring *r, uint off, void *src, uint n)
+{
+  for(uint i = 0; i < n; i++)
+    r->buf[(off + i) % LOGSIZE] = ((char*)src)[i];
+}
+
+static void
+ringget(struct logring *r, uint off, void *dst, uint n)
+{
+  for(uint i = 0; i < n; i++)
+    ((char*)dst)[i] = r->buf[(off + i) % LOGSIZE];
+}
+
+// append n bytes of text to this CPU's ring as one record, then
+// make sure the UART is sending.
+static void
+logappend(char *s, int n)
+{
+  struct logring *r;
+  struct loghdr h;
+  uint need;
+
+  push_off();
+  r = &logs[cpuid()];
+  need = LOGREC(n);
+  while(r->head + need - r->first > LOGSIZE){
+    if(r->first != __atomic_load_n(&r->tx, __ATOMIC_ACQUIRE)){
+      // drop the oldest record; it has been sent.
+      ringget(r, r->first, &h, sizeof(h));
+      __atomic_store_n(&r->first, r->first + LOGREC(h.len), __ATOMIC_RELEASE);
+    } else {
+      // full of text not yet sent: wait for the UART.
+      uartdrain();
+    }
+  }
+  h.ts = r_time();
+  h.len = n;
+  h.cpu = cpuid();
+  ringput(r, r->head, &h, sizeof(h));
+  ringput(r, r->head + sizeof(h), s, n);
+  __atomic_store_n(&r->head, r->head + need, __ATOMIC_RELEASE);
+  pop_off();
+
+  if(logsync){
+    while(uartdrain() > 0)
+      ;
+  } else {
+    uartkick();
+  }
+}
+
+// choose the oldest record not yet sent, over all CPUs.
+// caller holds logtx.lock.
+static int
+logpick(void)
+{
+  struct loghdr h;
+  uint64 ts = 0;
+  int best = -1;
+
+  for(int c = 0; c < NCPU; c++){
+    struct logring *r = &logs[c];
+    if(r->tx == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE))
+      continue;
+    ringget(r, r->tx, &h, sizeof(h));
+    if(best < 0 || h.ts < ts){
+      best = c;
+      ts = h.ts;
+      logtx.off = r->tx + sizeof(h);
+      logtx.left = h.len;
+    }
+  }
+  logtx.cpu = best;
+  return best;
+}
+
+// move up to n bytes of log text waiting to be sent into dst;
+// returns how many.  for the UART driver.
+int
+lognext(char *dst, int n)
+{
+  struct logring *r;
+  int k = 0, m;
+
+  if(panicking == 0)
+    acquire(&logtx.lock);
+  while(k < n){
+    if(logtx.cpu < 0 && logpick() < 0)
+      break;
+    r = &logs[logtx.cpu];
+    m = n - k < logtx.left ? n - k : logtx.left;
+    ringget(r, logtx.off, dst + k, m);
+    logtx.off += m;
+    logtx.left -= m;
+    k += m;
+    if(logtx.left == 0){
+      __atomic_store_n(&r->tx, (logtx.off + 7) & ~7, __ATOMIC_RELEASE);
+      logtx.cpu = -1;
+    }
+  }
+  if(panicking == 0)
+    release(&logtx.lock);
+  return k;
+}
+
+// printf's output buffer.
+struct pbuf {
+  int n;
+  char buf[LOGLINE];
+};
+
+static void
+putch(struct pbuf *b, int c)
+{
+  if(panicking){
+    consputc(c);
+    return;
+  }
+  if(b->n == LOGLINE){
+    logappend(b->buf, b->n);
+    b->n = 0;
+  }
+  b->buf[b->n++] = c;
+}
+
+static void
+printint(struct pbuf *b, long long xx, int base, int sign)
 {
   char buf[20];
   int i;
@@ -46,17 +211,17 @@ printint(long long xx, int base, int sign)
     buf[i++] = '-';
 
   while(--i >= 0)
-    consputc(buf[i]);
+    putch(b, buf[i]);
 }
 
 static void
-printptr(uint64 x)
+printptr(struct pbuf *b, uint64 x)
 {
   int i;
-  consputc('0');
-  consputc('x');
+  putch(b, '0');
+  putch(b, 'x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    consputc(digits[x >> (sizeof(uint64) * 8 - 4)]);
+    putch(b, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
 // Print to the console.
@@ -66,14 +231,13 @@ printf(char *fmt, ...)
   va_list ap;
   int i, cx, c0, c1, c2;
   char *s;
+  struct pbuf b;
 
-  if(panicking == 0)
-    acquire(&pr.lock);
-
+  b.n = 0;
   va_start(ap, fmt);
   for(i = 0; (cx = fmt[i] & 0xff) != 0; i++){
     if(cx != '%'){
-      consputc(cx);
+      putch(&b, cx);
       continue;
     }
     i++;
@@ -82,53 +246,53 @@ printf(char *fmt, ...)
     if(c0) c1 = fmt[i+1] & 0xff;
     if(c1) c2 = fmt[i+2] & 0xff;
     if(c0 == 'd'){
-      printint(va_arg(ap, int), 10, 1);
+      printint(&b, va_arg(ap, int), 10, 1);
     } else if(c0 == 'l' && c1 == 'd'){
-      printint(va_arg(ap, uint64), 10, 1);
+      printint(&b, va_arg(ap, uint64), 10, 1);
       i += 1;
     } else if(c0 == 'l' && c1 == 'l' && c2 == 'd'){
-      printint(va_arg(ap, uint64), 10, 1);
+      printint(&b, va_arg(ap, uint64), 10, 1);
       i += 2;
     } else if(c0 == 'u'){
-      printint(va_arg(ap, uint32), 10, 0);
+      printint(&b, va_arg(ap, uint32), 10, 0);
     } else if(c0 == 'l' && c1 == 'u'){
-      printint(va_arg(ap, uint64), 10, 0);
+      printint(&b, va_arg(ap, uint64), 10, 0);
       i += 1;
     } else if(c0 == 'l' && c1 == 'l' && c2 == 'u'){
-      printint(va_arg(ap, uint64), 10, 0);
+      printint(&b, va_arg(ap, uint64), 10, 0);
       i += 2;
     } else if(c0 == 'x'){
-      printint(va_arg(ap, uint32), 16, 0);
+      printint(&b, va_arg(ap, uint32), 16, 0);
     } else if(c0 == 'l' && c1 == 'x'){
-      printint(va_arg(ap, uint64), 16, 0);
+      printint(&b, va_arg(ap, uint64), 16, 0);
       i += 1;
     } else if(c0 == 'l' && c1 == 'l' && c2 == 'x'){
-      printint(va_arg(ap, uint64), 16, 0);
+      printint(&b, va_arg(ap, uint64), 16, 0);
       i += 2;
     } else if(c0 == 'p'){
-      printptr(va_arg(ap, uint64));
+      printptr(&b, va_arg(ap, uint64));
     } else if(c0 == 'c'){
-      consputc(va_arg(ap, uint));
+      putch(&b, va_arg(ap, uint));
     } else if(c0 == 's'){
       if((s = va_arg(ap, char*)) == 0)
         s = "(null)";
       for(; *s; s++)
-        consputc(*s);
+        putch(&b, *s);
     } else if(c0 == '%'){
-      consputc('%');
+      putch(&b, '%');
     } else if(c0 == 0){
       break;
     } else {
       // Print unknown % sequence to draw attention.
-      consputc('%');
-      consputc(c0);
+      putch(&b, '%');
+      putch(&b, c0);
     }
 
   }
   va_end(ap);
 
-  if(panicking == 0)
-    release(&pr.lock);
+  if(b.n > 0 && !panicking)
+    logappend(b.buf, b.n);
 
   return 0;
 }
@@ -136,7 +300,12 @@ printf(char *fmt, ...)
 void
 panic(char *s)
 {
+  char c;
+
   panicking = 1;
+  // send what is still in the log first, without locks.
+  while(lognext(&c, 1) == 1)
+    uartputc_sync(c);
   printf("panic: ");
   printf("%s\n", s);
   panicked = 1; // freeze uart output from other CPUs
@@ -147,5 +316,75 @@ panic(char *s)
 void
 printfinit(void)
 {
-  initlock(&pr.lock, "pr");
+  initlock(&logtx.lock, "log");
+  logtx.cpu = -1;
+}
+
+// from now on the UART's transmit interrupt sends printf's text.
+// called by hart 0 once booted, as it goes to turn interrupts on.
+void
+printfasync(void)
+{
+  logsync = 0;
+}
+
+// dmesg(buf, n): copy up to n bytes of the kept log, oldest
+// first, to buf; returns how many.  Reads the rings without
+// locks, so it rechecks after each copy that the owning CPU
+// hasn't reused the space meanwhile.
+uint64
+sys_dmesg(void)
+{
+  uint pos[NCPU];
+  struct loghdr h, bh;
+  char tmp[64];
+  uint64 dst;
+  int n, c, best, m, done = 0;
+
+  argaddr(0, &dst);
+  argint(1, &n);
+  for(c = 0; c < NCPU; c++)
+    pos[c] = __atomic_load_n(&logs[c].first, __ATOMIC_ACQUIRE);
+
+  while(done < n){
+    best = -1;
+    for(c = 0; c < NCPU; c++){
+      struct logring *r = &logs[c];
+      if(pos[c] == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE))
+        continue;
+      ringget(r, pos[c], &h, sizeof(h));
+      __sync_synchronize();
+      if((int)(__atomic_load_n(&r->first, __ATOMIC_ACQUIRE) - pos[c]) > 0){
+        // overwritten; start again from the oldest kept.
+        pos[c] = r->first;
+        c--;
+        continue;
+      }
+      if(best < 0 || h.ts < bh.ts){
+        best = c;
+        bh = h;
+      }
+    }
+    if(best < 0)
+      break;
+
+    struct logring *r = &logs[best];
+    uint off = pos[best] + sizeof(bh);
+    for(uint k = 0; k < bh.len && done < n; k += m){
+      m = bh.len - k;
+      if(m > sizeof(tmp))
+        m = sizeof(tmp);
+      if(m > n - done)
+        m = n - done;
+      ringget(r, off + k, tmp, m);
+      __sync_synchronize();
+      if((int)(__atomic_load_n(&r->first, __ATOMIC_ACQUIRE) - pos[best]) > 0)
+        break;
+      if(copyout(myproc()->pagetable, dst + done, tmp, m) < 0)
+        return -1;
+      done += m;
+    }
+    pos[best] += LOGREC(bh.len);
+  }
+  return done;
 }
@@ -3,8 +3,10 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "defs.h"
+#include "trace.h"
 #ifdef SLAB_KERNEL
 #include "slab.h"
 #endif
@@ -12,67 +14,174 @@
 struct cpu cpus[NCPU];
 
 #ifdef SLAB_KERNEL
-struct proc *proc;  // dynamically allocated via kmalloc
-#else
-struct proc proc[NPROC];  // static array (original xv6)
+static kmem_cache_t *proc_cache;
+static kmem_cache_t *vmspace_cache;
+static kmem_cache_t *files_cache;
 #endif
 
-struct proc *initproc;
+// Every struct proc in use or kept for reuse, newest first, linked
+// by p->next.  procdump(), kprocstat() and a few others walk the
+// list, or keep a proc pointer after letting go of its locks,
+// without proc_lock; see "Freeing procs" below.
+static struct proc *procs;
+
+#define NPIDHASH 256
+#define NFREEPROC 16    // UNUSED procs kept for reuse
+
+// proc_lock protects nextpid, pidhash[], freeprocs, nfree, the
+// links of procs, stackmap[], retired's list and nproc.
+// p->lock is acquired before it, never after.
+static struct spinlock proc_lock;
+static int nextpid = 1;
+static struct proc *pidhash[NPIDHASH];  // procs in use, by pid
+static struct proc *freeprocs;          // UNUSED procs kept
+static int nfree;                       // ... how many
+static uint64 stackmap[NPROC/64];       // KSTACK() slots taken
+static int nproc;                       // procs allocated
+
+// Freeing procs.  A proc let go when NFREEPROC are kept already is
+// retired: taken off procs and its kernel stack unmapped.  Its
+// memory is freed once no CPU can still be looking at it.  Code
+// that walks procs, or keeps a proc pointer without its lock, does
+// so with interrupts off, so it is done by the time its CPU is back
+// in scheduler(); code that may sleep meanwhile calls holdprocs().
+// procquiesce() notes the generation each CPU has reached, and
+// flushes its TLB on the way, so that the stack's slot can be
+// reused as well.
+static struct {
+  uint64 gen;           // bumped as each proc is retired
+  int holds;            // holdprocs() outstanding
+  struct proc *head;    // retired procs, by freenext
+} retired;
+
+// RUNNABLE procs, oldest first, linked by p->runnext.  scheduler()
+// takes the first that may run on its CPU.  p->lock is acquired
+// before runq.lock.
+static struct {
+  struct spinlock lock;
+  struct proc *head;
+  struct proc **tail;
+} runq;
+
+// SLEEPING procs, on lists hashed by channel, so that wakeup() looks
+// only at procs that may be on its channel.  A list's lock comes
+// after the sleep's condition lock and before p->lock.  A proc takes
+// itself off once it is awake; see sleep().
+#define SLEEPQBITS 6
+static struct sleepq {
+  struct spinlock lock;
+  struct proc *head;            // linked by p->sqnext
+} sleepq[1 << SLEEPQBITS];
 
-int nextpid = 1;
-struct spinlock pid_lock;
+struct proc *initproc;
 
 extern void forkret(void);
+static void kthreadret(void);
 static void freeproc(struct proc *p);
+static void vmput(struct proc *p);
+static void setrunnable(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
-// helps ensure that wakeups of wait()ing
-// parents are not lost. helps obey the
-// memory model when using p->parent.
-// must be acquired before any p->lock.
-struct spinlock wait_lock;
+// Exit and wait synchronize on the parent's p->wait_lock, which
+// protects its list of children and their parent pointers, and on
+// vm->tlock for threads.  Locks are acquired in this order: a
+// proc's wait_lock, then initproc's (by reparent()), then a vmspace's
+// tlock, then p->lock.
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
+// initialize the proc table.
 void
-proc_mapstacks(pagetable_t kpgtbl)
+procinit(void)
 {
-  struct proc *p;
-
+  initlock(&proc_lock, "proc_lock");
+  initlock(&runq.lock, "runq");
+  runq.tail = &runq.head;
+  for(int i = 0; i < NELEM(sleepq); i++)
+    initlock(&sleepq[i].lock, "sleepq");
 #ifdef SLAB_KERNEL
-  // Allocate proc table if not yet done
-  if(!proc) {
-    proc = (struct proc*)kmalloc(sizeof(struct proc) * NPROC);
-    if(!proc)
-      panic("proc_mapstacks: kmalloc");
-    memset(proc, 0, sizeof(struct proc) * NPROC);
-  }
+  proc_cache = kmem_cache_create("proc", sizeof(struct proc), 0, 0);
+  vmspace_cache = kmem_cache_create("vmspace", sizeof(struct vmspace), 0, 0);
+  files_cache = kmem_cache_create("files", sizeof(struct files), 0, 0);
+  if(!proc_cache || !vmspace_cache || !files_cache)
+    panic("procinit: cache create");
 #endif
+}
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
-  }
+// The first proc in procs; follow p->next for the rest.
+static struct proc*
+firstproc(void)
+{
+  return __atomic_load_n(&procs, __ATOMIC_ACQUIRE);
 }
 
-// initialize the proc table.
-void
-procinit(void)
+// Take an UNUSED proc from freeprocs, or if there is none, allocate
+// one, with a kernel stack mapped high in memory below an invalid
+// guard page.  The stack stays with the proc until it is freed.
+// Return 0 if there are NPROC procs already or memory is short.
+static struct proc*
+procget(void)
 {
   struct proc *p;
+  char *stack;
+  int w, slot;
+
+  acquire(&proc_lock);
+  if((p = freeprocs) != 0){
+    freeprocs = p->freenext;
+    nfree--;
+    release(&proc_lock);
+    return p;
+  }
+  if(nproc == NPROC){
+    release(&proc_lock);
+    return 0;
+  }
+  // retired procs keep their slots until freed, and count in
+  // nproc until then, so there is a free one.
+  for(w = 0; stackmap[w] == ~0UL; w++)
+    ;
+  slot = w*64 + __builtin_ctzll(~stackmap[w]);
 
-  initlock(&pid_lock, "nextpid");
-  initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->state = UNUSED;
-      p->kstack = KSTACK((int) (p - proc));
+#ifdef SLAB_KERNEL
+  p = (struct proc*)kmem_cache_alloc(proc_cache);
+#else
+  p = (struct proc*)kalloc_small(sizeof(*p));
+#endif
+  if(p == 0)
+    goto bad;
+  memset(p, 0, sizeof(*p));
+  if((stack = kalloc()) == 0)
+    goto bad;
+  // proc_lock keeps other CPUs out of the kernel page table.
+  if(kvmmapstack(KSTACK(slot), (uint64)stack) < 0){
+    pgfree(stack);
+    goto bad;
   }
+  initlock(&p->lock, "proc");
+  initlock(&p->wait_lock, "wait_lock");
+  p->state = UNUSED;
+  p->kstack = KSTACK(slot);
+  p->kstackpa = (uint64)stack;
+  p->slot = slot;
+  stackmap[slot/64] |= 1L << (slot%64);
+  nproc++;
+  p->next = procs;
+  if(procs)
+    procs->prev = p;
+  __atomic_store_n(&procs, p, __ATOMIC_RELEASE);
+  release(&proc_lock);
+  return p;
+
+bad:
+  if(p){
+#ifdef SLAB_KERNEL
+    kmem_cache_free(proc_cache, (void*)p);
+#else
+    pgfree_small(p, sizeof(*p));
+#endif
+  }
+  release(&proc_lock);
+  return 0;
 }
 
 // Must be called with interrupts disabled,
@@ -106,41 +215,333 @@ myproc(void)
   return p;
 }
 
-int
-allocpid()
+// Give p the next pid and enter it in the pid hash.
+static void
+allocpid(struct proc *p)
 {
-  int pid;
-  
-  acquire(&pid_lock);
-  pid = nextpid;
+  struct proc **h;
+
+  acquire(&proc_lock);
+  p->pid = nextpid;
   nextpid = nextpid + 1;
-  release(&pid_lock);
+  h = &pidhash[p->pid % NPIDHASH];
+  p->hashnext = *h;
+  *h = p;
+  release(&proc_lock);
+}
 
-  return pid;
+// Take p off procs, unmap its kernel stack, and put it on the
+// retired list until procreap() can free it.  Caller holds
+// proc_lock.
+static void
+procretire(struct proc *p)
+{
+  // a reader at p can still follow p->next.
+  if(p->prev)
+    __atomic_store_n(&p->prev->next, p->next, __ATOMIC_RELEASE);
+  else
+    __atomic_store_n(&procs, p->next, __ATOMIC_RELEASE);
+  if(p->next)
+    p->next->prev = p->prev;
+  kvmunmapstack(p->kstack);
+  p->freenext = retired.head;
+  retired.head = p;
+  p->gone = __atomic_add_fetch(&retired.gen, 1, __ATOMIC_SEQ_CST);
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, initialize state required to run in the kernel,
-// and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// The retired.gen that every CPU has been through scheduler()
+// since.
+static uint64
+procseen(void)
+{
+  struct cpu *c;
+  uint64 min = ~0L;
+
+  // qgen is 0 for a CPU not in scheduler() yet.  One getting there
+  // now stores its qgen before it looks at procs, so it can't see
+  // anything retired before these loads.
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    uint64 g = __atomic_load_n(&c->qgen, __ATOMIC_SEQ_CST);
+    if(g != 0 && g - 1 < min)
+      min = g - 1;
+  }
+  return min;
+}
+
+// Free the retired procs that every CPU has been through scheduler()
+// since, unless a holdprocs() is outstanding.
+static void
+procreap(void)
+{
+  struct proc *p, **pp, *done = 0;
+  uint64 min = procseen();
+
+  acquire(&proc_lock);
+  __sync_synchronize();
+  if(retired.holds > 0){
+    release(&proc_lock);
+    return;
+  }
+  for(pp = &retired.head; (p = *pp) != 0; ){
+    if(p->gone <= min){
+      *pp = p->freenext;
+      p->freenext = done;
+      done = p;
+      stackmap[p->slot/64] &= ~(1L << (p->slot%64));
+      nproc--;
+    } else {
+      pp = &p->freenext;
+    }
+  }
+  release(&proc_lock);
+
+  while((p = done) != 0){
+    done = p->freenext;
+    pgfree((void*)p->kstackpa);
+#ifdef SLAB_KERNEL
+    kmem_cache_free(proc_cache, (void*)p);
+#else
+    pgfree_small(p, sizeof(*p));
+#endif
+  }
+}
+
+// Called by scheduler() on each pass, with interrupts off and no
+// proc pointers kept: this CPU is done with any proc retired so far.
+static void
+procquiesce(struct cpu *c)
+{
+  uint64 g = __atomic_load_n(&retired.gen, __ATOMIC_ACQUIRE);
+
+  if(c->qgen != g + 1){
+    sfence_vma();       // forget retired kernel stacks
+    __atomic_store_n(&c->qgen, g + 1, __ATOMIC_SEQ_CST);
+  }
+  if(__atomic_load_n(&retired.head, __ATOMIC_RELAXED))
+    procreap();
+}
+
+// Keep retired procs from being freed, for code that walks procs
+// and may sleep; see kprocstat().
+static void
+holdprocs(void)
+{
+  __atomic_add_fetch(&retired.holds, 1, __ATOMIC_SEQ_CST);
+}
+
+static void
+unholdprocs(void)
+{
+  __atomic_sub_fetch(&retired.holds, 1, __ATOMIC_SEQ_CST);
+}
+
+// Free the procs kept for reuse, and any others retired.  For a
+// thread that is out of memory.  Every CPU gets back to scheduler()
+// at least once a tick, this one by sleeping, so the wait is short.
+static void
+procreclaim(void)
+{
+  struct proc *p;
+  uint64 g;
+
+  acquire(&proc_lock);
+  while((p = freeprocs) != 0){
+    freeprocs = p->freenext;
+    nfree--;
+    procretire(p);
+  }
+  g = retired.gen;
+  release(&proc_lock);
+
+  acquire(&tickslock);
+  while(procseen() < g)
+    sleep(&ticks, &tickslock);
+  release(&tickslock);
+  procreap();
+}
+
+// Remove p from the pid hash, and keep it on freeprocs, or retire
+// it if NFREEPROC are kept already.
+static void
+putproc(struct proc *p)
+{
+  struct proc **pp;
+
+  acquire(&proc_lock);
+  if(p->pid != 0){
+    for(pp = &pidhash[p->pid % NPIDHASH]; *pp; pp = &(*pp)->hashnext){
+      if(*pp == p){
+        *pp = p->hashnext;
+        break;
+      }
+    }
+  }
+  p->hashnext = 0;
+  if(nfree < NFREEPROC){
+    p->freenext = freeprocs;
+    freeprocs = p;
+    nfree++;
+  } else {
+    procretire(p);
+  }
+  release(&proc_lock);
+}
+
+// The proc with the given pid, locked, or 0.
 static struct proc*
-allocproc(void)
+findpid(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  // p->lock goes before proc_lock, so p may be reused, or retired,
+  // between the two; with interrupts off it isn't freed.
+  push_off();
+  acquire(&proc_lock);
+  for(p = pidhash[pid % NPIDHASH]; p; p = p->hashnext)
+    if(p->pid == pid)
+      break;
+  release(&proc_lock);
+  if(p){
     acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
+    if(p->pid != pid){
       release(&p->lock);
+      p = 0;
     }
   }
+  pop_off();
+  return p;
+}
+
+// Allocate an address space with one reference, and no page table.
+static struct vmspace*
+vmspacealloc(void)
+{
+  struct vmspace *vm;
+
+#ifdef SLAB_KERNEL
+  vm = (struct vmspace*)kmem_cache_alloc(vmspace_cache);
+#else
+  vm = (struct vmspace*)kalloc_small(sizeof(*vm));
+#endif
+  if(vm == 0)
+    return 0;
+  memset(vm, 0, sizeof(*vm));
+  initsleeplock(&vm->mmlock, "mmlock");
+  initlock(&vm->lock, "vmspace");
+  initlock(&vm->tlock, "threads");
+  vm->ref = 1;
+  return vm;
+}
+
+static void
+vmspacefree(struct vmspace *vm)
+{
+#ifdef SLAB_KERNEL
+  kmem_cache_free(vmspace_cache, (void*)vm);
+#else
+  pgfree_small(vm, sizeof(*vm));
+#endif
+}
+
+// Allocate an empty open-file table with one reference.
+static struct files*
+filesalloc(void)
+{
+  struct files *fs;
+
+#ifdef SLAB_KERNEL
+  fs = (struct files*)kmem_cache_alloc(files_cache);
+#else
+  fs = (struct files*)kalloc_small(sizeof(*fs));
+#endif
+  if(fs == 0)
+    return 0;
+  memset(fs, 0, sizeof(*fs));
+  initlock(&fs->lock, "files");
+  fs->ref = 1;
+  fdinit(fs);
+  return fs;
+}
+
+// Drop a reference to an open-file table.  The last one
+// closes the files and releases the current directory.
+static void
+filesput(struct files *fs)
+{
+  int last;
+
+  acquire(&fs->lock);
+  last = --fs->ref == 0;
+  release(&fs->lock);
+  if(!last)
+    return;
+
+  fdcloseall(fs);
+
+  if(fs->cwd){
+    begin_op();
+    iput(fs->cwd);
+    end_op();
+    fs->cwd = 0;
+  }
+
+#ifdef SLAB_KERNEL
+  kmem_cache_free(files_cache, (void*)fs);
+#else
+  pgfree_small(fs, sizeof(*fs));
+#endif
+}
+
+// Make thread p share the address space of thread q: map p's
+// trapframe in a free slot below TRAPFRAME in q's page table.
+// Return 0 on success, -1 if q already has NTHREAD threads.
+static int
+vmshare(struct proc *p, struct proc *q)
+{
+  struct vmspace *vm = q->vm;
+  int slot;
+
+  acquire(&vm->lock);
+  for(slot = 1; slot < NTHREAD; slot++)
+    if((vm->tfslots & (1 << slot)) == 0)
+      break;
+  if(slot == NTHREAD ||
+     mappages(q->pagetable, TRAPFRAMES(slot), PGSIZE,
+              (uint64)(p->trapframe), PTE_R | PTE_W) < 0){
+    release(&vm->lock);
+    return -1;
+  }
+  vm->tfslots |= 1 << slot;
+  vm->ref++;
+  release(&vm->lock);
+
+  p->vm = vm;
+  p->pagetable = q->pagetable;
+  p->tfslot = slot;
   return 0;
+}
+
+// Get an UNUSED proc, initialize state required to run in the
+// kernel, and return with p->lock held.  The new proc gets an empty
+// user address space, or shares that of thread if not 0.
+// If there are no free procs, or a memory allocation fails, return 0.
+static struct proc*
+allocproc(struct proc *thread)
+{
+  struct proc *p;
+
+  if((p = procget()) == 0)
+    return 0;
 
-found:
-  p->pid = allocpid();
+  acquire(&p->lock);
+  allocpid(p);
   p->state = USED;
+  memset(&p->ru, 0, sizeof(p->ru));
+  memset(&p->cru, 0, sizeof(p->cru));
+  p->start = ticks;
+  p->kfn = 0;
+  p->karg = 0;
+  p->pincpu = 0;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -149,12 +550,27 @@ found:
     return 0;
   }
 
-  // An empty user page table.
-  p->pagetable = proc_pagetable(p);
-  if(p->pagetable == 0){
-    freeproc(p);
-    release(&p->lock);
-    return 0;
+  if(thread){
+    if(vmshare(p, thread) < 0){
+      freeproc(p);
+      release(&p->lock);
+      return 0;
+    }
+  } else {
+    // An empty user page table.
+    if((p->vm = vmspacealloc()) == 0){
+      freeproc(p);
+      release(&p->lock);
+      return 0;
+    }
+    p->vm->tfslots = 1;
+    p->tfslot = 0;
+    p->pagetable = proc_pagetable(p);
+    if(p->pagetable == 0){
+      freeproc(p);
+      release(&p->lock);
+      return 0;
+    }
   }
 
   // Set up new context to start executing at forkret,
@@ -166,21 +582,61 @@ found:
   return p;
 }
 
-// free a proc structure and the data hanging from it,
-// including user pages.
+// Make a kernel thread named name that runs fn(arg), on CPU cpu
+// only if cpu >= 0.  It has no user memory, trapframe or open
+// files, and is scheduled like any other thread.  It runs until the
+// system stops, so fn must not return, and it can't be killed.
+// Returns 0 if there are no free procs.
+struct proc*
+kthread_create(char *name, void (*fn)(void*), void *arg, int cpu)
+{
+  struct proc *p;
+
+  if((p = procget()) == 0)
+    return 0;
+
+  acquire(&p->lock);
+  allocpid(p);
+  memset(&p->ru, 0, sizeof(p->ru));
+  memset(&p->cru, 0, sizeof(p->cru));
+  p->start = ticks;
+  p->kfn = fn;
+  p->karg = arg;
+  p->pincpu = cpu >= 0 ? cpu + 1 : 0;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  memset(&p->context, 0, sizeof(p->context));
+  p->context.ra = (uint64)kthreadret;
+  p->context.sp = p->kstack + PGSIZE;
+
+  setrunnable(p);
+  release(&p->lock);
+  return p;
+}
+
+// free the data hanging from a proc structure, including user
+// pages, and keep it for reuse or retire it; see putproc().
+// the caller must have taken it off its parent's and vmspace's
+// lists.
 // p->lock must be held.
 static void
 freeproc(struct proc *p)
 {
+  if(p->vm)
+    vmput(p);
+  p->vm = 0;
+  p->pagetable = 0;
+  p->tfslot = 0;
   if(p->trapframe)
     pgfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
-  p->pagetable = 0;
-  p->sz = 0;
+  p->files = 0;
+  putproc(p);
   p->pid = 0;
   p->parent = 0;
+  p->children = 0;
+  p->sibling = 0;
+  p->tnext = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
@@ -188,6 +644,34 @@ freeproc(struct proc *p)
   p->state = UNUSED;
 }
 
+// Drop p's reference to its address space.  Other threads may go
+// on using the page table, so unmap p's trapframe from it, and make
+// sure no CPU still caches the mapping before the page is freed.
+// The last reference frees the page table and user memory.
+static void
+vmput(struct proc *p)
+{
+  struct vmspace *vm = p->vm;
+  struct proc *me = myproc();
+  int last;
+
+  acquire(&vm->lock);
+  last = --vm->ref == 0;
+  if(p->pagetable){
+    uvmunmap(p->pagetable, TRAPFRAMES(p->tfslot), 1, 0);
+    if(!last && (me == 0 || me->vm != vm))
+      uvmshootdown(vm);  // uvmunmap() only does it for its caller's
+  }
+  vm->tfslots &= ~(1 << p->tfslot);
+  release(&vm->lock);
+
+  if(last){
+    if(p->pagetable)
+      proc_freepagetable(p->pagetable, vm->sz);
+    vmspacefree(vm);
+  }
+}
+
 // Create a user page table for a given process, with no user memory,
 // but with trampoline and trapframe pages.
 pagetable_t
@@ -211,7 +695,8 @@ proc_pagetable(struct proc *p)
   }
 
   // map the trapframe page just below the trampoline page, for
-  // trampoline.S.
+  // trampoline.S.  (threads made later by clone() get theirs
+  // mapped below this one.)
   if(mappages(pagetable, TRAPFRAME, PGSIZE,
               (uint64)(p->trapframe), PTE_R | PTE_W) < 0){
     uvmunmap(pagetable, TRAMPOLINE, 1, 0);
@@ -238,60 +723,160 @@ userinit(void)
 {
   struct proc *p;
 
-  p = allocproc();
+  p = allocproc(0);
   initproc = p;
   
-  p->cwd = namei("/");
+  if((p->files = filesalloc()) == 0)
+    panic("userinit");
+  p->files->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
 
-// Grow or shrink user memory by n bytes.
+// Grow or shrink user memory by n bytes, and store the
+// old size in *oldsz.
 // Return 0 on success, -1 on failure.
 int
-growproc(int n)
+growproc(int n, uint64 *oldsz)
 {
   uint64 sz;
   struct proc *p = myproc();
+  struct vmspace *vm = p->vm;
 
-  sz = p->sz;
+  // mmlock keeps other threads from changing sz meanwhile;
+  // vm->lock is only held to set it, since vmfault() reads it.
+  acquiresleep(&vm->mmlock);
+  sz = *oldsz = vm->sz;
   if(n > 0){
-    if(sz + n > TRAPFRAME) {
+    if(sz + n > MAXUSER) {
+      releasesleep(&vm->mmlock);
       return -1;
     }
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
-      return -1;
+    if(uvmalloc(p->pagetable, sz, sz + n, PTE_W) == 0){
+      // try again with the procs kept for reuse given back.
+      procreclaim();
+      if(uvmalloc(p->pagetable, sz, sz + n, PTE_W) == 0){
+        releasesleep(&vm->mmlock);
+        return -1;
+      }
     }
-  } else if(n < 0){
-    sz = uvmdealloc(p->pagetable, sz, sz + n);
+    sz += n;
+    acquire(&vm->lock);
+    vm->sz = sz;
+    release(&vm->lock);
+  } else if(n < 0 && sz + n < sz){
+    // shrink sz first, so vmfault() maps nothing in what is freed.
+    acquire(&vm->lock);
+    vm->sz = sz + n;
+    release(&vm->lock);
+    uvmdealloc(p->pagetable, sz, sz + n);
   }
-  p->sz = sz;
+  releasesleep(&vm->mmlock);
   return 0;
 }
 
+// Make c a child of p.
+// Caller must hold p->wait_lock.
+static void
+addchild(struct proc *p, struct proc *c)
+{
+  c->parent = p;
+  c->sibling = p->children;
+  p->children = c;
+}
+
+// Acquire the wait_lock of p's parent and return the parent, or 0
+// if p has none.  reparent() can change the parent until its lock
+// is held; with interrupts off the old one isn't freed meanwhile,
+// so it is safe to lock.
+static struct proc*
+lockparent(struct proc *p)
+{
+  struct proc *pp;
+
+  push_off();
+  for(;;){
+    if((pp = __atomic_load_n(&p->parent, __ATOMIC_RELAXED)) == 0)
+      break;
+    acquire(&pp->wait_lock);
+    if(p->parent == pp)
+      break;
+    release(&pp->wait_lock);
+  }
+  pop_off();
+  return pp;
+}
+
+// Wake p if it is sleeping on chan: wakeup() for one known proc,
+// without the search.
+static void
+wakeproc(struct proc *p, void *chan)
+{
+  acquire(&p->lock);
+  if(p->state == SLEEPING && p->chan == chan){
+    setrunnable(p);
+    TRACE(TC_WAKEUP, TE_WAKEUP, p->pid, chan);
+  }
+  release(&p->lock);
+}
+
+// Take zombie pp off its parent's list of children, and if it is
+// a thread made by clone(), off its address space's list of threads,
+// before freeproc().  Caller must hold the parent's wait_lock, and
+// for a thread the vmspace's tlock.
+static void
+unlinkproc(struct proc *pp)
+{
+  struct proc **l;
+
+  for(l = &pp->parent->children; *l; l = &(*l)->sibling){
+    if(*l == pp){
+      *l = pp->sibling;
+      break;
+    }
+  }
+  if(pp->tfslot != 0){
+    for(l = &pp->vm->threads; *l; l = &(*l)->tnext){
+      if(*l == pp){
+        *l = pp->tnext;
+        break;
+      }
+    }
+  }
+}
+
 // Create a new process, copying the parent.
 // Sets up child kernel stack to return as if from fork() system call.
 int
 kfork(void)
 {
-  int i, pid;
+  int pid;
   struct proc *np;
   struct proc *p = myproc();
 
   // Allocate process.
-  if((np = allocproc()) == 0){
+  if((np = allocproc(0)) == 0){
     return -1;
   }
 
-  // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  // Copy user memory from parent to child, holding the parent's
+  // mmlock against other threads changing it.  The copy may sleep,
+  // so np->lock is let go meanwhile; nothing can run or wait for
+  // np until it is RUNNABLE and a child.
+  release(&np->lock);
+  acquiresleep(&p->vm->mmlock);
+  if(uvmcopy(p->pagetable, np->pagetable, p->vm->sz) < 0){
+    releasesleep(&p->vm->mmlock);
+    acquire(&np->lock);
     freeproc(np);
     release(&np->lock);
     return -1;
   }
-  np->sz = p->sz;
+  np->vm->sz = p->vm->sz;
+  releasesleep(&p->vm->mmlock);
+  acquire(&np->lock);
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -300,10 +885,62 @@ kfork(void)
   np->trapframe->a0 = 0;
 
   // increment reference counts on open file descriptors.
-  for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
-  np->cwd = idup(p->cwd);
+  if((np->files = filesalloc()) == 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  if(fdcopy(np->files, p->files) < 0){
+    filesput(np->files);
+    np->files = 0;
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  acquire(&p->files->lock);
+  np->files->cwd = idup(p->files->cwd);
+  release(&p->files->lock);
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  pid = np->pid;
+
+  release(&np->lock);
+
+  acquire(&p->wait_lock);
+  addchild(p, np);
+  release(&p->wait_lock);
+
+  acquire(&np->lock);
+  setrunnable(np);
+  release(&np->lock);
+
+  return pid;
+}
+
+// Create a thread in the current process, sharing its address
+// space, open files and current directory.  It starts in fn(arg)
+// with stack pointer stack, its other registers copied from the
+// caller's.  Return its pid.
+int
+kclone(uint64 fn, uint64 arg, uint64 stack)
+{
+  int pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if((stack % 16) != 0)
+    return -1;
+
+  if((np = allocproc(p)) == 0){
+    return -1;
+  }
+
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = stack;
+  np->trapframe->ra = 0;
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -311,77 +948,153 @@ kfork(void)
 
   release(&np->lock);
 
-  acquire(&wait_lock);
-  np->parent = p;
-  release(&wait_lock);
+  acquire(&p->wait_lock);
+  acquire(&p->vm->tlock);
+  // if the process is exiting, kexit() has already killed the
+  // other threads, and missed this one.
+  if(killed(p)){
+    release(&p->vm->tlock);
+    release(&p->wait_lock);
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  addchild(p, np);
+  np->tnext = p->vm->threads;
+  p->vm->threads = np;
+  acquire(&p->files->lock);
+  p->files->ref++;
+  release(&p->files->lock);
+  np->files = p->files;
+  release(&p->vm->tlock);
+  release(&p->wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
 }
 
+// Kill the other threads of p's process.
+// Caller must hold p->vm->tlock.
+static void
+killthreads(struct proc *p)
+{
+  struct proc *pp;
+
+  for(pp = p->vm->threads; pp; pp = pp->tnext){
+    if(pp == p)
+      continue;
+    acquire(&pp->lock);
+    pp->killed = 1;
+    if(pp->state == SLEEPING)
+      setrunnable(pp);
+    release(&pp->lock);
+  }
+}
+
 // Pass p's abandoned children to init.
-// Caller must hold wait_lock.
 void
 reparent(struct proc *p)
 {
   struct proc *pp;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
+  acquire(&p->wait_lock);
+  if(p->children){
+    acquire(&initproc->wait_lock);
+    while((pp = p->children) != 0){
+      p->children = pp->sibling;
+      addchild(initproc, pp);
     }
+    wakeproc(initproc, initproc);
+    release(&initproc->wait_lock);
   }
+  release(&p->wait_lock);
 }
 
-// Exit the current process.  Does not return.
-// An exited process remains in the zombie state
-// until its parent calls wait().
+// Exit the current thread.  Does not return.
+// An exited thread remains in the zombie state until
+// its parent calls wait(), or, if it was made by clone(),
+// until another thread calls join().  The exit of a
+// process's first thread ends the whole process.
 void
 kexit(int status)
 {
   struct proc *p = myproc();
+  struct proc *pp;
 
   if(p == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
-    }
-  }
-
-  begin_op();
-  iput(p->cwd);
-  end_op();
-  p->cwd = 0;
+  // Close all open files, unless other threads share them.
+  filesput(p->files);
+  p->files = 0;
 
-  acquire(&wait_lock);
+  if(p->tfslot == 0){
+    acquire(&p->vm->tlock);
+    killthreads(p);
+    release(&p->vm->tlock);
+  }
 
   // Give any children to init.
   reparent(p);
 
-  // Parent might be sleeping in wait().
-  wakeup(p->parent);
-  
+  pp = lockparent(p);
+  acquire(&p->vm->tlock);
+
+  // Parent might be sleeping in wait(),
+  // or another thread in join().
+  wakeproc(pp, pp);
+  if(p->tfslot != 0)
+    wakeup(p->vm);
+
   acquire(&p->lock);
 
   p->xstate = status;
   p->state = ZOMBIE;
 
-  release(&wait_lock);
+  release(&p->vm->tlock);
+  release(&pp->wait_lock);
 
   // Jump into the scheduler, never to return.
   sched();
   panic("zombie exit");
 }
 
+// Add b's counts to a.
+static void
+ruadd(struct rusage *a, struct rusage *b)
+{
+  a->utime += b->utime;
+  a->stime += b->stime;
+  a->nvcsw += b->nvcsw;
+  a->nivcsw += b->nivcsw;
+  a->nfault += b->nfault;
+  a->nsyscall += b->nsyscall;
+  a->kmalloc += b->kmalloc;
+  a->kfree += b->kfree;
+}
+
+// Free p's zombie child or thread pp, copying its exit status to
+// user address addr, and return its pid; -1 if the copy fails.
+// Caller holds the locks unlinkproc() needs, and pp->lock.
+static int
+reap(struct proc *p, struct proc *pp, uint64 addr)
+{
+  int pid = pp->pid;
+
+  if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
+                          sizeof(pp->xstate)) < 0)
+    return -1;
+  ruadd(&p->cru, &pp->ru);
+  ruadd(&p->cru, &pp->cru);
+  unlinkproc(pp);
+  freeproc(pp);
+  return pid;
+}
+
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
 int
@@ -391,43 +1104,106 @@ kwait(uint64 addr)
   int havekids, pid;
   struct proc *p = myproc();
 
-  acquire(&wait_lock);
+  acquire(&p->wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
+    // Scan through our children looking for exited ones.
     havekids = 0;
-    for(pp = proc; pp < &proc[NPROC]; pp++){
-      if(pp->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&pp->lock);
-
-        havekids = 1;
-        if(pp->state == ZOMBIE){
-          // Found one.
-          pid = pp->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                  sizeof(pp->xstate)) < 0) {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(pp);
-          release(&pp->lock);
-          release(&wait_lock);
-          return pid;
-        }
+    for(pp = p->children; pp; pp = pp->sibling){
+      // our own threads are for join().
+      if(pp->vm == p->vm)
+        continue;
+      havekids = 1;
+      // a thread given to init leaves its vmspace's list too.
+      if(pp->tfslot != 0)
+        acquire(&pp->vm->tlock);
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&pp->lock);
+      if(pp->state == ZOMBIE){
+        // Found one.
+        struct vmspace *vm = pp->tfslot != 0 ? pp->vm : 0;
+        pid = reap(p, pp, addr);
         release(&pp->lock);
+        if(vm)
+          release(&vm->tlock);
+        release(&p->wait_lock);
+        return pid;
       }
+      release(&pp->lock);
+      if(pp->tfslot != 0)
+        release(&pp->vm->tlock);
     }
 
     // No point waiting if we don't have any children.
     if(!havekids || killed(p)){
-      release(&wait_lock);
+      release(&p->wait_lock);
       return -1;
     }
     
     // Wait for a child to exit.
-    sleep(p, &wait_lock);  //DOC: wait-sleep
+    sleep(p, &p->wait_lock);  //DOC: wait-sleep
+  }
+}
+
+// Wait for thread tid of this process, or any of its threads
+// if tid is 0, to exit, and return its pid.  The process's first
+// thread can't be joined; its exit ends the process.
+// Return -1 if there is no such thread.
+int
+kjoin(int tid, uint64 addr)
+{
+  struct proc *pp, *parent;
+  int havethreads, pid;
+  struct proc *p = myproc();
+  struct vmspace *vm = p->vm;
+
+  acquire(&vm->tlock);
+
+  for(;;){
+    havethreads = 0;
+    for(pp = vm->threads; pp; pp = pp->tnext){
+      if(pp == p || (tid != 0 && pp->pid != tid))
+        continue;
+      havethreads = 1;
+      acquire(&pp->lock);
+      if(pp->state == ZOMBIE){
+        release(&pp->lock);
+        break;
+      }
+      release(&pp->lock);
+    }
+
+    if(pp){
+      // the parent's wait_lock goes before tlock; once both are
+      // held, pp is still ours if it kept its pid.
+      // interrupts stay off so that pp isn't freed meanwhile.
+      pid = pp->pid;
+      push_off();
+      release(&vm->tlock);
+      parent = lockparent(pp);
+      acquire(&vm->tlock);
+      acquire(&pp->lock);
+      pop_off();
+      if(parent && pp->pid == pid && pp->state == ZOMBIE){
+        pid = reap(p, pp, addr);
+        release(&pp->lock);
+        release(&vm->tlock);
+        release(&parent->wait_lock);
+        return pid;
+      }
+      release(&pp->lock);
+      if(parent)
+        release(&parent->wait_lock);
+      continue;
+    }
+
+    if(!havethreads || killed(p)){
+      release(&vm->tlock);
+      return -1;
+    }
+
+    // Wait for a thread to exit; see kexit().
+    sleep(vm, &vm->tlock);
   }
 }
 
@@ -441,7 +1217,7 @@ kwait(uint64 addr)
 void
 scheduler(void)
 {
-  struct proc *p;
+  struct proc *p, **pp;
   struct cpu *c = mycpu();
 
   c->proc = 0;
@@ -453,29 +1229,47 @@ scheduler(void)
     // and wfi.
     intr_on();
     intr_off();
-
-    int found = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-        found = 1;
-      }
-      release(&p->lock);
-    }
-    if(found == 0) {
+    procquiesce(c);
+
+    // take the first queued proc that may run here.
+    acquire(&runq.lock);
+    for(pp = &runq.head; (p = *pp) != 0; pp = &p->runnext)
+      if(p->pincpu == 0 || p->pincpu == cpuid() + 1)
+        break;
+    if(p && (*pp = p->runnext) == 0)
+      runq.tail = pp;
+    release(&runq.lock);
+    if(p == 0) {
       // nothing to run; stop running on this core until an interrupt.
       asm volatile("wfi");
+      continue;
     }
+
+    // only scheduler() moves a proc on from RUNNABLE, so p is
+    // still RUNNABLE, once whoever queued it lets go of its lock.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler");
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    c->proc = p;
+    p->cpu = cpuid();
+    p->lastts = r_time();
+    TRACE(TC_SCHED, TE_SWITCH_IN, p->pid, 0);
+    swtch(&c->context, &p->context);
+    TRACE(TC_SCHED, TE_SWITCH_OUT, p->pid, p->state);
+    p->ru.stime += r_time() - p->lastts;
+    if(p->state == SLEEPING)
+      p->ru.nvcsw++;
+    else if(p->state == RUNNABLE)
+      p->ru.nivcsw++;
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
@@ -512,7 +1306,7 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
@@ -534,6 +1328,8 @@ forkret(void)
     // regular process (e.g., because it calls sleep), and thus cannot
     // be run from main().
     fsinit(ROOTDEV);
+    bootphase("fsinit");
+    tmpfsinit();
 
     first = 0;
     // ensure other cores see first=0.
@@ -545,43 +1341,96 @@ forkret(void)
     if (p->trapframe->a0 == -1) {
       panic("exec");
     }
+    bootphase("exec init");
+    bootreport();
   }
 
   // return to user space, mimicing usertrap()'s return.
   prepare_return();
-  uint64 satp = MAKE_SATP(p->pagetable);
+  uint64 satp = uvmswitch(p);
   uint64 trampoline_userret = TRAMPOLINE + (userret - trampoline);
   ((void (*)(uint64))trampoline_userret)(satp);
 }
 
+// A kernel thread's first scheduling by scheduler() will swtch
+// here.
+static void
+kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler, which took it with
+  // interrupts off, so release() leaves them off.
+  release(&p->lock);
+  intr_on();
+
+  p->kfn(p->karg);
+  panic("kthread returned");
+}
+
+// Make p RUNNABLE and queue it for scheduler().  Caller holds
+// p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  p->state = RUNNABLE;
+  acquire(&runq.lock);
+  p->runnext = 0;
+  *runq.tail = p;
+  runq.tail = &p->runnext;
+  release(&runq.lock);
+}
+
+// The list of procs that may be sleeping on chan.
+static struct sleepq*
+sleepqof(void *chan)
+{
+  return &sleepq[((uint64)chan * 0x9e3779b97f4a7c15UL) >> (64 - SLEEPQBITS)];
+}
+
 // Sleep on channel chan, releasing condition lock lk.
 // Re-acquires lk when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct sleepq *sq = sleepqof(chan);
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // Once we hold p->lock and chan's list lock,
+  // we can be guaranteed that we won't miss any
+  // wakeup (wakeup locks both),
   // so it's okay to release lk.
 
+  acquire(&sq->lock);
   acquire(&p->lock);  //DOC: sleeplock1
   release(lk);
 
-  // Go to sleep.
+  // Go to sleep, on chan's list.
   p->chan = chan;
   p->state = SLEEPING;
+  if((p->sqnext = sq->head) != 0)
+    sq->head->sqprev = &p->sqnext;
+  p->sqprev = &sq->head;
+  sq->head = p;
+  release(&sq->lock);
 
   sched();
 
   // Tidy up.
   p->chan = 0;
+  release(&p->lock);
+
+  // Off chan's list.  The list lock goes before p->lock, so this
+  // waits until p->lock is let go; wakeup() skips p meanwhile,
+  // since p->chan is 0.
+  acquire(&sq->lock);
+  if((*p->sqprev = p->sqnext) != 0)
+    p->sqnext->sqprev = p->sqprev;
+  release(&sq->lock);
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
@@ -590,17 +1439,21 @@ sleep(void *chan, struct spinlock *lk)
 void
 wakeup(void *chan)
 {
+  struct sleepq *sq = sleepqof(chan);
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  acquire(&sq->lock);
+  for(p = sq->head; p; p = p->sqnext) {
     if(p != myproc()){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
+        setrunnable(p);
+        TRACE(TC_WAKEUP, TE_WAKEUP, p->pid, chan);
       }
       release(&p->lock);
     }
   }
+  release(&sq->lock);
 }
 
 // Kill the process with the given pid.
@@ -611,20 +1464,20 @@ kkill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
+  if((p = findpid(pid)) == 0)
+    return -1;
+  if(p->kfn){
+    // a kernel thread.
     release(&p->lock);
+    return -1;
   }
-  return -1;
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    setrunnable(p);
+  }
+  release(&p->lock);
+  return 0;
 }
 
 void
@@ -694,7 +1547,8 @@ procdump(void)
   char *state;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  push_off();
+  for(p = firstproc(); p; p = p->next){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -704,4 +1558,100 @@ procdump(void)
     printf("%d %s %s", p->pid, state, p->name);
     printf("\n");
   }
+  pop_off();
+}
+
+// Charge bytes of kmalloc() (positive) or kfree() (negative) to
+// the running thread, if any.  Called by slab.c.
+void
+kmem_charge(long bytes)
+{
+  struct proc *p = myproc();
+
+  if(p == 0)
+    return;
+  if(bytes > 0)
+    p->ru.kmalloc += bytes;
+  else
+    p->ru.kfree += -bytes;
+}
+
+// r_time() counts at 10 MHz in qemu's virt machine.
+#define TIMEBASE_PER_US 10
+
+static void
+rucopy(struct rusage *dst, struct rusage *src)
+{
+  *dst = *src;
+  dst->utime /= TIMEBASE_PER_US;
+  dst->stime /= TIMEBASE_PER_US;
+}
+
+// Copy the calling thread's usage (RUSAGE_SELF) or that of the
+// children and threads it has reaped (RUSAGE_CHILDREN) to user
+// address addr.
+int
+kgetrusage(int who, uint64 addr)
+{
+  struct proc *p = myproc();
+  struct rusage ru;
+
+  if(who == RUSAGE_SELF){
+    // include the time since it last entered the kernel.
+    push_off();
+    p->ru.stime += r_time() - p->lastts;
+    p->lastts = r_time();
+    pop_off();
+    rucopy(&ru, &p->ru);
+  } else if(who == RUSAGE_CHILDREN){
+    rucopy(&ru, &p->cru);
+  } else {
+    return -1;
+  }
+  if(copyout(p->pagetable, addr, (char*)&ru, sizeof(ru)) < 0)
+    return -1;
+  return 0;
+}
+
+// Copy a struct procstat for each of up to n threads in use to
+// user address addr; returns how many.  A few at a time, since
+// copyout can't run with the locks held.
+int
+kprocstat(uint64 addr, int n)
+{
+  struct procstat ps[4];
+  struct proc *p, *pp;
+  int k, done = 0;
+
+  // keep p good while the locks are dropped for copyout.
+  holdprocs();
+  p = firstproc();
+  while(done < n && p){
+    for(k = 0; k < NELEM(ps) && done + k < n && p; p = p->next){
+      acquire(&p->lock);
+      if(p->state != UNUSED){
+        ps[k].pid = p->pid;
+        // parents can change under us, but aren't freed.
+        pp = __atomic_load_n(&p->parent, __ATOMIC_RELAXED);
+        ps[k].ppid = pp ? pp->pid : 0;
+        ps[k].state = p->state;
+        ps[k].cpu = p->cpu;
+        ps[k].sz = p->vm ? p->vm->sz : 0;
+        ps[k].ticks = ticks - p->start;
+        ps[k].tid = p->tfslot;
+        safestrcpy(ps[k].name, p->name, sizeof(ps[k].name));
+        rucopy(&ps[k].ru, &p->ru);
+        k++;
+      }
+      release(&p->lock);
+    }
+    if(k > 0 && copyout(myproc()->pagetable, addr + done*sizeof(ps[0]),
+                        (char*)ps, k*sizeof(ps[0])) < 0){
+      unholdprocs();
+      return -1;
+    }
+    done += k;
+  }
+  unholdprocs();
+  return done;
 }
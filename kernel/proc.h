@@ -1,3 +1,7 @@
+#include "rusage.h"
+#include "sleepstat.h"
+#include "irqstat.h"
+
 // Saved registers for kernel context switches.
 struct context {
   uint64 ra;
@@ -24,6 +28,16 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint64 asid_gen;            // ASID generation this CPU's TLB is clean for.
+  struct sleepstat sleepstat; // sleep-lock counters, under the lock's spinlock.
+  uint64 irqs[NIRQ];          // device interrupts taken, by IRQ.
+  uint64 irqtime;             // r_time() spent in device interrupt handlers,
+  uint64 irqmax;              // ... and the longest; see softirqstat().
+  uint softpending;           // deferred work raised; see softirq.c.
+  int insoftirq;              // running it?
+  uint64 nsoft;               // times it ran,
+  uint64 softtime;            // ... and for how long.
+  uint64 qgen;                // 1 + procs retired when last in scheduler().
 };
 
 extern struct cpu cpus[NCPU];
@@ -81,6 +95,35 @@ struct trapframe {
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A user address space.  Threads made by clone() share one, and its
+// page table; each thread has its own trapframe, mapped at
+// TRAPFRAMES(p->tfslot).
+struct vmspace {
+  struct sleeplock mmlock;     // held to change sz and user memory
+  struct spinlock lock;        // protects ref, sz, tfslots
+  int ref;                     // threads using it
+  uint64 sz;                   // Size of process memory (bytes)
+  uint tfslots;                // trapframe slots in use
+  uint64 asid;                 // RISC-V ASID of pagetable, 0 if none yet
+  uint64 asid_gen;             // generation asid was allocated in
+  uint tlb_stale;              // CPUs that must flush asid before running it
+  volatile uint active;        // CPUs running it in user space right now
+  struct spinlock tlock;       // protects threads; join() sleeps on it
+  struct proc *threads;        // threads made by clone()
+};
+
+// Open files and current directory, shared by threads.
+struct files {
+  struct spinlock lock;        // protects everything below
+  int ref;                     // threads using it
+  int nfd;                     // slots in ofile[]
+  int maxfd;                   // most descriptors allowed; fdlimit()
+  struct file **ofile;         // Open files; inofile until it grows
+  uint64 fdmap[NOFILEMAX/64];  // descriptors in use
+  struct file *inofile[NOFILE];
+  struct inode *cwd;           // Current directory
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
@@ -92,16 +135,50 @@ struct proc {
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
 
-  // wait_lock must be held when using this:
+  // the parent's wait_lock must be held when using these:
   struct proc *parent;         // Parent process
+  struct proc *sibling;        // Next child of parent
+
+  // p->wait_lock protects the list of children; wait() sleeps on it.
+  struct spinlock wait_lock;
+  struct proc *children;       // Its children, linked by sibling
+
+  struct proc *tnext;          // Next thread in vm->threads; vm->tlock
+
+  // proc.c's runq.lock and sleep-list locks protect these:
+  struct proc *runnext;        // Next in the run queue
+  struct proc *sqnext;         // Next on its channel's sleep list,
+  struct proc **sqprev;        // ... and what points at it
+
+  // proc_lock must be held when using these:
+  struct proc *hashnext;       // Next in pid hash chain
+  struct proc *freenext;       // Next on the free or retired list
+  struct proc *prev;           // Previous in list of all procs
+  uint64 gone;                 // retired.gen when retired; see proc.c
+  int slot;                    // KSTACK() slot
+
+  struct proc *next;           // Next in list of all procs; proc_lock
+                               // to change, but read without it
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
-  uint64 sz;                   // Size of process memory (bytes)
-  pagetable_t pagetable;       // User page table
+  uint64 kstackpa;             // ... and its physical page
+  struct vmspace *vm;          // User address space
+  pagetable_t pagetable;       // User page table, shared by threads
   struct trapframe *trapframe; // data page for trampoline.S
+  int tfslot;                  // trapframe is mapped at TRAPFRAMES(tfslot)
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
+  struct files *files;         // Open files and current directory
   char name[16];               // Process name (debugging)
+  void (*kfn)(void*);          // if a kernel thread, what it runs,
+  void *karg;                  // ... and with what; see kthread_create().
+  int pincpu;                  // 1 + the only CPU it may run on, or 0
+
+  // accounting, charged by the CPU running the thread and read
+  // without a lock.  times are in r_time() units here.
+  struct rusage ru;
+  struct rusage cru;           // reaped children and threads
+  uint64 lastts;               // r_time() when time was last charged
+  uint start;                  // ticks when allocated
+  int cpu;                     // CPU it last ran on
 };
@@ -0,0 +1,35 @@
+// Resource accounting, returned by getrusage() and procstat().
+
+#ifndef _KERNEL_RUSAGE_H
+#define _KERNEL_RUSAGE_H
+
+struct rusage {
+  uint64 utime;       // microseconds in user space
+  uint64 stime;       // microseconds in the kernel
+  uint64 nvcsw;       // voluntary context switches: slept
+  uint64 nivcsw;      // involuntary: preempted
+  uint64 nfault;      // page faults
+  uint64 nsyscall;    // system calls
+  uint64 kmalloc;     // bytes allocated with kmalloc()
+  uint64 kfree;       // bytes freed with kfree()
+};
+
+// getrusage() who
+#define RUSAGE_SELF      0   // the calling thread
+#define RUSAGE_CHILDREN  1   // children and threads it has reaped
+
+// one process-table entry, from procstat().
+struct procstat {
+  int pid;
+  int ppid;
+  int state;          // enum procstate: unused, used, sleeping,
+                      // runnable, running, zombie
+  int cpu;            // CPU it last ran on
+  uint64 sz;          // bytes of user memory
+  uint ticks;         // clock ticks since it was created
+  int tid;            // thread slot; 0 for a process's first thread
+  char name[16];
+  struct rusage ru;
+};
+
+#endif // _KERNEL_RUSAGE_H
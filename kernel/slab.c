@@ -5,6 +5,8 @@
 #include "defs.h"
 #include "slab.h"
 #include "buddy.h"
+#include "atrace.h"
+#include "slabstat.h"
 
 #ifndef SLAB_KERNEL
 static struct buddy_allocator slab_buddy;
@@ -34,6 +36,34 @@ static struct {
 
 static kmem_cache_t *small_buf_caches[NUM_SMALL_BUF_SIZES];
 
+// Pages for slabs and cache descriptors: from slab's own buddy in
+// Deo 1, from the kernel's page allocator in Deo 2.  Traced as
+// nested allocations, since they happen inside a traced call.
+static void *slab_pages_alloc(int order)
+{
+    void *p;
+
+    atrace_nest(1);
+#ifdef SLAB_KERNEL
+    p = kalloc_order(order);
+#else
+    p = buddy_alloc(&slab_buddy, order);
+#endif
+    atrace_nest(-1);
+    return p;
+}
+
+static void slab_pages_free(void *p, int order)
+{
+    atrace_nest(1);
+#ifdef SLAB_KERNEL
+    pgfree_order(p, order);
+#else
+    buddy_free(&slab_buddy, p, order);
+#endif
+    atrace_nest(-1);
+}
+
 static void *slab_obj_start(slab_t *slab)
 {
     kmem_cache_t *c = slab->cache;
@@ -101,11 +131,7 @@ static void build_free_list(slab_t *slab, kmem_cache_t *cache)
 
 static slab_t *alloc_slab(kmem_cache_t *cache)
 {
-#ifdef SLAB_KERNEL
-    void *region = kalloc_order(cache->slab_order);
-#else
-    void *region = buddy_alloc(&slab_buddy, cache->slab_order);
-#endif
+    void *region = slab_pages_alloc(cache->slab_order);
     if (!region) {
         cache->error = 1;
         return 0;
@@ -159,11 +185,7 @@ static void destroy_slab(kmem_cache_t *cache, slab_t *slab)
     cache->total_objs -= cache->obj_per_slab;
     cache->free_objs -= slab->free_count;
 
-#ifdef SLAB_KERNEL
-    pgfree_order((void *)slab, slab->order);
-#else
-    buddy_free(&slab_buddy, (void *)slab, slab->order);
-#endif
+    slab_pages_free((void *)slab, slab->order);
 }
 
 static void free_empty_slab(kmem_cache_t *cache, slab_t *slab)
@@ -181,11 +203,7 @@ static void free_empty_slab(kmem_cache_t *cache, slab_t *slab)
     cache->total_objs -= cache->obj_per_slab;
     cache->free_objs -= slab->free_count;
 
-#ifdef SLAB_KERNEL
-    pgfree_order((void *)slab, slab->order);
-#else
-    buddy_free(&slab_buddy, (void *)slab, slab->order);
-#endif
+    slab_pages_free((void *)slab, slab->order);
 }
 
 // ============================================================
@@ -233,11 +251,7 @@ kmem_cache_t *kmem_cache_create(const char *name, size_t size,
     uint64 aligned_size = ALIGN8(size);
 
     // Allocate the cache descriptor (1 page = 4KB, more than enough)
-#ifdef SLAB_KERNEL
-    kmem_cache_t *cache = (kmem_cache_t *)kalloc_order(0);
-#else
-    kmem_cache_t *cache = (kmem_cache_t *)buddy_alloc(&slab_buddy, 0);
-#endif
+    kmem_cache_t *cache = (kmem_cache_t *)slab_pages_alloc(0);
     if (!cache)
         return 0;
 
@@ -253,11 +267,7 @@ kmem_cache_t *kmem_cache_create(const char *name, size_t size,
     cache->obj_per_slab = compute_obj_per_slab(aligned_size, cache->slab_order);
 
     if (cache->obj_per_slab <= 0) {
-#ifdef SLAB_KERNEL
-        pgfree_order(cache, 0);
-#else
-        buddy_free(&slab_buddy, cache, 0);
-#endif
+        slab_pages_free(cache, 0);
         return 0;
     }
 
@@ -295,7 +305,7 @@ kmem_cache_t *kmem_cache_create(const char *name, size_t size,
 //  kmem_cache_alloc
 // ============================================================
 
-void *kmem_cache_alloc(kmem_cache_t *cachep)
+static void *cache_alloc(kmem_cache_t *cachep)
 {
     if (!cachep)
         return 0;
@@ -389,7 +399,7 @@ static inline slab_t *obj_to_slab(kmem_cache_t *cachep, void *objp)
     return (slab_t *)slab_addr;
 }
 
-void kmem_cache_free(kmem_cache_t *cachep, void *objp)
+static void cache_free(kmem_cache_t *cachep, void *objp)
 {
     if (!cachep || !objp)
         return;
@@ -458,6 +468,24 @@ void kmem_cache_free(kmem_cache_t *cachep, void *objp)
     release(&cachep->lock);
 }
 
+void *kmem_cache_alloc(kmem_cache_t *cachep)
+{
+    void *obj = cache_alloc(cachep);
+
+    if (atrace_on && obj)
+        atrace_record(AT_ALLOC, cachep, cachep->obj_size, obj);
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t *cachep, void *objp)
+{
+    // record it first: once freed, another CPU may get it back
+    // and trace that before we would.
+    if (atrace_on && cachep && objp)
+        atrace_record(AT_FREE, cachep, cachep->obj_size, objp);
+    cache_free(cachep, objp);
+}
+
 // ============================================================
 //  kmem_cache_shrink
 // ============================================================
@@ -489,6 +517,21 @@ int kmem_cache_shrink(kmem_cache_t *cachep)
     return freed_blocks;
 }
 
+// Shrink every cache that hasn't grown since it was last shrunk;
+// returns the blocks given back.  The kernel calls this now and
+// then from a workqueue (see trap.c), so that slabs emptied by a
+// burst of frees don't stay with their cache for good.
+int kmem_cache_reap(void)
+{
+    int freed_blocks = 0;
+
+    acquire(&slab_state.lock);
+    for (kmem_cache_t *c = slab_state.caches; c; c = c->next)
+        freed_blocks += kmem_cache_shrink(c);
+    release(&slab_state.lock);
+    return freed_blocks;
+}
+
 // ============================================================
 //  kmem_cache_destroy
 // ============================================================
@@ -534,11 +577,7 @@ void kmem_cache_destroy(kmem_cache_t *cachep)
     release(&slab_state.lock);
 
     // Free the cache descriptor itself
-#ifdef SLAB_KERNEL
-    pgfree_order(cachep, 0);
-#else
-    buddy_free(&slab_buddy, cachep, 0);
-#endif
+    slab_pages_free(cachep, 0);
 }
 
 // ============================================================
@@ -547,31 +586,82 @@ void kmem_cache_destroy(kmem_cache_t *cachep)
 
 void kmem_cache_info(kmem_cache_t *cachep)
 {
+    struct slabstat st;
+
     if (!cachep)
         return;
 
-    acquire(&cachep->lock);
+    // print from a snapshot, so allocation isn't held up by the console.
+    kmem_cache_stat(cachep, &st);
 
-    int used = cachep->total_objs - cachep->free_objs;
     int pct = 0;
-    if (cachep->total_objs > 0)
-        pct = (used * 100) / cachep->total_objs;
+    if (st.total_objs > 0)
+        pct = (st.active_objs * 100) / st.total_objs;
 
-    int cache_blocks = cachep->slab_count * (1 << cachep->slab_order);
+    int cache_blocks = st.slabs * (1 << st.slab_order);
 
-    printf("CACHE: %s\n", cachep->name);
-    printf("  obj size:   %lu B\n", cachep->obj_size);
+    printf("CACHE: %s\n", st.name);
+    printf("  obj size:   %lu B\n", st.obj_size);
     printf("  cache size: %d blocks\n", cache_blocks);
-    printf("  slabs:      %d\n", cachep->slab_count);
-    printf("  objs/slab:  %d\n", cachep->obj_per_slab);
+    printf("  slabs:      %d\n", st.slabs);
+    printf("  objs/slab:  %d\n", st.obj_per_slab);
     printf("  usage:      %d%%\n", pct);
-    printf("  allocs:     %lu\n", cachep->alloc_count);
-    printf("  frees:      %lu\n", cachep->free_count_total);
-    printf("  colors:     %d\n", cachep->color_max);
+    printf("  allocs:     %lu\n", st.allocs);
+    printf("  frees:      %lu\n", st.frees);
+    printf("  colors:     %d\n", st.color_max);
+}
+
+// ============================================================
+//  kmem_cache_stat / kmem_cache_stats
+// ============================================================
 
+void kmem_cache_stat(kmem_cache_t *cachep, struct slabstat *st)
+{
+    acquire(&cachep->lock);
+    str_copy(st->name, cachep->name, sizeof(st->name));
+    st->obj_size = cachep->obj_size;
+    st->allocs = cachep->alloc_count;
+    st->frees = cachep->free_count_total;
+    st->slabs = cachep->slab_count;
+    st->slab_order = cachep->slab_order;
+    st->obj_per_slab = cachep->obj_per_slab;
+    st->active_objs = cachep->total_objs - cachep->free_objs;
+    st->total_objs = cachep->total_objs;
+    st->error = cachep->error;
+    st->color_max = cachep->color_max;
+    st->color_next = cachep->color_next;
     release(&cachep->lock);
 }
 
+// Snapshot up to n caches, starting with the skip'th on the cache
+// list; returns how many.  Each cache is locked only while it is
+// copied.
+int kmem_cache_stats(int skip, struct slabstat *st, int n)
+{
+    int k = 0;
+
+    acquire(&slab_state.lock);
+    for (kmem_cache_t *c = slab_state.caches; c && k < n; c = c->next) {
+        if (skip > 0) {
+            skip--;
+            continue;
+        }
+        kmem_cache_stat(c, &st[k++]);
+    }
+    release(&slab_state.lock);
+    return k;
+}
+
+// free blocks of each order where slab pages come from.
+void slab_pages_stat(struct buddystat *st)
+{
+#ifdef SLAB_KERNEL
+    kalloc_stat(st);
+#else
+    buddy_stat(&slab_buddy, st);
+#endif
+}
+
 // ============================================================
 //  kmem_cache_error
 // ============================================================
@@ -644,7 +734,12 @@ void *kmalloc(size_t size)
         }
     }
 
-    return kmem_cache_alloc(small_buf_caches[idx]);
+    void *obj = cache_alloc(small_buf_caches[idx]);
+    if (obj)
+        kmem_charge(small_buf_caches[idx]->obj_size);
+    if (atrace_on && obj)
+        atrace_record(AT_KMALLOC, small_buf_caches[idx], size, obj);
+    return obj;
 }
 
 void kfree(const void *objp)
@@ -667,7 +762,10 @@ void kfree(const void *objp)
 
         // Quick check: does this slab belong to this cache?
         if (slab->cache == cache) {
-            kmem_cache_free(cache, (void *)objp);
+            if (atrace_on)
+                atrace_record(AT_KFREE, cache, 0, (void *)objp);
+            kmem_charge(-(long)cache->obj_size);
+            cache_free(cache, (void *)objp);
             return;
         }
     }
@@ -68,6 +68,8 @@ kmem_cache_t *kmem_cache_create(const char *name, size_t size,
 
 int kmem_cache_shrink(kmem_cache_t *cachep);
 
+int kmem_cache_reap(void);
+
 void *kmem_cache_alloc(kmem_cache_t *cachep);
 
 void kmem_cache_free(kmem_cache_t *cachep, void *objp);
@@ -82,4 +84,13 @@ void kmem_cache_info(kmem_cache_t *cachep);
 
 int kmem_cache_error(kmem_cache_t *cachep);
 
+struct slabstat;
+struct buddystat;
+
+void kmem_cache_stat(kmem_cache_t *cachep, struct slabstat *st);
+
+int kmem_cache_stats(int skip, struct slabstat *st, int n);
+
+void slab_pages_stat(struct buddystat *st);
+
 #endif // _KERNEL_SLAB_H
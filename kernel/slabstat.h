@@ -0,0 +1,29 @@
+// Allocator statistics, filled in by the slabstat() and
+// buddystat() system calls; see user/slabtop.c.
+
+struct slabstat {
+  char name[32];
+  uint64 obj_size;
+  uint64 allocs;        // kmem_cache_alloc calls since creation
+  uint64 frees;
+  int slabs;
+  int slab_order;       // each slab is 2^slab_order blocks
+  int obj_per_slab;
+  int active_objs;
+  int total_objs;
+  int error;            // last error code, 0 if none
+  int color_max;        // coloring offsets, in 8-byte units
+  int color_next;
+};
+
+#define BUDDYSTAT_ORDERS 21   // MAX_ORDER - MIN_ORDER + 1 in buddy.h
+
+// the buddy allocator slab pages come from: slab's own in Deo 1,
+// the kernel's global one in Deo 2.
+struct buddystat {
+  uint64 start;
+  uint64 total_size;    // bytes managed
+  int max_order;
+  int pad;
+  int nfree[BUDDYSTAT_ORDERS];  // free blocks of each order
+};
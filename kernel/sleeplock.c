@@ -6,8 +6,61 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
-#include "proc.h"
 #include "sleeplock.h"
+#include "proc.h"
+
+// Most sleep locks are held for a few microseconds (bread() to
+// brelse(), a stat), and a waiter that sleeps pays for a sleep, a
+// wakeup and a trip through the scheduler to get one.  So if the
+// holder is running on another CPU, a waiter first spins for up to
+// SPINTIME, sleeping only if the lock isn't let go by then or the
+// holder blocks.  The spinning is done with interrupts off, so the
+// holder isn't freed meanwhile (see proc.c) and its state can be
+// read without its lock even if it has since exited.
+
+#define SPINTIME 500   // r_time() units (10 MHz in qemu): 50 us
+
+static int spinon = 1;  // sleepstat() can turn spinning off
+
+// Counters for this CPU.  Caller holds a sleep lock's spinlock, so
+// interrupts are off.
+static struct sleepstat *
+stats(void)
+{
+  return &mycpu()->sleepstat;
+}
+
+static int
+running(struct proc **owner)
+{
+  struct proc *p = __atomic_load_n(owner, __ATOMIC_RELAXED);
+
+  return p && __atomic_load_n(&p->state, __ATOMIC_RELAXED) == RUNNING;
+}
+
+// *busy is set and lk, the lock's spinlock, held.  If the holder is
+// running, spin with lk dropped until *busy clears, the holder stops
+// running, or SPINTIME passes.  Returns with lk held again, and
+// whether it spun.
+static int
+spinwait(uint *busy, struct proc **owner, struct spinlock *lk)
+{
+  uint64 t0, t;
+
+  if(!spinon || !running(owner))
+    return 0;
+  push_off();
+  release(lk);
+  t0 = t = r_time();
+  while(__atomic_load_n(busy, __ATOMIC_RELAXED) && running(owner) &&
+        (t = r_time()) - t0 < SPINTIME)
+    ;
+  acquire(lk);
+  pop_off();
+  stats()->spins++;
+  stats()->spintime += t - t0;
+  return 1;
+}
 
 void
 initsleeplock(struct sleeplock *lk, char *name)
@@ -15,6 +68,7 @@ initsleeplock(struct sleeplock *lk, char *name)
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->owner = 0;
   lk->pid = 0;
 }
 
@@ -22,10 +76,18 @@ void
 acquiresleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
+  stats()->acquires++;
+  if(lk->locked){
+    stats()->contended++;
+    if(spinwait(&lk->locked, &lk->owner, &lk->lk) && !lk->locked)
+      stats()->spinwins++;
+  }
   while (lk->locked) {
+    stats()->sleeps++;
     sleep(lk, &lk->lk);
   }
   lk->locked = 1;
+  lk->owner = myproc();
   lk->pid = myproc()->pid;
   release(&lk->lk);
 }
@@ -35,6 +97,7 @@ releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
   lk->locked = 0;
+  lk->owner = 0;
   lk->pid = 0;
   wakeup(lk);
   release(&lk->lk);
@@ -51,5 +114,103 @@ holdingsleep(struct sleeplock *lk)
   return r;
 }
 
+// Reader/writer sleep locks.  A writer waiting for the readers to
+// leave holds off new ones, so a stream of readers can't starve it.
 
+void
+initrwsleeplock(struct rwsleeplock *lk, char *name)
+{
+  initlock(&lk->lk, "rw sleep lock");
+  lk->name = name;
+  lk->readers = 0;
+  lk->writer = 0;
+  lk->wwait = 0;
+  lk->owner = 0;
+  lk->pid = 0;
+}
 
+// Acquire lk for writing if write, else for reading.  Readers
+// aren't recorded, so a waiter spins only on a running writer.
+void
+acquiresleep_rw(struct rwsleeplock *lk, int write)
+{
+  acquire(&lk->lk);
+  stats()->acquires++;
+  if(lk->writer || (write ? lk->readers > 0 : lk->wwait > 0)){
+    stats()->contended++;
+    if(spinwait(&lk->writer, &lk->owner, &lk->lk) && !lk->writer &&
+       (write ? lk->readers == 0 : lk->wwait == 0))
+      stats()->spinwins++;
+  }
+  if(write){
+    lk->wwait++;
+    while(lk->writer || lk->readers > 0){
+      stats()->sleeps++;
+      sleep(lk, &lk->lk);
+    }
+    lk->wwait--;
+    lk->writer = 1;
+    lk->owner = myproc();
+    lk->pid = myproc()->pid;
+  } else {
+    while(lk->writer || lk->wwait > 0){
+      stats()->sleeps++;
+      sleep(lk, &lk->lk);
+    }
+    lk->readers++;
+  }
+  release(&lk->lk);
+}
+
+// Release lk, held in whichever mode.
+void
+releasesleep_rw(struct rwsleeplock *lk)
+{
+  acquire(&lk->lk);
+  if(lk->writer){
+    lk->writer = 0;
+    lk->owner = 0;
+    lk->pid = 0;
+    wakeup(lk);
+  } else if(--lk->readers == 0 && lk->wwait > 0){
+    wakeup(lk);
+  }
+  release(&lk->lk);
+}
+
+// Is lk held for writing by this process, or held by any reader?
+// (readers aren't recorded.)
+int
+holdingsleep_rw(struct rwsleeplock *lk)
+{
+  int r;
+
+  acquire(&lk->lk);
+  r = (lk->writer && lk->pid == myproc()->pid) || lk->readers > 0;
+  release(&lk->lk);
+  return r;
+}
+
+// Copy the counters, summed over CPUs, to user address addr.  Turn
+// spinning off if spin is 0, on if 1; leave it alone if -1.
+int
+sleepstats(uint64 addr, int spin)
+{
+  struct sleepstat st;
+  struct cpu *c;
+
+  memset(&st, 0, sizeof(st));
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    st.acquires += c->sleepstat.acquires;
+    st.contended += c->sleepstat.contended;
+    st.spins += c->sleepstat.spins;
+    st.spinwins += c->sleepstat.spinwins;
+    st.sleeps += c->sleepstat.sleeps;
+    st.spintime += c->sleepstat.spintime;
+  }
+  if(spin == 0 || spin == 1)
+    spinon = spin;
+  if(addr && copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
@@ -3,8 +3,23 @@ struct sleeplock {
   uint locked;       // Is the lock held?
   struct spinlock lk; // spinlock protecting this sleep lock
   
+  struct proc *owner; // Process holding it; spinners watch it run
+
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
 };
 
+
+// Long-term reader/writer lock: any number of readers, or one writer.
+struct rwsleeplock {
+  int readers;       // Number of readers holding it
+  uint writer;       // Is it held by a writer?
+  int wwait;         // Writers waiting; new readers hold off for them
+  struct spinlock lk; // spinlock protecting this sleep lock
+  struct proc *owner; // Writer holding it, if any
+
+  // For debugging:
+  char *name;        // Name of lock.
+  int pid;           // Process holding lock for writing
+};
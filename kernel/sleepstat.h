@@ -0,0 +1,16 @@
+// Sleep-lock statistics, summed over all CPUs and returned by the
+// sleepstat() system call; see user/lockbench.c.
+
+#ifndef _KERNEL_SLEEPSTAT_H
+#define _KERNEL_SLEEPSTAT_H
+
+struct sleepstat {
+  uint64 acquires;    // sleep locks taken, either kind
+  uint64 contended;   // ... that were held when asked for
+  uint64 spins;       // contended, holder running: spun for it
+  uint64 spinwins;    // ... and got it without sleeping
+  uint64 sleeps;      // times a waiter went to sleep
+  uint64 spintime;    // r_time() units spent spinning
+};
+
+#endif // _KERNEL_SLEEPSTAT_H
@@ -0,0 +1,92 @@
+// Deferred interrupt work ("bottom halves").
+//
+// A device's interrupt handler does only what can't wait with
+// interrupts off -- acknowledge the device, take input it would
+// otherwise lose -- and calls raisesoftirq() for the rest.  The
+// rest runs on the same CPU as the trap returns, in softirq(), with
+// interrupts on, so a burst of completions or console input no
+// longer holds off the timer and the other devices.
+//
+// A CPU's pending bits are only touched by that CPU with interrupts
+// off.  While a CPU is running deferred work it neither starts it
+// again from a nested interrupt nor yields from a timer interrupt
+// (see kerneltrap()), so the work finishes on the CPU it was raised
+// on and the kernel stack nests at most one trap deep.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "defs.h"
+#include "softirq.h"
+
+static void (*handlers[NSOFTIRQ])(void) = {
+[SOFTIRQ_UART]  uartsoftintr,
+[SOFTIRQ_DISK]  virtio_disk_softintr,
+};
+
+// if 0, run the work at once, in the interrupt handler, as
+// before there were softirqs.  for comparing; see irqstat().
+static int defer = 1;
+
+// queue deferred work of kind n on this CPU.  called by interrupt
+// handlers, with interrupts off.
+void
+raisesoftirq(int n)
+{
+  if(!defer){
+    handlers[n]();
+    return;
+  }
+  mycpu()->softpending |= 1 << n;
+}
+
+// run this CPU's deferred work, with interrupts on.  called with
+// interrupts off as a trap returns; returns with them off.
+void
+softirq(void)
+{
+  struct cpu *c = mycpu();
+  uint pending;
+  uint64 t0;
+
+  if(c->insoftirq || c->softpending == 0)
+    return;
+  c->insoftirq = 1;
+  while((pending = c->softpending) != 0){
+    c->softpending = 0;
+    t0 = r_time();
+    intr_on();
+    for(int n = 0; n < NSOFTIRQ; n++)
+      if(pending & (1 << n))
+        handlers[n]();
+    intr_off();
+    c->nsoft++;
+    c->softtime += r_time() - t0;
+  }
+  c->insoftirq = 0;
+}
+
+// the handler and deferred times, summed over CPUs, for irqstat().
+// turn deferring off if on is 0, on if 1; leave it alone if -1.
+void
+softirqstat(struct irqstat *st, int on)
+{
+  struct cpu *c;
+
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    st->hardtime += c->irqtime;
+    if(c->irqmax > st->hardmax)
+      st->hardmax = c->irqmax;
+    // racy, but only loses a maximum.
+    c->irqmax = 0;
+    st->nsoft += c->nsoft;
+    st->softtime += c->softtime;
+  }
+  if(on == 0 || on == 1)
+    defer = on;
+  st->defer = defer;
+}
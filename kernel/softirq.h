@@ -0,0 +1,5 @@
+// Deferred interrupt work, one bit per kind; see softirq.c.
+
+#define SOFTIRQ_UART  0     // console input and output
+#define SOFTIRQ_DISK  1     // virtio completions
+#define NSOFTIRQ      2
@@ -6,13 +6,18 @@
 
 void main();
 void timerinit();
+void ipivec();
+
+// scratch space for ipivec in kernelvec.S, per CPU.
+uint64 ipiscratch[NCPU][2];
 
 // entry.S needs one stack per CPU.
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
-// entry.S jumps here in machine mode on stack0.
+// entry.S jumps here in machine mode on stack0, with the
+// hartid and the device tree's address from qemu.
 void
-start()
+start(uint64 hartid, uint64 fdt)
 {
   // set M Previous Privilege mode to Supervisor, for mret.
   unsigned long x = r_mstatus();
@@ -30,7 +35,7 @@ start()
   // delegate all interrupts and exceptions to supervisor mode.
   w_medeleg(0xffff);
   w_mideleg(0xffff);
-  w_sie(r_sie() | SIE_SEIE | SIE_STIE);
+  w_sie(r_sie() | SIE_SEIE | SIE_STIE | SIE_SSIE);
 
   // configure Physical Memory Protection to give supervisor mode
   // access to all of physical memory.
@@ -40,10 +45,26 @@ start()
   // ask for clock interrupts.
   timerinit();
 
+  // inter-processor interrupts arrive in machine mode;
+  // ipivec forwards them to supervisor mode.
+  w_mscratch((uint64)ipiscratch[r_mhartid()]);
+  w_mtvec((uint64)ipivec);
+  w_mie(r_mie() | MIE_MSIE);
+
+#ifdef RVV
+  // misa is machine-only, so probe for the vector unit here.
+  if(r_misa() & MISA_V)
+    rvv_enabled = 1;
+#endif
+
   // keep each CPU's hartid in its tp register, for cpuid().
   int id = r_mhartid();
   w_tp(id);
 
+  // for fdtinit().
+  if(id == 0)
+    fdtpa = fdt;
+
   // switch to supervisor mode and jump to main().
   asm volatile("mret");
 }
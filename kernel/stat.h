@@ -9,3 +9,9 @@ struct stat {
   short nlink; // Number of links to file
   uint64 size; // Size of file in bytes
 };
+
+// A directory entry and its stat, from dirstat().
+struct dirstat {
+  char name[16];   // NUL-terminated; at most DIRSIZ (14) characters
+  struct stat st;
+};
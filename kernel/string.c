@@ -1,13 +1,89 @@
 #include "types.h"
+#ifdef RVV
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+#endif
+
+// memset/memmove/memcmp move eight bytes per load/store once both
+// pointers agree on their alignment modulo 8; RISC-V does not promise
+// fast misaligned doubleword access, so mismatched pointers and the
+// unaligned head and tail fall back to byte loops.
+
+#define WSIZE  sizeof(uint64)
+#define WMASK  (WSIZE - 1)
+
+#ifdef RVV
+// Set by start() on harts whose misa reports the V extension
+// (qemu -cpu rv64,v=true).  The vector routines live in vecops.S.
+volatile int rvv_enabled;
+
+void vec_memset(void *, int, uint64);
+void vec_memcpy(void *, const void *, uint64);
+void vec_memcpy_back(void *, const void *, uint64);
+int  vec_memcmp(const void *, const void *, uint64);
+
+// Below this size the scalar loops win over vsetvli + csr traffic.
+#define RVV_MIN 256
+
+// The kernel does not save vector registers on swtch() or traps, so
+// vector code runs with interrupts off and sstatus.VS switched on only
+// for its duration.  User space therefore never sees VS enabled.
+static inline void
+rvv_begin(void)
+{
+  push_off();
+  w_sstatus(r_sstatus() | SSTATUS_VS_INITIAL);
+}
+
+static inline void
+rvv_end(void)
+{
+  w_sstatus(r_sstatus() & ~SSTATUS_VS);
+  pop_off();
+}
+#endif
 
 void*
 memset(void *dst, int c, uint n)
 {
-  char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uchar *d = (uchar *) dst;
+  uint64 w, *wd;
+
+#ifdef RVV
+  if(rvv_enabled && n >= RVV_MIN){
+    rvv_begin();
+    vec_memset(dst, c, n);
+    rvv_end();
+    return dst;
+  }
+#endif
+
+  // byte head up to the first aligned word.
+  while(n > 0 && ((uint64)d & WMASK)){
+    *d++ = c;
+    n--;
   }
+
+  w = (uchar)c;
+  w |= w << 8;
+  w |= w << 16;
+  w |= w << 32;
+
+  wd = (uint64 *) d;
+  for(; n >= 4*WSIZE; n -= 4*WSIZE, wd += 4){
+    wd[0] = w;
+    wd[1] = w;
+    wd[2] = w;
+    wd[3] = w;
+  }
+  for(; n >= WSIZE; n -= WSIZE)
+    *wd++ = w;
+
+  d = (uchar *) wd;
+  while(n-- > 0)
+    *d++ = c;
   return dst;
 }
 
@@ -18,6 +94,32 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+
+#ifdef RVV
+  if(rvv_enabled && n >= RVV_MIN){
+    int r;
+    rvv_begin();
+    r = vec_memcmp(v1, v2, n);
+    rvv_end();
+    return r;
+  }
+#endif
+
+  if((((uint64)s1 ^ (uint64)s2) & WMASK) == 0){
+    while(n > 0 && ((uint64)s1 & WMASK)){
+      if(*s1 != *s2)
+        return *s1 - *s2;
+      s1++, s2++, n--;
+    }
+    // skip equal words; the byte loop below finds the
+    // differing byte inside the first word that mismatches.
+    while(n >= WSIZE && *(uint64 *)s1 == *(uint64 *)s2){
+      s1 += WSIZE;
+      s2 += WSIZE;
+      n -= WSIZE;
+    }
+  }
+
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -27,18 +129,99 @@ memcmp(const void *v1, const void *v2, uint n)
   return 0;
 }
 
+// copy n bytes upwards.  dst and src share alignment modulo 8.
+static void
+copy_fwd_words(uchar *d, const uchar *s, uint n)
+{
+  uint64 *wd;
+  const uint64 *ws;
+
+  while(n > 0 && ((uint64)d & WMASK)){
+    *d++ = *s++;
+    n--;
+  }
+  wd = (uint64 *) d;
+  ws = (const uint64 *) s;
+  for(; n >= 4*WSIZE; n -= 4*WSIZE, wd += 4, ws += 4){
+    uint64 a = ws[0], b = ws[1], c = ws[2], e = ws[3];
+    wd[0] = a;
+    wd[1] = b;
+    wd[2] = c;
+    wd[3] = e;
+  }
+  for(; n >= WSIZE; n -= WSIZE)
+    *wd++ = *ws++;
+  d = (uchar *) wd;
+  s = (const uchar *) ws;
+  while(n-- > 0)
+    *d++ = *s++;
+}
+
+// copy n bytes downwards, starting just below d+n and s+n.
+// dst and src share alignment modulo 8.
+static void
+copy_back_words(uchar *d, const uchar *s, uint n)
+{
+  uint64 *wd;
+  const uint64 *ws;
+
+  d += n;
+  s += n;
+  while(n > 0 && ((uint64)d & WMASK)){
+    *--d = *--s;
+    n--;
+  }
+  wd = (uint64 *) d;
+  ws = (const uint64 *) s;
+  for(; n >= 4*WSIZE; n -= 4*WSIZE){
+    wd -= 4;
+    ws -= 4;
+    uint64 a = ws[3], b = ws[2], c = ws[1], e = ws[0];
+    wd[3] = a;
+    wd[2] = b;
+    wd[1] = c;
+    wd[0] = e;
+  }
+  for(; n >= WSIZE; n -= WSIZE)
+    *--wd = *--ws;
+  d = (uchar *) wd;
+  s = (const uchar *) ws;
+  while(n-- > 0)
+    *--d = *--s;
+}
+
 void*
 memmove(void *dst, const void *src, uint n)
 {
-  const char *s;
-  char *d;
+  const uchar *s;
+  uchar *d;
+  int back;
 
-  if(n == 0)
+  if(n == 0 || dst == src)
     return dst;
   
   s = src;
   d = dst;
-  if(s < d && s + n > d){
+  back = (s < d && s + n > d);
+
+#ifdef RVV
+  if(rvv_enabled && n >= RVV_MIN){
+    rvv_begin();
+    if(back)
+      vec_memcpy_back(dst, src, n);
+    else
+      vec_memcpy(dst, src, n);
+    rvv_end();
+    return dst;
+  }
+#endif
+
+  if((((uint64)s ^ (uint64)d) & WMASK) == 0){
+    if(back)
+      copy_back_words(d, s, n);
+    else
+      copy_fwd_words(d, s, n);
+  } else if(back){
     s += n;
     d += n;
     while(n-- > 0)
@@ -3,16 +3,18 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "syscall.h"
 #include "defs.h"
+#include "trace.h"
 
 // Fetch the uint64 at addr from the current process.
 int
 fetchaddr(uint64 addr, uint64 *ip)
 {
   struct proc *p = myproc();
-  if(addr >= p->sz || addr+sizeof(uint64) > p->sz) // both tests needed, in case of overflow
+  if(addr >= p->vm->sz || addr+sizeof(uint64) > p->vm->sz) // both tests needed, in case of overflow
     return -1;
   if(copyin(p->pagetable, (char *)ip, addr, sizeof(*ip)) != 0)
     return -1;
@@ -113,6 +115,24 @@ extern uint64 sys_kmalloc(void);
 extern uint64 sys_kfree(void);
 extern uint64 sys_slab_write(void);
 extern uint64 sys_slab_read(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_join(void);
+extern uint64 sys_futex_wait(void);
+extern uint64 sys_futex_wake(void);
+extern uint64 sys_atrace(void);
+extern uint64 sys_ktrace(void);
+extern uint64 sys_slabstat(void);
+extern uint64 sys_buddystat(void);
+extern uint64 sys_getrusage(void);
+extern uint64 sys_procstat(void);
+extern uint64 sys_dmesg(void);
+extern uint64 sys_fdlimit(void);
+extern uint64 sys_sleepstat(void);
+extern uint64 sys_getdents(void);
+extern uint64 sys_dirstat(void);
+extern uint64 sys_irqaffinity(void);
+extern uint64 sys_irqstat(void);
+extern uint64 sys_workstat(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -150,6 +170,24 @@ static uint64 (*syscalls[])(void) = {
 [SYS_kfree]             sys_kfree,
 [SYS_slab_write]        sys_slab_write,
 [SYS_slab_read]         sys_slab_read,
+[SYS_clone]             sys_clone,
+[SYS_join]              sys_join,
+[SYS_futex_wait]        sys_futex_wait,
+[SYS_futex_wake]        sys_futex_wake,
+[SYS_atrace]            sys_atrace,
+[SYS_ktrace]            sys_ktrace,
+[SYS_slabstat]          sys_slabstat,
+[SYS_buddystat]         sys_buddystat,
+[SYS_getrusage]         sys_getrusage,
+[SYS_procstat]          sys_procstat,
+[SYS_dmesg]             sys_dmesg,
+[SYS_fdlimit]           sys_fdlimit,
+[SYS_sleepstat]         sys_sleepstat,
+[SYS_getdents]          sys_getdents,
+[SYS_dirstat]           sys_dirstat,
+[SYS_irqaffinity]       sys_irqaffinity,
+[SYS_irqstat]           sys_irqstat,
+[SYS_workstat]          sys_workstat,
 };
 
 void
@@ -162,7 +200,10 @@ syscall(void)
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     // Use num to lookup the system call function for num, call it,
     // and store its return value in p->trapframe->a0
+    p->ru.nsyscall++;
+    TRACE(TC_SYSCALL, TE_SYS_ENTER, num, 0);
     p->trapframe->a0 = syscalls[num]();
+    TRACE(TC_SYSCALL, TE_SYS_EXIT, num, p->trapframe->a0);
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
@@ -32,3 +32,21 @@
 #define SYS_kfree             31
 #define SYS_slab_write        32
 #define SYS_slab_read         33
+#define SYS_clone             34
+#define SYS_join              35
+#define SYS_futex_wait        36
+#define SYS_futex_wake        37
+#define SYS_atrace            38
+#define SYS_ktrace            39
+#define SYS_slabstat          40
+#define SYS_buddystat         41
+#define SYS_getrusage         42
+#define SYS_procstat          43
+#define SYS_dmesg             44
+#define SYS_fdlimit           45
+#define SYS_sleepstat         46
+#define SYS_getdents          47
+#define SYS_dirstat           48
+#define SYS_irqaffinity       49
+#define SYS_irqstat           50
+#define SYS_workstat          51
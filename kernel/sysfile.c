@@ -10,45 +10,36 @@
 #include "param.h"
 #include "stat.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "fs.h"
-#include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
-// and return both the descriptor and the corresponding struct file.
+// and return the corresponding struct file, with a reference the
+// caller must drop with fileclose(), so that another thread closing
+// the descriptor can't free the file out from under it.
 static int
-argfd(int n, int *pfd, struct file **pf)
+argfd(int n, struct file **pf)
 {
   int fd;
   struct file *f;
 
   argint(n, &fd);
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f = fdget(myproc()->files, fd)) == 0)
     return -1;
-  if(pfd)
-    *pfd = fd;
-  if(pf)
-    *pf = f;
+  *pf = f;
   return 0;
 }
 
 // Allocate a file descriptor for the given file.
 // Takes over file reference from caller on success.
+// With f == 0, only takes the descriptor; see fdset().
 static int
 fdalloc(struct file *f)
 {
-  int fd;
-  struct proc *p = myproc();
-
-  for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
-      return fd;
-    }
-  }
-  return -1;
+  return fdinstall(myproc()->files, f);
 }
 
 uint64
@@ -57,11 +48,12 @@ sys_dup(void)
   struct file *f;
   int fd;
 
-  if(argfd(0, 0, &f) < 0)
+  if(argfd(0, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
+  if((fd=fdalloc(f)) < 0){
+    fileclose(f);
     return -1;
-  filedup(f);
+  }
   return fd;
 }
 
@@ -71,12 +63,15 @@ sys_read(void)
   struct file *f;
   int n;
   uint64 p;
+  int r;
 
   argaddr(1, &p);
   argint(2, &n);
-  if(argfd(0, 0, &f) < 0)
+  if(argfd(0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  r = fileread(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 uint64
@@ -85,13 +80,15 @@ sys_write(void)
   struct file *f;
   int n;
   uint64 p;
-  
+  int r;
+
   argaddr(1, &p);
   argint(2, &n);
-  if(argfd(0, 0, &f) < 0)
+  if(argfd(0, &f) < 0)
     return -1;
-
-  return filewrite(f, p, n);
+  r = filewrite(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 uint64
@@ -100,9 +97,9 @@ sys_close(void)
   int fd;
   struct file *f;
 
-  if(argfd(0, &fd, &f) < 0)
+  argint(0, &fd);
+  if((f = fdremove(myproc()->files, fd)) == 0)
     return -1;
-  myproc()->ofile[fd] = 0;
   fileclose(f);
   return 0;
 }
@@ -112,11 +109,61 @@ sys_fstat(void)
 {
   struct file *f;
   uint64 st; // user pointer to struct stat
+  int r;
 
   argaddr(1, &st);
-  if(argfd(0, 0, &f) < 0)
+  if(argfd(0, &f) < 0)
     return -1;
-  return filestat(f, st);
+  r = filestat(f, st);
+  fileclose(f);
+  return r;
+}
+
+// Read up to n entries of a directory, from its offset, as
+// dirents, skipping empty ones.  Returns how many, 0 at the end.
+uint64
+sys_getdents(void)
+{
+  struct file *f;
+  uint64 p;
+  int n, r;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  if(argfd(0, &f) < 0)
+    return -1;
+  r = filedirents(f, p, n, 0);
+  fileclose(f);
+  return r;
+}
+
+// Like getdents, but returns each name with its stat, as struct
+// dirstats, saving ls an open, fstat and close per entry.
+uint64
+sys_dirstat(void)
+{
+  struct file *f;
+  uint64 p;
+  int n, r;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  if(argfd(0, &f) < 0)
+    return -1;
+  r = filedirents(f, p, n, 1);
+  fileclose(f);
+  return r;
+}
+
+// Set the most file descriptors this process may have open, or
+// with 0, just return the limit.  Returns the old limit.
+uint64
+sys_fdlimit(void)
+{
+  int n;
+
+  argint(0, &n);
+  return fdlimit(myproc()->files, n);
 }
 
 // Create the path new as a link to the same inode as old.
@@ -170,16 +217,17 @@ bad:
 }
 
 // Is the directory dp empty except for "." and ".." ?
+// (In a hashed directory they can be anywhere.)
 static int
 isdirempty(struct inode *dp)
 {
   int off;
   struct dirent de;
 
-  for(off=2*sizeof(de); off<dp->size; off+=sizeof(de)){
+  for(off=0; off<dp->size; off+=sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("isdirempty: readi");
-    if(de.inum != 0)
+    if(de.inum != 0 && namecmp(de.name, ".") != 0 && namecmp(de.name, "..") != 0)
       return 0;
   }
   return 1;
@@ -210,6 +258,10 @@ sys_unlink(void)
 
   if((ip = dirlookup(dp, name, &off)) == 0)
     goto bad;
+  if(ismount(ip)){
+    iput(ip);
+    goto bad;
+  }
   ilock(ip);
 
   if(ip->nlink < 1)
@@ -242,7 +294,10 @@ bad:
   return -1;
 }
 
-static struct inode*
+// Make a file or directory at path, and return it locked.  If path
+// is a file already and type is T_FILE, return that.  Must be
+// called inside a transaction.
+struct inode*
 create(char *path, short type, short major, short minor)
 {
   struct inode *ip, *dp;
@@ -341,9 +396,10 @@ sys_open(void)
     return -1;
   }
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
-    if(f)
-      fileclose(f);
+  // take the descriptor now, but fill it in only once f is ready.
+  if((fd = fdalloc(0)) < 0 || (f = filealloc()) == 0){
+    if(fd >= 0)
+      fdrelease(myproc()->files, fd);
     iunlockput(ip);
     end_op();
     return -1;
@@ -367,6 +423,7 @@ sys_open(void)
   iunlock(ip);
   end_op();
 
+  fdset(myproc()->files, fd, f);
   return fd;
 }
 
@@ -410,8 +467,8 @@ uint64
 sys_chdir(void)
 {
   char path[MAXPATH];
-  struct inode *ip;
-  struct proc *p = myproc();
+  struct inode *ip, *old;
+  struct files *fs = myproc()->files;
   
   begin_op();
   if(argstr(0, path, MAXPATH) < 0 || (ip = namei(path)) == 0){
@@ -425,9 +482,12 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(p->cwd);
+  acquire(&fs->lock);
+  old = fs->cwd;
+  fs->cwd = ip;
+  release(&fs->lock);
+  iput(old);
   end_op();
-  p->cwd = ip;
   return 0;
 }
 
@@ -485,21 +545,21 @@ sys_pipe(void)
   argaddr(0, &fdarray);
   if(pipealloc(&rf, &wf) < 0)
     return -1;
-  fd0 = -1;
-  if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
-    if(fd0 >= 0)
-      p->ofile[fd0] = 0;
-    fileclose(rf);
-    fileclose(wf);
-    return -1;
-  }
-  if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
+  // take both descriptors, and fill them in only once nothing
+  // can fail, so another thread never sees one end alone.
+  fd0 = fd1 = -1;
+  if((fd0 = fdalloc(0)) < 0 || (fd1 = fdalloc(0)) < 0 ||
+     copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
+    if(fd0 >= 0)
+      fdrelease(p->files, fd0);
+    if(fd1 >= 0)
+      fdrelease(p->files, fd1);
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
+  fdset(p->files, fd0, rf);
+  fdset(p->files, fd1, wf);
   return 0;
 }
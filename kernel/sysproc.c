@@ -4,6 +4,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "vm.h"
 
@@ -36,6 +37,101 @@ sys_wait(void)
   return kwait(p);
 }
 
+uint64
+sys_getrusage(void)
+{
+  int who;
+  uint64 p;
+
+  argint(0, &who);
+  argaddr(1, &p);
+  return kgetrusage(who, p);
+}
+
+uint64
+sys_procstat(void)
+{
+  uint64 p;
+  int n;
+
+  argaddr(0, &p);
+  argint(1, &n);
+  return kprocstat(p, n);
+}
+
+uint64
+sys_sleepstat(void)
+{
+  uint64 p;
+  int spin;
+
+  argaddr(0, &p);
+  argint(1, &spin);
+  return sleepstats(p, spin);
+}
+
+uint64
+sys_irqaffinity(void)
+{
+  int irq, mask;
+
+  argint(0, &irq);
+  argint(1, &mask);
+  return plicaffinity(irq, mask);
+}
+
+uint64
+sys_irqstat(void)
+{
+  struct irqstat st;
+  uint64 p;
+  int defer;
+
+  argaddr(0, &p);
+  argint(1, &defer);
+  memset(&st, 0, sizeof(st));
+  plicstat(&st);
+  virtio_disk_stat(&st);
+  softirqstat(&st, defer);
+  if(p && copyout(myproc()->pagetable, p, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+uint64
+sys_workstat(void)
+{
+  uint64 p;
+  int n, flush;
+
+  argaddr(0, &p);
+  argint(1, &n);
+  argint(2, &flush);
+  return workstats(p, n, flush);
+}
+
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  argaddr(0, &fn);
+  argaddr(1, &arg);
+  argaddr(2, &stack);
+  return kclone(fn, arg, stack);
+}
+
+uint64
+sys_join(void)
+{
+  int tid;
+  uint64 p;
+
+  argint(0, &tid);
+  argaddr(1, &p);
+  return kjoin(tid, p);
+}
+
 uint64
 sys_sbrk(void)
 {
@@ -43,23 +139,29 @@ sys_sbrk(void)
   int t;
   int n;
 
+  struct vmspace *vm = myproc()->vm;
+
   argint(0, &n);
   argint(1, &t);
-  addr = myproc()->sz;
 
   if(t == SBRK_EAGER || n < 0) {
-    if(growproc(n) < 0) {
+    if(growproc(n, &addr) < 0) {
       return -1;
     }
   } else {
     // Lazily allocate memory for this process: increase its memory
     // size but don't allocate memory. If the processes uses the
     // memory, vmfault() will allocate it.
-    if(addr + n < addr)
-      return -1;
-    if(addr + n > TRAPFRAME)
+    acquiresleep(&vm->mmlock);
+    addr = vm->sz;
+    if(addr + n < addr || addr + n > MAXUSER){
+      releasesleep(&vm->mmlock);
       return -1;
-    myproc()->sz += n;
+    }
+    acquire(&vm->lock);
+    vm->sz += n;
+    release(&vm->lock);
+    releasesleep(&vm->mmlock);
   }
   return addr;
 }
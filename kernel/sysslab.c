@@ -8,16 +8,18 @@
 #include "param.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "defs.h"
 #include "slab.h"
+#include "slabstat.h"
 #include "memlayout.h"
 
 #ifndef SLAB_KERNEL
 // Deo 1: reserve a contiguous region for slab's buddy.
-// We take the top 32 MB of physical memory (8192 pages).
-#define SLAB_TEST_BLOCKS   8192
-#define SLAB_TEST_SIZE     ((uint64)SLAB_TEST_BLOCKS * 4096)
+// We take the top quarter of physical memory, as kalloc.c leaves it.
+#define SLAB_TEST_SIZE     SLABRESERVE
+#define SLAB_TEST_BLOCKS   ((int)(SLAB_TEST_SIZE / 4096))
 #define SLAB_TEST_START    ((void *)(PHYSTOP - SLAB_TEST_SIZE))
 #endif
 
@@ -265,3 +267,45 @@ sys_slab_read(void)
         return -1;
     return 0;
 }
+
+// ---------- statistics ----------
+
+// slabstat(buf, n): a struct slabstat for each of up to n caches;
+// returns how many.  Copied out a few at a time, since copyout
+// can't run under the slab locks; a cache created or destroyed
+// meanwhile may be missed or seen twice.
+uint64
+sys_slabstat(void)
+{
+    struct slabstat st[4];
+    uint64 buf;
+    int n, k, done = 0;
+
+    argaddr(0, &buf);
+    argint(1, &n);
+    struct proc *p = myproc();
+    while (done < n) {
+        k = kmem_cache_stats(done, st, n - done < NELEM(st) ? n - done : NELEM(st));
+        if (k == 0)
+            break;
+        if (copyout(p->pagetable, buf + done * sizeof(st[0]),
+                    (char *)st, k * sizeof(st[0])) < 0)
+            return -1;
+        done += k;
+    }
+    return done;
+}
+
+// buddystat(buf): free blocks of each order where slab pages come from.
+uint64
+sys_buddystat(void)
+{
+    struct buddystat st;
+    uint64 buf;
+
+    argaddr(0, &buf);
+    slab_pages_stat(&st);
+    if (copyout(myproc()->pagetable, buf, (char *)&st, sizeof(st)) < 0)
+        return -1;
+    return 0;
+}
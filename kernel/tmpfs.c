@@ -0,0 +1,328 @@
+// RAM file system, mounted on /tmp.
+//
+// A tmpfs inode is a struct tmpnode, found from its inode number
+// through a two-level table, and its content is whole pages: the
+// first NDIRECT through node->direct[], the rest through a page of
+// pointers, node->indirect.  Directories hold struct dirents, as
+// on the disk, so dirlink() and the rest of fs.c work unchanged.
+// Nothing is logged or written to the disk, so creating, writing
+// and removing files here costs no disk I/O.
+//
+// The generic inode code in fs.c calls the functions here through
+// tmpfsops, always with the in-memory inode locked, and there is
+// only ever one in-memory inode for a node, so that lock protects
+// the node too.  tmp.lock protects the table and the free list.
+//
+// Nodes are kept on a free list when their file is removed, with
+// their inode number, and never freed, so the table only grows.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#ifdef SLAB_KERNEL
+#include "slab.h"
+#endif
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+#define NPTR        (PGSIZE / sizeof(void*))    // pointers in a page
+#define TMPMAXFILE  (NDIRECT + NPTR)            // pages in a file
+#define TMPNINODE   65536                       // dirent.inum is a ushort
+
+struct tmpnode {
+  short type;
+  short major;
+  short minor;
+  short nlink;
+  uint size;
+  uint inum;
+  char *direct[NDIRECT];
+  char **indirect;
+  struct tmpnode *freenext;
+};
+
+static struct {
+  struct spinlock lock;
+  struct tmpnode **table[TMPNINODE / NPTR];   // by inode number
+  uint ninum;                                 // numbers handed out
+  struct tmpnode *free;
+} tmp;
+
+#ifdef SLAB_KERNEL
+static kmem_cache_t *tmpnode_cache;
+#endif
+
+static struct fsops tmpfsops;
+
+static struct tmpnode*
+node(uint inum)
+{
+  struct tmpnode **t;
+
+  acquire(&tmp.lock);
+  t = inum < tmp.ninum ? tmp.table[inum / NPTR] : 0;
+  release(&tmp.lock);
+  if(t == 0 || t[inum % NPTR] == 0)
+    panic("tmpfs: bad inum");
+  return t[inum % NPTR];
+}
+
+// Put more nodes on the free list, each with the next inode
+// number.  Caller holds tmp.lock.
+static void
+morenodes(void)
+{
+  struct tmpnode *n;
+  int i, k;
+
+#ifdef SLAB_KERNEL
+  n = (struct tmpnode*)kmem_cache_alloc(tmpnode_cache);
+  k = 1;
+#else
+  // kalloc() hands out whole pages; use all of it.
+  n = (struct tmpnode*)kalloc();
+  k = PGSIZE / sizeof(*n);
+#endif
+  if(n == 0)
+    return;
+  memset(n, 0, k * sizeof(*n));
+  for(i = 0; i < k && tmp.ninum < TMPNINODE; i++){
+    if(tmp.ninum % NPTR == 0){
+      if((tmp.table[tmp.ninum / NPTR] = (struct tmpnode**)kalloc()) == 0)
+        break;
+      memset(tmp.table[tmp.ninum / NPTR], 0, PGSIZE);
+    }
+    n[i].inum = tmp.ninum++;
+    tmp.table[n[i].inum / NPTR][n[i].inum % NPTR] = &n[i];
+  }
+  // lowest number on top.  what's left over (when out of numbers
+  // or memory) is lost.
+  while(--i >= 0){
+    n[i].freenext = tmp.free;
+    tmp.free = &n[i];
+  }
+}
+
+// A node with no content, or 0 if out of memory or numbers.
+static struct tmpnode*
+nodealloc(short type)
+{
+  struct tmpnode *n;
+
+  acquire(&tmp.lock);
+  if(tmp.free == 0)
+    morenodes();
+  if((n = tmp.free) != 0){
+    tmp.free = n->freenext;
+    n->type = type;
+  }
+  release(&tmp.lock);
+  return n;
+}
+
+static struct inode*
+tmpialloc(uint dev, short type)
+{
+  struct tmpnode *n;
+
+  if((n = nodealloc(type)) == 0){
+    printf("tmpfs: out of memory\n");
+    return 0;
+  }
+  return iget(dev, n->inum);
+}
+
+static void
+tmpiload(struct inode *ip)
+{
+  struct tmpnode *n = node(ip->inum);
+
+  ip->type = n->type;
+  ip->major = n->major;
+  ip->minor = n->minor;
+  ip->nlink = n->nlink;
+  ip->size = n->size;
+}
+
+static void
+tmpiupdate(struct inode *ip)
+{
+  struct tmpnode *n = node(ip->inum);
+
+  n->type = ip->type;
+  n->major = ip->major;
+  n->minor = ip->minor;
+  n->nlink = ip->nlink;
+  n->size = ip->size;
+  if(n->type == 0){
+    // iput() has truncated it; it's gone.
+    acquire(&tmp.lock);
+    n->freenext = tmp.free;
+    tmp.free = n;
+    release(&tmp.lock);
+  }
+}
+
+// Address of page bn of n's content; if alloc, allocate it (and
+// the indirect page) if it isn't there.  Returns 0 if there's no
+// such page or no memory.
+static char*
+pmap(struct tmpnode *n, uint bn, int alloc)
+{
+  char **pp;
+
+  if(bn < NDIRECT){
+    pp = &n->direct[bn];
+  } else {
+    bn -= NDIRECT;
+    if(n->indirect == 0){
+      if(!alloc || (n->indirect = (char**)kalloc()) == 0)
+        return 0;
+      memset(n->indirect, 0, PGSIZE);
+    }
+    pp = &n->indirect[bn];
+  }
+  if(*pp == 0 && alloc && (*pp = kalloc()) != 0)
+    memset(*pp, 0, PGSIZE);
+  return *pp;
+}
+
+static void
+tmpitrunc(struct inode *ip)
+{
+  struct tmpnode *n = node(ip->inum);
+  int i;
+
+  for(i = 0; i < NDIRECT; i++){
+    if(n->direct[i]){
+      pgfree(n->direct[i]);
+      n->direct[i] = 0;
+    }
+  }
+  if(n->indirect){
+    for(i = 0; i < NPTR; i++)
+      if(n->indirect[i])
+        pgfree(n->indirect[i]);
+    pgfree((char*)n->indirect);
+    n->indirect = 0;
+  }
+  ip->size = 0;
+  tmpiupdate(ip);
+}
+
+static int
+tmpreadi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
+{
+  struct tmpnode *np = node(ip->inum);
+  uint tot, m;
+  char *pg;
+
+  if(off > ip->size || off + n < off)
+    return 0;
+  if(off + n > ip->size)
+    n = ip->size - off;
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    if((pg = pmap(np, off/PGSIZE, 0)) == 0)
+      break;
+    if(either_copyout(user_dst, dst, pg + off%PGSIZE, m) == -1)
+      return -1;
+  }
+  return tot;
+}
+
+static int
+tmpwritei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
+{
+  struct tmpnode *np = node(ip->inum);
+  uint tot, m;
+  char *pg;
+
+  if(off > ip->size || off + n < off)
+    return -1;
+  if(off + n > TMPMAXFILE*PGSIZE)
+    return -1;
+
+  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    if((pg = pmap(np, off/PGSIZE, 1)) == 0)
+      break;
+    if(either_copyin(pg + off%PGSIZE, user_src, src, m) == -1)
+      break;
+  }
+
+  if(off > ip->size)
+    ip->size = off;
+  np->size = ip->size;
+
+  return tot;
+}
+
+// Like the disk's, but looks at the entries in place instead of
+// copying each one out with readi().
+static struct inode*
+tmpdirlookup(struct inode *dp, char *name, uint off, uint end, uint *poff)
+{
+  struct tmpnode *n = node(dp->inum);
+  struct dirent *de;
+  char *pg;
+
+  for(; off < end; off += sizeof(*de)){
+    if((pg = pmap(n, off/PGSIZE, 0)) == 0)
+      panic("tmpdirlookup");
+    de = (struct dirent*)(pg + off%PGSIZE);
+    if(de->inum != 0 && namecmp(name, de->name) == 0){
+      if(poff)
+        *poff = off;
+      return iget(dp->dev, de->inum);
+    }
+  }
+  return 0;
+}
+
+static struct fsops tmpfsops = {
+  .ialloc = tmpialloc,
+  .iload = tmpiload,
+  .iupdate = tmpiupdate,
+  .itrunc = tmpitrunc,
+  .readi = tmpreadi,
+  .writei = tmpwritei,
+  .dirlookup = tmpdirlookup,
+};
+
+// Make an empty tmpfs and mount it on /tmp.  Called once, from the
+// first process, after the disk's file system is up.
+void
+tmpfsinit(void)
+{
+  struct tmpnode *n;
+  struct inode *ip;
+
+  initlock(&tmp.lock, "tmpfs");
+#ifdef SLAB_KERNEL
+  tmpnode_cache = kmem_cache_create("tmpnode", sizeof(struct tmpnode), 0, 0);
+  if(!tmpnode_cache)
+    panic("tmpfsinit: cache create");
+#endif
+  // inode 0 means an empty dirent, so waste it; the root is 1.
+  if(nodealloc(0) == 0 || (n = nodealloc(T_DIR)) == 0 || n->inum != ROOTINO)
+    panic("tmpfsinit");
+  n->nlink = 1;
+
+  if(mount("/tmp", TMPDEV, &tmpfsops) < 0){
+    printf("tmpfs: can't mount on /tmp\n");
+    return;
+  }
+  ip = iget(TMPDEV, ROOTINO);
+  ilock(ip);
+  if(dirlink(ip, ".", ROOTINO) < 0 || dirlink(ip, "..", ROOTINO) < 0)
+    panic("tmpfsinit: dirlink");
+  iunlockput(ip);
+}
@@ -0,0 +1,129 @@
+//
+// Static tracepoints.
+//
+// TRACE(cat, ev, a, b) in kernel/trace.h tests trace_mask and only
+// calls trace_emit() when cat is enabled.  Each CPU appends records
+// to its own ring with interrupts off, so a ring has one producer
+// and needs no lock on the write side: the producer owns head, the
+// reader owns tail, and each publishes its index with a release
+// store after it is done with the slot.  Readers of one ring are
+// serialized by a spinlock the producer never touches.  A full
+// ring drops the new record and counts it.
+//
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "defs.h"
+#include "trace.h"
+
+#define NTRACE 2048   // records per CPU; a power of two
+
+volatile uint trace_mask;
+
+static struct tracering {
+  struct spinlock lock;   // serializes readers
+  uint head;              // next to write; written by the owning CPU
+  uint tail;              // next to read; written under lock
+  uint dropped;
+  struct tracerec rec[NTRACE];
+} rings[NCPU];
+
+void
+traceinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&rings[i].lock, "trace");
+}
+
+void
+trace_emit(int ev, uint64 a, uint64 b)
+{
+  struct tracering *r;
+  struct tracerec *t;
+  struct proc *p;
+  uint head;
+  int c;
+
+  push_off();
+  c = cpuid();
+  r = &rings[c];
+  head = r->head;
+  if(head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == NTRACE){
+    r->dropped++;
+  } else {
+    p = mycpu()->proc;
+    t = &r->rec[head % NTRACE];
+    t->ts = r_time();
+    t->pid = p ? p->pid : 0;
+    t->ev = ev;
+    t->cpu = c;
+    t->a = a;
+    t->b = b;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+  }
+  pop_off();
+}
+
+// copy up to n records from CPU c's ring to user address dst;
+// returns how many.
+static int
+traceread(int c, uint64 dst, int n)
+{
+  struct tracering *r = &rings[c];
+  struct tracerec buf[16];
+  int k, done = 0;
+  uint tail, head;
+
+  while(done < n){
+    acquire(&r->lock);
+    tail = r->tail;
+    head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    for(k = 0; k < NELEM(buf) && done + k < n && tail != head; k++)
+      buf[k] = r->rec[tail++ % NTRACE];
+    __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    release(&r->lock);
+    if(k == 0)
+      break;
+    // copyout may fault and sleep, so the lock isn't held here.
+    if(copyout(myproc()->pagetable, dst + done*sizeof(struct tracerec),
+               (char*)buf, k*sizeof(struct tracerec)) < 0)
+      return -1;
+    done += k;
+  }
+  return done;
+}
+
+uint64
+sys_ktrace(void)
+{
+  int cmd, arg, n;
+  uint64 buf;
+  uint old;
+
+  argint(0, &cmd);
+  argint(1, &arg);
+  argaddr(2, &buf);
+  argint(3, &n);
+
+  switch(cmd){
+  case KTRACE_ENABLE:
+    old = trace_mask;
+    trace_mask = arg & TC_ALL;
+    return old;
+  case KTRACE_READ:
+    if(arg < 0 || arg >= NCPU)
+      return -1;
+    if((n = traceread(arg, buf, n)) == 0 && trace_mask == 0)
+      return -1;
+    return n;
+  case KTRACE_DROPPED:
+    if(arg < 0 || arg >= NCPU)
+      return -1;
+    return rings[arg].dropped;
+  }
+  return -1;
+}
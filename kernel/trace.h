@@ -0,0 +1,45 @@
+// Static tracepoints: event records written by kernel/trace.c and
+// read back with the ktrace() system call.
+
+// categories, for ktrace(KTRACE_ENABLE, mask)
+#define TC_SCHED    (1 << 0)  // context switches
+#define TC_WAKEUP   (1 << 1)
+#define TC_FAULT    (1 << 2)  // page faults
+#define TC_BIO      (1 << 3)  // buffer cache lookups
+#define TC_VIRTIO   (1 << 4)  // disk requests
+#define TC_SYSCALL  (1 << 5)
+#define TC_ALL      0x3f
+
+// events; a and b are per event.
+#define TE_SWITCH_IN   1   // a: pid now running
+#define TE_SWITCH_OUT  2   // a: pid that stopped, b: its state
+#define TE_WAKEUP      3   // a: pid made runnable, b: chan
+#define TE_FAULT       4   // a: va, b: 1 if a read
+#define TE_BGET        5   // a: blockno, b: 1 if cached
+#define TE_DISK_SUBMIT 6   // a: blockno, b: descriptor << 1 | write
+#define TE_DISK_DONE   7   // a: blockno, b: descriptor << 1
+#define TE_SYS_ENTER   8   // a: syscall number
+#define TE_SYS_EXIT    9   // a: syscall number, b: return value
+#define TE_NEVENT      10
+
+struct tracerec {
+  uint64 ts;      // r_time()
+  uint pid;       // current process, 0 if none
+  uchar ev;
+  uchar cpu;
+  ushort pad;
+  uint64 a;
+  uint64 b;
+};
+
+// ktrace() commands
+#define KTRACE_ENABLE   0   // set the category mask; returns the old one
+#define KTRACE_READ     1   // move up to n records of CPU cpu into buf
+#define KTRACE_DROPPED  2   // records CPU cpu lost to a full ring
+
+// a tracepoint.  while cat is off this is one load and a branch
+// predicted not taken; trace_mask and trace_emit are in defs.h.
+#define TRACE(cat, ev, a, b) do {                           \
+    if(__builtin_expect(trace_mask & (cat), 0))            \
+      trace_emit((ev), (uint64)(a), (uint64)(b));          \
+  } while(0)
@@ -3,8 +3,10 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "defs.h"
+#include "workqueue.h"
 #ifdef SLAB_KERNEL
 #include "slab.h"
 #endif
@@ -16,6 +18,11 @@ struct spinlock tickslock;
 #endif
 uint ticks;
 
+// every REAPTICKS, hart 0's worker gives back the empty slabs of
+// caches that haven't grown meanwhile.
+#define REAPTICKS 50    // about five seconds
+static struct work reapwork;
+
 extern char trampoline[], uservec[];
 
 // in kernelvec.S, calls kerneltrap().
@@ -23,6 +30,12 @@ void kernelvec();
 
 extern int devintr();
 
+static void
+slabreap(void *arg)
+{
+  kmem_cache_reap();
+}
+
 void
 trapinit(void)
 {
@@ -33,6 +46,7 @@ trapinit(void)
   memset(tickslock_ptr, 0, sizeof(struct spinlock));
 #endif
   initlock(&tickslock, "time");
+  workinit(&reapwork, slabreap, 0);
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -60,6 +74,14 @@ usertrap(void)
   w_stvec((uint64)kernelvec);  //DOC: kernelvec
 
   struct proc *p = myproc();
+
+  // charge the time since prepare_return() to user space.
+  uint64 now = r_time();
+  p->ru.utime += now - p->lastts;
+  p->lastts = now;
+
+  // this CPU no longer runs p's user address space.
+  uvmleave(p);
   
   // save user program counter.
   p->trapframe->epc = r_sepc();
@@ -80,7 +102,8 @@ usertrap(void)
 
     syscall();
   } else if((which_dev = devintr()) != 0){
-    // ok
+    // the work the handler deferred.
+    softirq();
   } else if((r_scause() == 15 || r_scause() == 13) &&
             vmfault(p->pagetable, r_stval(), (r_scause() == 13)? 1 : 0) != 0) {
     // page fault on lazily-allocated page
@@ -100,7 +123,7 @@ usertrap(void)
   prepare_return();
 
   // the user page table to switch to, for trampoline.S
-  uint64 satp = MAKE_SATP(p->pagetable);
+  uint64 satp = uvmswitch(p);
 
   // return to trampoline.S; satp value in a0.
   return satp;
@@ -130,6 +153,9 @@ prepare_return(void)
   p->trapframe->kernel_trap = (uint64)usertrap;
   p->trapframe->kernel_hartid = r_tp();         // hartid for cpuid()
 
+  // tell trampoline.S where this thread's trapframe is.
+  w_sscratch(TRAPFRAMES(p->tfslot));
+
   // set up the registers that trampoline.S's sret will use
   // to get to user space.
   
@@ -141,6 +167,11 @@ prepare_return(void)
 
   // set S Exception Program Counter to the saved user pc.
   w_sepc(p->trapframe->epc);
+
+  // charge the time in the kernel; usertrap() charges the rest.
+  uint64 now = r_time();
+  p->ru.stime += now - p->lastts;
+  p->lastts = now;
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -164,8 +195,12 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0)
+  // the work the handler deferred, unless this interrupted it.
+  softirq();
+
+  // give up the CPU if this is a timer interrupt, unless this
+  // interrupted deferred work, which must finish on this CPU.
+  if(which_dev == 2 && myproc() != 0 && !mycpu()->insoftirq)
     yield();
 
   // the yield() may have caused some traps to occur,
@@ -182,6 +217,8 @@ clockintr()
     ticks++;
     wakeup(&ticks);
     release(&tickslock);
+    if(ticks % REAPTICKS == 0)
+      queuework(&reapwork);
   }
 
   // ask for the next timer interrupt. this also clears
@@ -204,6 +241,7 @@ devintr()
     // this is a supervisor external interrupt, via PLIC.
 
     // irq indicates which device interrupted.
+    uint64 t0 = r_time();
     int irq = plic_claim();
 
     if(irq == UART0_IRQ){
@@ -220,13 +258,36 @@ devintr()
     if(irq)
       plic_complete(irq);
 
+    if(irq > 0 && irq < NIRQ){
+      struct cpu *c = mycpu();
+      uint64 t = r_time() - t0;
+      c->irqs[irq]++;
+      c->irqtime += t;
+      if(t > c->irqmax)
+        c->irqmax = t;
+    }
+
     return 1;
   } else if(scause == 0x8000000000000005L){
     // timer interrupt.
     clockintr();
     return 2;
+  } else if(scause == 0x8000000000000001L){
+    // software interrupt: an IPI from another CPU,
+    // forwarded by ipivec in kernelvec.S.
+    w_sip(r_sip() & ~SIP_SSIP);
+    tlbintr();
+    return 1;
   } else {
     return 0;
   }
 }
 
+
+// interrupt another CPU. it arrives there as a
+// supervisor software interrupt; see devintr().
+void
+ipisend(int cpu)
+{
+  *(volatile uint32 *)CLINT_MSIP(cpu) = 1;
+}
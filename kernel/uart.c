@@ -7,8 +7,10 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "defs.h"
+#include "softirq.h"
 
 // the UART control registers are memory-mapped
 // at address UART0. this macro returns the
@@ -37,11 +39,26 @@
 #define LSR_RX_READY (1<<0)   // input is waiting to be read from RHR
 #define LSR_TX_IDLE (1<<5)    // THR can accept another character to send
 
-// for sending threads to synchronize with uart "ready" interrupts.
+#define UART_FIFO 16          // depth of the 16550's transmit FIFO
+#define TX_BUF_SIZE 1024      // bytes queued by uartwrite()
+#define RX_BUF_SIZE 128       // bytes read by uartintr(), not yet processed
+
+// output waiting for the UART, and sending threads waiting for
+// room in tx_buf.  the transmit interrupt refills the FIFO.
 static struct spinlock tx_lock;
+static char tx_buf[TX_BUF_SIZE];
+static uint tx_r;             // next byte to send
+static uint tx_w;             // next free slot
 static int tx_busy;           // is the UART busy sending?
 static int tx_chan;           // &tx_chan is the "wait channel"
 
+// input the interrupt handler has taken from the UART, for
+// uartsoftintr() to give to the console.
+static struct spinlock rx_lock;
+static uchar rx_buf[RX_BUF_SIZE];
+static uint rx_r;             // next byte to process
+static uint rx_w;             // next free slot
+
 extern volatile int panicking; // from printf.c
 extern volatile int panicked; // from printf.c
 
@@ -71,28 +88,91 @@ uartinit(void)
   WriteReg(IER, IER_TX_ENABLE | IER_RX_ENABLE);
 
   initlock(&tx_lock, "uart");
+  initlock(&rx_lock, "uartrx");
 }
 
-// transmit buf[] to the uart. it blocks if the
-// uart is busy, so it cannot be called from
-// interrupts, only from write() system calls.
+// if the UART's transmit FIFO is empty, fill it from the kernel
+// log and tx_buf, sharing it between the two when both have
+// output waiting.  caller holds tx_lock.
+static void
+uartstart(void)
+{
+  char buf[UART_FIFO];
+  int n;
+
+  if(panicked || tx_busy || (ReadReg(LSR) & LSR_TX_IDLE) == 0)
+    return;
+
+  n = lognext(buf, tx_r != tx_w ? UART_FIFO/2 : UART_FIFO);
+  if(tx_r != tx_w){
+    while(n < UART_FIFO && tx_r != tx_w)
+      buf[n++] = tx_buf[tx_r++ % TX_BUF_SIZE];
+    if(n < UART_FIFO)
+      n += lognext(buf + n, UART_FIFO - n);
+  }
+  for(int i = 0; i < n; i++)
+    WriteReg(THR, buf[i]);
+  if(n > 0)
+    tx_busy = 1;
+}
+
+// start sending new log output, unless the UART is busy, in
+// which case its next transmit interrupt will.  for printf.
+void
+uartkick(void)
+{
+  // logappend() published the record before this load, and
+  // uartsoftintr() clears tx_busy before it looks for log output,
+  // so one of the two sees the other.
+  __sync_synchronize();
+  if(tx_busy)
+    return;
+  acquire(&tx_lock);
+  uartstart();
+  release(&tx_lock);
+}
+
+// send a FIFO's worth of log output, spinning until the UART can
+// take it; returns how many bytes.  for printf when a CPU's log
+// ring is full of unsent text, or interrupts aren't on yet.
+int
+uartdrain(void)
+{
+  char buf[UART_FIFO];
+  int n;
+
+  acquire(&tx_lock);
+  while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
+    ;
+  n = lognext(buf, UART_FIFO);
+  for(int i = 0; i < n; i++)
+    WriteReg(THR, buf[i]);
+  if(n > 0)
+    tx_busy = 1;
+  release(&tx_lock);
+  return n;
+}
+
+// queue buf[] for the uart and start it sending. it returns once
+// the bytes are queued, but blocks while tx_buf is full, so it
+// cannot be called from interrupts, only from write() system calls.
 void
 uartwrite(char buf[], int n)
 {
   acquire(&tx_lock);
 
   int i = 0;
-  while(i < n){ 
-    while(tx_busy != 0){
+  while(i < n){
+    while(tx_w - tx_r == TX_BUF_SIZE){
       // wait for a UART transmit-complete interrupt
-      // to set tx_busy to 0.
+      // to make room.
+      uartstart();
       sleep(&tx_chan, &tx_lock);
-    }   
-      
-    WriteReg(THR, buf[i]);
+    }
+    tx_buf[tx_w++ % TX_BUF_SIZE] = buf[i];
     i += 1;
-    tx_busy = 1;
   }
+  uartstart();
 
   release(&tx_lock);
 }
@@ -137,23 +217,51 @@ uartgetc(void)
 
 // handle a uart interrupt, raised because input has
 // arrived, or the uart is ready for more output, or
-// both. called from devintr().
+// both. called from devintr().  it only takes the input,
+// which the uart would otherwise keep interrupting for;
+// uartsoftintr() does the rest.
 void
 uartintr(void)
 {
   ReadReg(ISR); // acknowledge the interrupt
 
+  acquire(&rx_lock);
+  while(1){
+    int c = uartgetc();
+    if(c == -1)
+      break;
+    if(rx_w - rx_r < RX_BUF_SIZE)  // else lost, as if the FIFO overran
+      rx_buf[rx_w++ % RX_BUF_SIZE] = c;
+  }
+  release(&rx_lock);
+
+  raisesoftirq(SOFTIRQ_UART);
+}
+
+// refill the transmit FIFO, and give the console the input
+// uartintr() took.  deferred work, with interrupts on.
+void
+uartsoftintr(void)
+{
+  int c;
+
   acquire(&tx_lock);
   if(ReadReg(LSR) & LSR_TX_IDLE){
-    // UART finished transmitting; wake up sending thread.
+    // UART finished transmitting; refill the FIFO, and
+    // maybe uartwrite() is waiting for space in the buffer.
     tx_busy = 0;
-    wakeup(&tx_chan);
+    __sync_synchronize();
+    uartstart();
+    if(tx_w - tx_r < TX_BUF_SIZE)
+      wakeup(&tx_chan);
   }
   release(&tx_lock);
 
-  // read and process incoming characters, if any.
+  // process incoming characters, if any.
   while(1){
-    int c = uartgetc();
+    acquire(&rx_lock);
+    c = rx_r != rx_w ? rx_buf[rx_r++ % RX_BUF_SIZE] : -1;
+    release(&rx_lock);
     if(c == -1)
       break;
     consoleintr(c);
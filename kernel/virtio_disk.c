@@ -15,6 +15,9 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "trace.h"
+#include "irqstat.h"
+#include "softirq.h"
 #ifdef SLAB_KERNEL
 #include "slab.h"
 #endif
@@ -58,6 +61,12 @@ struct disk_s {
   struct virtio_blk_req ops[NUM];
   
   struct spinlock vdisk_lock;
+
+  // request latency, for irqstat(); under vdisk_lock.
+  uint64 nio;
+  uint64 iotime;
+  uint64 iotime2;
+  uint64 iomax;
 };
 
 #ifdef SLAB_KERNEL
@@ -293,6 +302,8 @@ virtio_disk_rw(struct buf *b, int write)
 
   __sync_synchronize();
 
+  TRACE(TC_VIRTIO, TE_DISK_SUBMIT, b->blockno, idx[0] << 1 | write);
+  uint64 t0 = r_time();
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
   // Wait for virtio_disk_intr() to say request has finished.
@@ -300,25 +311,42 @@ virtio_disk_rw(struct buf *b, int write)
     sleep(b, &disk.vdisk_lock);
   }
 
+  uint64 t = r_time() - t0;
+  disk.nio++;
+  disk.iotime += t;
+  disk.iotime2 += t * t;
+  if(t > disk.iomax)
+    disk.iomax = t;
+
   disk.info[idx[0]].b = 0;
   free_chain(idx[0]);
 
   release(&disk.vdisk_lock);
 }
 
+// the interrupt handler only acknowledges the interrupt; the
+// completions are handled by virtio_disk_softintr(), with
+// interrupts on.
 void
 virtio_disk_intr()
 {
-  acquire(&disk.vdisk_lock);
-
   // the device won't raise another interrupt until we tell it
   // we've seen this interrupt, which the following line does.
   // this may race with the device writing new entries to
   // the "used" ring, in which case we may process the new
-  // completion entries in this interrupt, and have nothing to do
-  // in the next interrupt, which is harmless.
+  // completion entries now, and have nothing to do after the
+  // next interrupt, which is harmless.
   *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
+  raisesoftirq(SOFTIRQ_DISK);
+}
+
+// wake up the processes whose requests have finished.
+void
+virtio_disk_softintr()
+{
+  acquire(&disk.vdisk_lock);
+
   __sync_synchronize();
 
   // the device increments disk.used->idx when it
@@ -332,6 +360,7 @@ virtio_disk_intr()
       panic("virtio_disk_intr status");
 
     struct buf *b = disk.info[id].b;
+    TRACE(TC_VIRTIO, TE_DISK_DONE, b->blockno, id << 1);
     b->disk = 0;   // disk is done with buf
     wakeup(b);
 
@@ -340,3 +369,17 @@ virtio_disk_intr()
 
   release(&disk.vdisk_lock);
 }
+
+// the latency counters, for irqstat().  the worst latency is
+// since the last call.
+void
+virtio_disk_stat(struct irqstat *st)
+{
+  acquire(&disk.vdisk_lock);
+  st->nio = disk.nio;
+  st->iotime = disk.iotime;
+  st->iotime2 = disk.iotime2;
+  st->iomax = disk.iomax;
+  disk.iomax = 0;
+  release(&disk.vdisk_lock);
+}
@@ -5,8 +5,10 @@
 #include "riscv.h"
 #include "defs.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "fs.h"
+#include "trace.h"
 
 /*
  * the kernel's page table.
@@ -17,6 +19,31 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+// Address-space identifiers.
+//
+// Each user address space runs under its own RISC-V ASID, so the
+// satp switches in trampoline.S between the kernel (ASID 0) and user
+// space need no TLB flush.  ASIDs come from a global counter; when it
+// runs past the hardware's limit the generation is bumped, and every
+// CPU flushes its whole TLB once before it uses an ASID of the new
+// generation.  An address space holding an ASID from an older
+// generation gets a fresh one the next time it returns to user space.
+static struct {
+  struct spinlock lock;
+  volatile uint64 generation;
+  uint64 next;     // next ASID to hand out
+  uint64 max;      // largest implemented ASID; 0 if ASIDs are unsupported
+} asids;
+
+// TLB shootdown.  When an address space shared by threads loses a
+// mapping, CPUs running it in user space at that moment are sent an
+// IPI and flush its ASID; see uvmshootdown().  One request at a time.
+static struct {
+  struct spinlock lock;
+  volatile uint64 asid;      // ASID to flush; 0 means everything
+  volatile uint pending;     // CPUs that have yet to flush
+} shoot;
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
@@ -35,6 +62,9 @@ kvmmake(void)
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x4000000, PTE_R | PTE_W);
 
+  // CLINT software-interrupt registers, for IPIs
+  kvmmap(kpgtbl, CLINT, CLINT, PGSIZE, PTE_R | PTE_W);
+
   // map kernel text executable and read-only.
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
@@ -45,9 +75,13 @@ kvmmake(void)
   // the highest virtual address in the kernel.
   kvmmap(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-  // allocate and map a kernel stack for each process.
-  proc_mapstacks(kpgtbl);
-  
+  // kernel stacks are mapped as procs are allocated; see procget().
+  // make their page-table pages now, so that mapping and unmapping
+  // them never allocates or frees one.
+  for(int i = 0; i < NPROC; i++)
+    if(walk(kpgtbl, KSTACK(i), 1) == 0)
+      panic("kvmmake: kstack");
+
   return kpgtbl;
 }
 
@@ -61,6 +95,32 @@ kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
     panic("kvmmap");
 }
 
+// map the kernel stack page pa at va, for a new proc.  the page
+// table is live on every CPU, so the caller serializes calls; va
+// isn't mapped, and every CPU has flushed its TLB since it last was
+// (see procreap()), so none can hold a stale translation.
+int
+kvmmapstack(uint64 va, uint64 pa)
+{
+  if(mappages(kernel_pagetable, va, PGSIZE, pa, PTE_R | PTE_W) != 0)
+    return -1;
+  sfence_vma();
+  return 0;
+}
+
+// unmap the kernel stack at va, for a proc being freed.  CPUs may
+// use the old translation until they next flush their TLBs, so the
+// caller must not free the page, or map va again, until they have.
+void
+kvmunmapstack(uint64 va)
+{
+  pte_t *pte;
+
+  if((pte = walk(kernel_pagetable, va, 0)) == 0 || (*pte & PTE_V) == 0)
+    panic("kvmunmapstack");
+  *pte = 0;
+}
+
 // Initialize the kernel_pagetable, shared by all CPUs.
 void
 kvminit(void)
@@ -76,12 +136,157 @@ kvminithart()
   // wait for any previous writes to the page table memory to finish.
   sfence_vma();
 
-  w_satp(MAKE_SATP(kernel_pagetable));
+  w_satp(MAKE_SATP(kernel_pagetable, 0));
 
   // flush stale entries from the TLB.
   sfence_vma();
 }
 
+// Find out how many ASID bits the hardware implements: the ASID field
+// of satp is WARL, so writing all ones reads back only the bits that
+// exist.  Called once, on hart 0, with paging on.
+void
+asidinit(void)
+{
+  uint64 satp = r_satp();
+
+  initlock(&asids.lock, "asid");
+  initlock(&shoot.lock, "shootdown");
+  w_satp(satp | SATP_ASID_MASK);
+  asids.max = (r_satp() & SATP_ASID_MASK) >> SATP_ASID_SHIFT;
+  w_satp(satp);
+  sfence_vma();
+
+  asids.generation = 1;
+  asids.next = 1;
+  printf("vm: %ld ASIDs\n", asids.max);
+}
+
+// Return the satp value with which p should run in user space on
+// this CPU.  Allocates p's address space an ASID if it has none from
+// the current generation, and flushes whatever stale translations
+// this CPU may hold for it.  Interrupts must be off.
+uint64
+uvmswitch(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  struct vmspace *vm = p->vm;
+  uint mask = 1 << cpuid();
+  uint64 gen;
+
+  // announce that we're about to run vm before looking at
+  // tlb_stale; uvmshootdown() does the opposite.
+  __sync_fetch_and_or(&vm->active, mask);
+
+  // without ASIDs trampoline.S flushes the TLB on every switch.
+  if(asids.max == 0)
+    return MAKE_SATP(p->pagetable, 0);
+
+  gen = asids.generation;
+  if(vm->asid_gen != gen){
+    acquire(&asids.lock);
+    if(vm->asid_gen != asids.generation){
+      // (a sibling thread may have beaten us to it.)
+      if(asids.next > asids.max){
+        asids.generation++;
+        asids.next = 1;
+      }
+      vm->asid = asids.next++;
+      vm->tlb_stale = 0;
+      __sync_synchronize();
+      vm->asid_gen = asids.generation;
+    }
+    gen = asids.generation;
+    release(&asids.lock);
+  }
+
+  if(c->asid_gen != gen){
+    // first use of this generation here; older ASIDs may be reused.
+    sfence_vma();
+    c->asid_gen = gen;
+    __sync_fetch_and_and(&vm->tlb_stale, ~mask);
+  } else if(vm->tlb_stale & mask){
+    __sync_fetch_and_and(&vm->tlb_stale, ~mask);
+    sfence_vma_asid(vm->asid);
+  }
+
+  return MAKE_SATP(p->pagetable, vm->asid);
+}
+
+// p trapped into the kernel on this CPU, and is no longer using
+// its user translations here.  Interrupts must be off.
+void
+uvmleave(struct proc *p)
+{
+  __sync_fetch_and_and(&p->vm->active, ~(1 << cpuid()));
+}
+
+// The address space whose page table is pagetable, if it may be
+// live: if it belongs to the calling process.  Other page tables
+// are being built or torn down, and run under no ASID that will be
+// used again without a flush.
+static struct vmspace*
+uvmlive(pagetable_t pagetable)
+{
+  struct proc *p = myproc();
+
+  if(p == 0 || p->pagetable != pagetable)
+    return 0;
+  return p->vm;
+}
+
+// Some of vm's translations were removed or lost permissions.
+// Every CPU flushes vm's ASID before it next enters user space with
+// it; CPUs running it in user space right now are interrupted, and
+// have flushed by the time this returns.  Only then may pages that
+// were unmapped be freed.
+void
+uvmshootdown(struct vmspace *vm)
+{
+  uint others;
+
+  __sync_fetch_and_or(&vm->tlb_stale, ~0);
+
+  push_off();
+  others = vm->active & ~(1 << cpuid());
+  pop_off();
+  if(others == 0)
+    return;
+
+  acquire(&shoot.lock);
+  shoot.asid = vm->asid;
+  __sync_synchronize();
+  shoot.pending = others;
+  for(int i = 0; i < NCPU; i++)
+    if(others & (1 << i))
+      ipisend(i);
+  // a CPU that has since trapped into the kernel will flush
+  // before it returns (tlb_stale), so needn't be waited for.
+  // CPUs still in user space take the IPI right away.
+  while(shoot.pending & vm->active)
+    ;
+  shoot.pending = 0;
+  release(&shoot.lock);
+}
+
+// An IPI arrived: flush the TLB if a shootdown is waiting for us.
+void
+tlbintr(void)
+{
+  uint mask = 1 << cpuid();
+
+  if(shoot.pending & mask){
+    __sync_synchronize();
+    // a CPU still on an older generation may be running the
+    // address space under its previous ASID.
+    if(shoot.asid && mycpu()->asid_gen == asids.generation)
+      sfence_vma_asid(shoot.asid);
+    else
+      sfence_vma();
+    __sync_fetch_and_and(&shoot.pending, ~mask);
+  }
+}
+
 // Return the address of the PTE in page table pagetable
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page-table pages.
@@ -105,10 +310,21 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
     if(*pte & PTE_V) {
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      pde_t *new;
+      pte_t old = 0;
+
+      if(!alloc || (new = (pde_t*)kalloc()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
-      *pte = PA2PTE(pagetable) | PTE_V;
+      memset(new, 0, PGSIZE);
+      // growproc() maps pages without vm->lock, so a sibling's
+      // vmfault() may be filling in the same entry.
+      if(__atomic_compare_exchange_n(pte, &old, PA2PTE(new) | PTE_V, 0,
+                                     __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)){
+        pagetable = new;
+      } else {
+        pgfree(new);
+        pagetable = (pagetable_t)PTE2PA(old);
+      }
     }
   }
   return &pagetable[PX(0, va)];
@@ -194,6 +410,9 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
   uint64 a;
   pte_t *pte;
+  struct vmspace *vm = uvmlive(pagetable);
+  void *freed[32];  // pages to free after the shootdown
+  int nfreed = 0, unmapped = 0;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
@@ -203,11 +422,27 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
       continue;   
     if((*pte & PTE_V) == 0)  // has physical page been allocated?
       continue;
-    if(do_free){
-      uint64 pa = PTE2PA(*pte);
+    uint64 pa = PTE2PA(*pte);
+    *pte = 0;
+    unmapped = 1;
+    if(!do_free)
+      continue;
+    if(vm == 0){
       pgfree((void*)pa);
+      continue;
+    }
+    freed[nfreed++] = (void*)pa;
+    if(nfreed == NELEM(freed)){
+      uvmshootdown(vm);
+      while(nfreed > 0)
+        pgfree(freed[--nfreed]);
     }
-    *pte = 0;
+  }
+
+  if(vm && unmapped){
+    uvmshootdown(vm);
+    while(nfreed > 0)
+      pgfree(freed[--nfreed]);
   }
 }
 
@@ -329,11 +564,14 @@ void
 uvmclear(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
+  struct vmspace *vm;
   
   pte = walk(pagetable, va, 0);
   if(pte == 0)
     panic("uvmclear");
   *pte &= ~PTE_U;
+  if((vm = uvmlive(pagetable)) != 0)
+    uvmshootdown(vm);
 }
 
 // Copy from kernel to user.
@@ -447,28 +685,49 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
 // allocate and map user memory if process is referencing a page
 // that was lazily allocated in sys_sbrk().
-// returns 0 if va is invalid or already mapped, or if
-// out of physical memory, and physical address if successful.
+// returns 0 if va is invalid or already mapped without the
+// needed permission, or if out of physical memory, and
+// physical address if successful.
 uint64
 vmfault(pagetable_t pagetable, uint64 va, int read)
 {
-  uint64 mem;
+  uint64 mem = 0;
+  pte_t *pte;
   struct proc *p = myproc();
-
-  if (va >= p->sz)
-    return 0;
+  struct vmspace *vm = p->vm;
+
+  TRACE(TC_FAULT, TE_FAULT, va, read);
+  p->ru.nfault++;
+
+  // sibling threads may be faulting on the same page, or growing
+  // or shrinking the address space.  this can't sleep for mmlock
+  // (copyin() may be called with spinlocks held), but growproc()
+  // sets sz under vm->lock, and shrinks it before unmapping.
+  acquire(&vm->lock);
+  if (va >= vm->sz)
+    goto out;
   va = PGROUNDDOWN(va);
   if(ismapped(pagetable, va)) {
-    return 0;
+    // RISC-V lets sfence.vma be deferred after an invalid PTE
+    // becomes valid, so the fault may come from a stale TLB entry
+    // rather than a missing page; flush it and retry the access.
+    pte = walk(pagetable, va, 0);
+    if((*pte & PTE_U) && (*pte & (read ? PTE_R : PTE_W))){
+      sfence_vma_page(va, vm->asid);
+      mem = PTE2PA(*pte);
+    }
+    goto out;
   }
   mem = (uint64) kalloc();
   if(mem == 0)
-    return 0;
+    goto out;
   memset((void *) mem, 0, PGSIZE);
   if (mappages(p->pagetable, va, PGSIZE, mem, PTE_W|PTE_U|PTE_R) != 0) {
     pgfree((void *)mem);
-    return 0;
+    mem = 0;
   }
+ out:
+  release(&vm->lock);
   return mem;
 }
 
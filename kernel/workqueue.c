@@ -0,0 +1,215 @@
+// Per-CPU workqueues.
+//
+// Each CPU has a queue of struct works and a kernel thread, pinned
+// to that CPU, that runs them one at a time in the order they were
+// queued.  A subsystem queues work instead of doing it inline in
+// whatever system call or interrupt happens to notice it is due:
+// the work runs in a thread of its own, which may sleep, with
+// interrupts on, and is charged to its worker in procstat().
+//
+// queuework() may be called from interrupt handlers.  q->lock
+// protects a queue and its counters; a work's queued flag is set
+// and cleared atomically, so a work is on at most one queue.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "defs.h"
+#include "workqueue.h"
+
+// r_time() counts at 10 MHz in qemu's virt machine.
+#define TIMEBASE_PER_US 10
+
+static struct workq {
+  struct spinlock lock;
+  struct work *head;
+  struct work **tail;
+  struct proc *worker;
+  int depth;
+  int maxdepth;
+  uint64 queued;
+  uint64 done;
+  uint64 runtime;       // r_time() units
+  uint64 waittime;
+  uint64 maxwait;
+} wq[NCPU];
+
+// set up every CPU's queue, so work can be queued for a CPU
+// before its worker starts.  called once, by hart 0.
+void
+workqinit(void)
+{
+  for(int i = 0; i < NCPU; i++){
+    initlock(&wq[i].lock, "workq");
+    wq[i].tail = &wq[i].head;
+  }
+}
+
+static void
+worker(void *arg)
+{
+  struct workq *q = arg;
+  struct work *w;
+  void (*fn)(void*);
+  uint64 t0, wait;
+
+  acquire(&q->lock);
+  for(;;){
+    while(q->head == 0)
+      sleep(q, &q->lock);
+    w = q->head;
+    if((q->head = w->next) == 0)
+      q->tail = &q->head;
+    q->depth--;
+    t0 = r_time();
+    wait = t0 - w->qtime;
+    q->waittime += wait;
+    if(wait > q->maxwait)
+      q->maxwait = wait;
+    // w may be queued again, or freed, once the flag is clear.
+    fn = w->fn;
+    arg = w->arg;
+    __atomic_store_n(&w->queued, 0, __ATOMIC_RELEASE);
+    release(&q->lock);
+
+    if(!intr_get())
+      panic("worker: interrupts off");
+    fn(arg);
+
+    acquire(&q->lock);
+    q->done++;
+    q->runtime += r_time() - t0;
+  }
+}
+
+// start this CPU's worker.  called by each hart as it boots, after
+// workqinit() and userinit().
+void
+workqinithart(void)
+{
+  char name[16];
+  int cpu;
+
+  push_off();
+  cpu = cpuid();
+  pop_off();
+  safestrcpy(name, "kworker/0", sizeof(name));
+  name[8] = '0' + cpu;
+  if((wq[cpu].worker = kthread_create(name, worker, &wq[cpu], cpu)) == 0)
+    panic("workqinithart");
+}
+
+void
+workinit(struct work *w, void (*fn)(void*), void *arg)
+{
+  w->fn = fn;
+  w->arg = arg;
+  w->next = 0;
+  w->queued = 0;
+}
+
+// queue w on cpu's queue.  returns 0 if it was queued already.
+int
+queuework_on(int cpu, struct work *w)
+{
+  struct workq *q = &wq[cpu];
+
+  if(__sync_lock_test_and_set(&w->queued, 1))
+    return 0;
+  acquire(&q->lock);
+  w->next = 0;
+  w->qtime = r_time();
+  *q->tail = w;
+  q->tail = &w->next;
+  q->queued++;
+  if(++q->depth > q->maxdepth)
+    q->maxdepth = q->depth;
+  wakeup(q);
+  release(&q->lock);
+  return 1;
+}
+
+// queue w on this CPU's queue.
+int
+queuework(struct work *w)
+{
+  int cpu;
+
+  push_off();
+  cpu = cpuid();
+  pop_off();
+  return queuework_on(cpu, w);
+}
+
+struct flush {
+  struct work w;
+  struct workq *q;
+  int done;
+};
+
+static void
+flushdone(void *arg)
+{
+  struct flush *f = arg;
+
+  acquire(&f->q->lock);
+  f->done = 1;
+  wakeup(f);
+  release(&f->q->lock);
+}
+
+// wait until the work queued on cpu so far has run.
+void
+flushwork(int cpu)
+{
+  struct flush f;
+
+  if(wq[cpu].worker == 0)
+    return;
+  f.q = &wq[cpu];
+  f.done = 0;
+  workinit(&f.w, flushdone, &f);
+  queuework_on(cpu, &f.w);
+  acquire(&f.q->lock);
+  while(!f.done)
+    sleep(&f, &f.q->lock);
+  release(&f.q->lock);
+}
+
+// copy a struct workstat for each of up to n workers to user
+// address addr, after flushing each queue if flush; returns how
+// many.
+int
+workstats(uint64 addr, int n, int flush)
+{
+  struct workstat ws;
+  struct workq *q;
+  int cpu, k = 0;
+
+  for(cpu = 0; cpu < NCPU && k < n; cpu++){
+    q = &wq[cpu];
+    if(q->worker == 0)
+      continue;
+    if(flush)
+      flushwork(cpu);
+    acquire(&q->lock);
+    ws.cpu = cpu;
+    ws.pid = q->worker->pid;
+    ws.depth = q->depth;
+    ws.maxdepth = q->maxdepth;
+    ws.queued = q->queued;
+    ws.done = q->done;
+    ws.runtime = q->runtime / TIMEBASE_PER_US;
+    ws.waittime = q->waittime / TIMEBASE_PER_US;
+    ws.maxwait = q->maxwait / TIMEBASE_PER_US;
+    release(&q->lock);
+    if(copyout(myproc()->pagetable, addr + k*sizeof(ws), (char*)&ws, sizeof(ws)) < 0)
+      return -1;
+    k++;
+  }
+  return k;
+}
@@ -0,0 +1,30 @@
+// Per-CPU workqueues: functions queued to run later in a kernel
+// thread; see workqueue.c.  Worker statistics are returned by the
+// workstat() system call; see user/workstat.c.
+
+#ifndef _KERNEL_WORKQUEUE_H
+#define _KERNEL_WORKQUEUE_H
+
+// a deferred call of fn(arg).  it may be queued again as soon as
+// fn starts, but only once at a time.
+struct work {
+  void (*fn)(void*);
+  void *arg;
+  struct work *next;    // in its queue
+  int queued;           // on a queue; set and cleared atomically
+  uint64 qtime;         // r_time() when queued
+};
+
+struct workstat {
+  int cpu;
+  int pid;              // of the worker thread
+  int depth;            // items waiting now
+  int maxdepth;         // most ever waiting
+  uint64 queued;        // items queued
+  uint64 done;          // items run
+  uint64 runtime;       // microseconds running them
+  uint64 waittime;      // microseconds they waited to start
+  uint64 maxwait;       // the longest wait, microseconds
+};
+
+#endif // _KERNEL_WORKQUEUE_H
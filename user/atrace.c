@@ -0,0 +1,138 @@
+// atrace: record kernel allocator calls to a file.
+//
+//   atrace start               empty the ring and start recording
+//   atrace stop                stop recording
+//   atrace dump file           move what the ring holds into file
+//   atrace run file cmd ...    record while cmd runs, into file
+//   atrace print file          print file as text, one record per
+//                              line, for host/atreplay
+//
+// See kernel/atrace.h for the record format.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/atrace.h"
+#include "user/user.h"
+
+#define NREC 128
+
+struct atrace recs[NREC];
+
+void
+usage(void)
+{
+  fprintf(2, "usage: atrace start | stop | dump file | run file cmd ... | print file\n");
+  exit(1);
+}
+
+int
+create(char *file)
+{
+  int fd;
+
+  if((fd = open(file, O_CREATE | O_WRONLY | O_TRUNC)) < 0){
+    fprintf(2, "atrace: cannot create %s\n", file);
+    exit(1);
+  }
+  return fd;
+}
+
+// copy records from the ring to fd.  if follow, keep going until
+// tracing stops; otherwise stop when the ring is empty.
+int
+drain(int fd, int follow)
+{
+  int n, total = 0;
+
+  while((n = atrace(ATRACE_READ, recs, NREC)) >= 0){
+    if(n == 0){
+      if(!follow)
+        break;
+      pause(1);
+      continue;
+    }
+    if(write(fd, recs, n * sizeof(struct atrace)) != n * sizeof(struct atrace)){
+      fprintf(2, "atrace: write error\n");
+      exit(1);
+    }
+    total += n;
+  }
+  return total;
+}
+
+void
+run(char *file, char **argv)
+{
+  int fd, drainer, pid, n;
+
+  fd = create(file);
+  atrace(ATRACE_START, 0, 0);
+
+  // a second process empties the ring while cmd runs, so that
+  // a long run doesn't overflow it.
+  if((drainer = fork()) == 0){
+    n = drain(fd, 1);
+    printf("atrace: %d records, %d dropped\n", n, atrace(ATRACE_DROPPED, 0, 0));
+    exit(0);
+  }
+  close(fd);
+
+  if((pid = fork()) == 0){
+    exec(argv[0], argv);
+    fprintf(2, "atrace: exec %s failed\n", argv[0]);
+    exit(1);
+  }
+  if(pid > 0)
+    wait(0);
+  atrace(ATRACE_STOP, 0, 0);
+  if(drainer > 0)
+    wait(0);
+}
+
+void
+print(char *file)
+{
+  int fd, n, i;
+
+  if((fd = open(file, O_RDONLY)) < 0){
+    fprintf(2, "atrace: cannot open %s\n", file);
+    exit(1);
+  }
+  printf("# op cpu ts cache size addr\n");
+  while((n = read(fd, recs, sizeof(recs))) > 0){
+    for(i = 0; i < n / sizeof(struct atrace); i++){
+      struct atrace *t = &recs[i];
+      printf("at %d %d %lu %lx %d %lx\n",
+             t->op, t->cpu, t->ts, t->cache, t->size, t->addr);
+    }
+  }
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, n;
+
+  if(argc < 2)
+    usage();
+
+  if(strcmp(argv[1], "start") == 0){
+    atrace(ATRACE_START, 0, 0);
+  } else if(strcmp(argv[1], "stop") == 0){
+    atrace(ATRACE_STOP, 0, 0);
+  } else if(strcmp(argv[1], "dump") == 0 && argc == 3){
+    fd = create(argv[2]);
+    n = drain(fd, 0);
+    close(fd);
+    printf("atrace: %d records, %d dropped\n", n, atrace(ATRACE_DROPPED, 0, 0));
+  } else if(strcmp(argv[1], "run") == 0 && argc >= 4){
+    run(argv[2], argv + 3);
+  } else if(strcmp(argv[1], "print") == 0 && argc == 3){
+    print(argv[2]);
+  } else {
+    usage();
+  }
+  exit(0);
+}
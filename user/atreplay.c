@@ -0,0 +1,216 @@
+// Replay an allocation trace from atrace against the kernel's slab
+// allocator, through the slab test system calls.
+//
+//   atreplay file
+//
+// Every cache in the trace gets a fresh cache of the same object
+// size; kmalloc/kfree replay as kmalloc/kfree.  Records the slab
+// made for itself (AT_NESTED), page allocations, which have no
+// system call, and frees of objects allocated before the trace
+// began are skipped.  Reports ticks and live objects per window of
+// records, then kmem_cache_info() for each replay cache, whose
+// usage line shows how fragmented the trace left it.
+//
+// Timing includes a trap per call; host/atreplay replays the same
+// trace natively for per-op latency.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/atrace.h"
+#include "user/user.h"
+
+#define NREC     128
+#define WINDOW   2048
+#define NMAP     (1 << 15)      // live objects tracked; a power of two
+#define NCACHES  64
+
+struct live {
+    uint64 key;         // address in the trace; 0 if empty
+    uint64 obj;         // replayed object
+    kmem_cache_t cache; // its replay cache; 0 for kmalloc
+    int size;
+};
+
+static struct live *map;
+static struct { uint64 id; kmem_cache_t c; int size; } caches[NCACHES];
+static int ncaches;
+static struct atrace recs[NREC];
+
+static int nlive;
+static uint64 livebytes;
+
+static uint hash(uint64 k)
+{
+    return (uint)((k >> 3) * 2654435761u) & (NMAP - 1);
+}
+
+static struct live *lookup(uint64 key)
+{
+    for (uint i = hash(key); map[i].key; i = (i + 1) & (NMAP - 1))
+        if (map[i].key == key)
+            return &map[i];
+    return 0;
+}
+
+static int insert(uint64 key, uint64 obj, kmem_cache_t c, int size)
+{
+    uint i;
+
+    if (nlive >= NMAP - NMAP / 4)
+        return -1;
+    for (i = hash(key); map[i].key; i = (i + 1) & (NMAP - 1))
+        ;
+    map[i].key = key;
+    map[i].obj = obj;
+    map[i].cache = c;
+    map[i].size = size;
+    nlive++;
+    livebytes += size;
+    return 0;
+}
+
+// linear-probing delete: pull later entries of the run back.
+static void delete(struct live *e)
+{
+    uint i = e - map, j = i;
+
+    nlive--;
+    livebytes -= e->size;
+    for (;;) {
+        map[i].key = 0;
+        for (;;) {
+            j = (j + 1) & (NMAP - 1);
+            if (map[j].key == 0)
+                return;
+            uint h = hash(map[j].key);
+            // move j to i unless its home lies cyclically in (i, j].
+            if (i <= j ? (i < h && h <= j) : (i < h || h <= j))
+                continue;
+            break;
+        }
+        map[i] = map[j];
+        i = j;
+    }
+}
+
+static kmem_cache_t replay_cache(uint64 id, int size)
+{
+    for (int i = 0; i < ncaches; i++)
+        if (caches[i].id == id)
+            return caches[i].c;
+    if (ncaches == NCACHES)
+        return 0;
+    kmem_cache_t c = kmem_cache_create("replay", size, 0, 0);
+    if (c) {
+        caches[ncaches].id = id;
+        caches[ncaches].c = c;
+        caches[ncaches].size = size;
+        ncaches++;
+    }
+    return c;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int fd, n;
+    int done = 0, window = 0, skipped = 0, orphans = 0, failed = 0;
+
+    if (argc != 2) {
+        fprintf(2, "usage: atreplay file\n");
+        exit(1);
+    }
+    if ((fd = open(argv[1], O_RDONLY)) < 0) {
+        fprintf(2, "atreplay: cannot open %s\n", argv[1]);
+        exit(1);
+    }
+    if ((map = malloc(NMAP * sizeof(struct live))) == 0) {
+        fprintf(2, "atreplay: out of memory\n");
+        exit(1);
+    }
+    memset(map, 0, NMAP * sizeof(struct live));
+    kmem_init(0);
+
+    printf("===== ALLOCATION TRACE REPLAY: %s =====\n", argv[1]);
+    int t0 = uptime(), tw = t0;
+    while ((n = read(fd, recs, sizeof(recs))) > 0) {
+        for (int i = 0; i < n / sizeof(struct atrace); i++) {
+            struct atrace *t = &recs[i];
+            struct live *e;
+            uint64 obj;
+
+            if (t->op & AT_NESTED) {
+                skipped++;
+                continue;
+            }
+            switch (t->op) {
+            case AT_ALLOC:
+            case AT_KMALLOC: {
+                kmem_cache_t c = 0;
+                if (t->op == AT_ALLOC) {
+                    if ((c = replay_cache(t->cache, t->size)) == 0) {
+                        failed++;
+                        continue;
+                    }
+                    obj = kmem_cache_alloc(c);
+                } else {
+                    obj = kmalloc(t->size);
+                }
+                if (obj == 0 || insert(t->addr, obj, c, t->size) < 0) {
+                    failed++;
+                    continue;
+                }
+                break;
+            }
+            case AT_FREE:
+            case AT_KFREE:
+                if ((e = lookup(t->addr)) == 0) {
+                    orphans++;
+                    continue;
+                }
+                if (e->cache)
+                    kmem_cache_free(e->cache, e->obj);
+                else
+                    kfree(e->obj);
+                delete(e);
+                break;
+            default:
+                skipped++;
+                continue;
+            }
+
+            done++;
+            if (++window == WINDOW) {
+                int now = uptime();
+                printf("  ops=%d  ticks=%d  live=%d  live_bytes=%lu\n",
+                       done, now - tw, nlive, livebytes);
+                tw = now;
+                window = 0;
+            }
+        }
+    }
+    close(fd);
+    int dt = uptime() - t0;
+
+    printf("\n  replayed=%d  ticks=%d  skipped=%d  orphan_frees=%d  failed=%d\n",
+           done, dt, skipped, orphans, failed);
+    printf("  still live at end: %d objects, %lu bytes\n\n", nlive, livebytes);
+    for (int i = 0; i < ncaches; i++)
+        kmem_cache_info(caches[i].c);
+
+    // give everything back.
+    for (int i = 0; i < NMAP; i++) {
+        if (map[i].key == 0)
+            continue;
+        if (map[i].cache)
+            kmem_cache_free(map[i].cache, map[i].obj);
+        else
+            kfree(map[i].obj);
+    }
+    for (int i = 0; i < ncaches; i++)
+        kmem_cache_destroy(caches[i].c);
+
+    printf("\n===== REPLAY DONE =====\n");
+    exit(0);
+}
@@ -0,0 +1,131 @@
+// Parallel read benchmark.
+// 1, 2 and 4 processes each open the same file and read it to the
+// end over and over, as parallel cats of one file would.  With
+// shared inode locks the readers should overlap; run it at
+// CPUS=4 (make qemu CPUS=4).  The file is small enough to stay in
+// the buffer cache, so the disk doesn't set the pace.  Test 2 does
+// the same with exec of one binary.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define MAXP     4
+#define FILESZ   (16*1024)
+#define NPASS    500        // times each reader reads the file
+#define NEXEC    50         // execs per process in test 2
+
+static char buf[4096];
+static char *file = "catbench.tmp";
+
+// ---- timing helpers ----
+static int timer_start(void) { return uptime(); }
+static int timer_elapsed(int start) { return uptime() - start; }
+
+static void make_file(void)
+{
+    int fd = open(file, O_CREATE | O_WRONLY | O_TRUNC);
+    if (fd < 0) {
+        printf("  FAIL: create %s\n", file);
+        exit(1);
+    }
+    memset(buf, 'x', sizeof(buf));
+    for (int n = 0; n < FILESZ; n += sizeof(buf)) {
+        if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+            printf("  FAIL: write %s\n", file);
+            exit(1);
+        }
+    }
+    close(fd);
+}
+
+static void reader(void)
+{
+    int fd, n;
+    long total = 0;
+
+    for (int i = 0; i < NPASS; i++) {
+        if ((fd = open(file, O_RDONLY)) < 0)
+            exit(1);
+        while ((n = read(fd, buf, sizeof(buf))) > 0)
+            total += n;
+        close(fd);
+    }
+    exit(total == (long)NPASS * FILESZ ? 0 : 1);
+}
+
+static void execer(void)
+{
+    char *argv[] = { "echo", 0 };
+
+    for (int i = 0; i < NEXEC; i++) {
+        int pid = fork();
+        if (pid < 0)
+            exit(1);
+        if (pid == 0) {
+            // echo with no arguments prints a newline; lose it.
+            close(1);
+            open("console", O_RDONLY);
+            exec("echo", argv);
+            exit(1);
+        }
+        wait(0);
+    }
+    exit(0);
+}
+
+// run fn in np processes at once; return ticks taken.
+static int run(void (*fn)(void), int np)
+{
+    int st, n = 0, bad = 0;
+
+    int t0 = timer_start();
+    for (int i = 0; i < np; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("  FAIL: fork\n");
+            break;
+        }
+        if (pid == 0)
+            fn();
+        n++;
+    }
+    for (int i = 0; i < n; i++) {
+        if (wait(&st) < 0 || st != 0)
+            bad = 1;
+    }
+    if (bad)
+        printf("  FAIL: a process failed\n");
+    return timer_elapsed(t0);
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const int counts[] = {1, 2, MAXP};
+
+    printf("===== PARALLEL READ BENCHMARK =====\n");
+    make_file();
+
+    printf("\n=== Test 1: read one %d KB file, %d passes each ===\n",
+           FILESZ / 1024, NPASS);
+    for (int c = 0; c < 3; c++) {
+        int np = counts[c];
+        int dt = run(reader, np);
+        printf("  procs=%d  ticks=%d", np, dt);
+        if (dt > 0)
+            printf("  KB_per_sec=%d", np * NPASS * (FILESZ / 1024) * 10 / dt);
+        printf("\n");
+    }
+
+    printf("\n=== Test 2: exec one binary, %d times each ===\n", NEXEC);
+    for (int c = 0; c < 3; c++) {
+        int np = counts[c];
+        printf("  procs=%d  ticks=%d\n", np, run(execer, np));
+    }
+
+    unlink(file);
+    printf("\n===== BENCHMARK DONE =====\n");
+    exit(0);
+}
@@ -0,0 +1,104 @@
+// Big-directory benchmark.
+// Creates, stats and removes N files in one directory, for N of
+// 500 and 5000.  It runs in /tmp, since the disk doesn't have 5000
+// inodes.  With hashed directories the time per file should stay
+// about the same as N grows; with linear ones every lookup scans the
+// whole directory, so it grows with N.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define DIR      "/tmp/dirbench"
+
+// ---- timing helpers ----
+static int timer_start(void) { return uptime(); }
+static int timer_elapsed(int start) { return uptime() - start; }
+
+static int fail;
+
+// DIR/fNNNN
+static void name(char *p, int i)
+{
+    strcpy(p, DIR "/f");
+    p += strlen(p);
+    *p++ = '0' + i / 1000 % 10;
+    *p++ = '0' + i / 100 % 10;
+    *p++ = '0' + i / 10 % 10;
+    *p++ = '0' + i % 10;
+    *p = 0;
+}
+
+static void report(const char *what, int n, int dt)
+{
+    printf("  files=%d  %s  ticks=%d", n, what, dt);
+    if (dt > 0)
+        printf("  per_sec=%d", n * 10 / dt);
+    printf("\n");
+}
+
+static void run(int n)
+{
+    char path[32];
+    struct stat st;
+    int fd, t0;
+
+    if (mkdir(DIR) < 0) {
+        printf("  FAIL: mkdir %s\n", DIR);
+        fail = 1;
+        return;
+    }
+
+    t0 = timer_start();
+    for (int i = 0; i < n; i++) {
+        name(path, i);
+        if ((fd = open(path, O_CREATE | O_WRONLY)) < 0) {
+            printf("  FAIL: create %s\n", path);
+            fail = 1;
+            n = i;
+            break;
+        }
+        close(fd);
+    }
+    report("create", n, timer_elapsed(t0));
+
+    t0 = timer_start();
+    for (int i = 0; i < n; i++) {
+        name(path, i);
+        if (stat(path, &st) < 0) {
+            printf("  FAIL: stat %s\n", path);
+            fail = 1;
+        }
+    }
+    report("stat  ", n, timer_elapsed(t0));
+
+    t0 = timer_start();
+    for (int i = 0; i < n; i++) {
+        name(path, i);
+        if (unlink(path) < 0) {
+            printf("  FAIL: unlink %s\n", path);
+            fail = 1;
+        }
+    }
+    report("unlink", n, timer_elapsed(t0));
+
+    if (unlink(DIR) < 0) {
+        printf("  FAIL: rmdir %s\n", DIR);
+        fail = 1;
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("===== BIG DIRECTORY BENCHMARK =====\n");
+
+    printf("\n=== Test 1: 500 files in one directory ===\n");
+    run(500);
+    printf("\n=== Test 2: 5000 files in one directory ===\n");
+    run(5000);
+
+    printf("\n===== BENCHMARK DONE =====\n");
+    exit(fail);
+}
@@ -0,0 +1,33 @@
+// dmesg: print the kernel's recent console output, which the
+// kernel keeps in per-CPU log rings; see kernel/printf.c.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+#define LOGSIZE 16384   // per CPU, as in kernel/printf.c
+
+int
+main(int argc, char *argv[])
+{
+  int size = NCPU * LOGSIZE, n;
+  char *buf;
+
+  if(argc != 1){
+    fprintf(2, "usage: dmesg\n");
+    exit(1);
+  }
+  if((buf = malloc(size)) == 0){
+    fprintf(2, "dmesg: out of memory\n");
+    exit(1);
+  }
+  if((n = dmesg(buf, size)) < 0){
+    fprintf(2, "dmesg: failed\n");
+    exit(1);
+  }
+  if(write(1, buf, n) != n){
+    fprintf(2, "dmesg: write error\n");
+    exit(1);
+  }
+  exit(0);
+}
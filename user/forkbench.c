@@ -0,0 +1,140 @@
+// Process creation and teardown benchmark.
+// Times fork/exit/wait with 1, 2, 4 and 8 processes doing it at
+// once, a parent reaping a batch of children, and orphans that
+// exit to init.  Run it with different numbers of CPUs
+// (make qemu CPUS=n) to see how exit and wait scale.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define MAXW     8
+#define NCYCLE   2000       // fork/exit/wait cycles per worker
+#define NBATCH   32         // children alive at once in test 2
+#define NROUND   50         // batches per worker in test 2
+#define NORPHAN  500        // orphans per worker in test 3
+
+// ---- timing helpers ----
+static int timer_start(void) { return uptime(); }
+static int timer_elapsed(int start) { return uptime() - start; }
+
+static int fail;
+
+static void cycle(void)
+{
+    for (int i = 0; i < NCYCLE; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("  FAIL: fork\n");
+            exit(1);
+        }
+        if (pid == 0)
+            exit(0);
+        if (wait(0) != pid) {
+            printf("  FAIL: wait\n");
+            exit(1);
+        }
+    }
+}
+
+static void batch(void)
+{
+    for (int r = 0; r < NROUND; r++) {
+        for (int i = 0; i < NBATCH; i++) {
+            int pid = fork();
+            if (pid < 0) {
+                printf("  FAIL: fork\n");
+                exit(1);
+            }
+            if (pid == 0)
+                exit(0);
+        }
+        for (int i = 0; i < NBATCH; i++) {
+            if (wait(0) < 0) {
+                printf("  FAIL: wait\n");
+                exit(1);
+            }
+        }
+    }
+}
+
+// the child forks a grandchild and exits at once, so the grandchild
+// is handed to init and exits there.
+static void orphan(void)
+{
+    for (int i = 0; i < NORPHAN; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("  FAIL: fork\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            fork();
+            exit(0);
+        }
+        if (wait(0) != pid) {
+            printf("  FAIL: wait\n");
+            exit(1);
+        }
+    }
+}
+
+// run fn in nw worker processes at once; return ticks taken.
+static int run(void (*fn)(void), int nw)
+{
+    int st, n = 0;
+
+    int t0 = timer_start();
+    for (int i = 0; i < nw; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("  FAIL: fork worker\n");
+            break;
+        }
+        if (pid == 0) {
+            fn();
+            exit(0);
+        }
+        n++;
+    }
+    for (int i = 0; i < n; i++) {
+        if (wait(&st) < 0 || st != 0)
+            fail = 1;
+    }
+    return timer_elapsed(t0);
+}
+
+static void report(const char *what, int nw, int per, int dt)
+{
+    int total = nw * per;
+
+    printf("  workers=%d  %s=%d  ticks=%d", nw, what, total, dt);
+    if (dt > 0)
+        printf("  per_sec=%d", total * 10 / dt);
+    printf("\n");
+}
+
+static void test(const char *title, void (*fn)(void), const char *what, int per)
+{
+    static const int counts[] = {1, 2, 4, MAXW};
+
+    printf("\n=== %s ===\n", title);
+    for (int c = 0; c < 4; c++)
+        report(what, counts[c], per, run(fn, counts[c]));
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("===== FORK/EXIT/WAIT BENCHMARK =====\n");
+
+    test("Test 1: fork, exit, wait one child at a time", cycle, "forks", NCYCLE);
+    test("Test 2: fork 32 children, then wait for all", batch, "forks",
+         NROUND * NBATCH);
+    test("Test 3: orphans reparented to init", orphan, "orphans", NORPHAN);
+
+    if (fail)
+        printf("\n  FAIL: a worker failed\n");
+    printf("\n===== BENCHMARK DONE =====\n");
+    exit(fail);
+}
@@ -0,0 +1,215 @@
+// Lock contention benchmark.
+// Compares a test-and-set spin lock against the futex-based
+// mutex in ulib, and a condition-variable handoff against a
+// pipe, with several threads of one process.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define MAXT     8
+#define NUNCONT  1000000    // uncontended lock/unlock pairs
+#define NINC     20000      // critical sections per thread
+#define NPING    5000       // handoff round trips
+
+// ---- timing helpers ----
+static int timer_start(void) { return uptime(); }
+static int timer_elapsed(int start) { return uptime() - start; }
+
+static int spin;
+static struct mutex mu;
+static volatile int counter;
+static volatile int go;
+
+static void spin_lock(int *l)
+{
+    while (__sync_lock_test_and_set(l, 1) != 0)
+        ;
+}
+
+static void spin_unlock(int *l)
+{
+    __sync_lock_release(l);
+}
+
+// a short critical section, so the lock is what's measured.
+static void critical(void)
+{
+    for (int i = 0; i < 10; i++)
+        counter++;
+}
+
+static void worker_spin(void *a)
+{
+    (void)a;
+    while (!go)
+        ;
+    for (int i = 0; i < NINC; i++) {
+        spin_lock(&spin);
+        critical();
+        spin_unlock(&spin);
+    }
+}
+
+static void worker_mutex(void *a)
+{
+    (void)a;
+    while (!go)
+        ;
+    for (int i = 0; i < NINC; i++) {
+        mutex_lock(&mu);
+        critical();
+        mutex_unlock(&mu);
+    }
+}
+
+// ---- Test 1: uncontended cost ----
+static void test_uncontended(void)
+{
+    printf("\n=== Test 1: Uncontended lock/unlock ===\n");
+
+    int t0 = timer_start();
+    for (int i = 0; i < NUNCONT; i++) {
+        spin_lock(&spin);
+        spin_unlock(&spin);
+    }
+    printf("  spin   N=%d  ticks=%d\n", NUNCONT, timer_elapsed(t0));
+
+    t0 = timer_start();
+    for (int i = 0; i < NUNCONT; i++) {
+        mutex_lock(&mu);
+        mutex_unlock(&mu);
+    }
+    printf("  mutex  N=%d  ticks=%d\n", NUNCONT, timer_elapsed(t0));
+}
+
+// ---- Test 2: contended counter ----
+static int run(void (*fn)(void *), int nt)
+{
+    int tids[MAXT];
+    int n = 0;
+
+    go = 0;
+    counter = 0;
+    for (int i = 0; i < nt; i++) {
+        if ((tids[i] = thread_create(fn, 0)) < 0) {
+            printf("  FAIL: thread_create\n");
+            break;
+        }
+        n++;
+    }
+    int t0 = timer_start();
+    go = 1;
+    for (int i = 0; i < n; i++)
+        thread_join(tids[i]);
+    int dt = timer_elapsed(t0);
+
+    if (counter != n * NINC * 10)
+        printf("  FAIL: counter=%d, want %d\n", counter, n * NINC * 10);
+    return dt;
+}
+
+static void test_contended(void)
+{
+    static const int counts[] = {1, 2, 4, 8};
+
+    printf("\n=== Test 2: Contended counter (%d sections/thread) ===\n", NINC);
+    for (int c = 0; c < 4; c++) {
+        int nt = counts[c];
+        int ds = run(worker_spin, nt);
+        int dm = run(worker_mutex, nt);
+        printf("  threads=%d  spin_ticks=%d  mutex_ticks=%d\n", nt, ds, dm);
+    }
+}
+
+// ---- Test 3: handoff between two threads ----
+static struct cond cv;
+static volatile int turn;
+static int pp[2], pq[2];
+
+static void pong_cond(void *a)
+{
+    (void)a;
+    mutex_lock(&mu);
+    for (int i = 0; i < NPING; i++) {
+        while (turn != 1)
+            cond_wait(&cv, &mu);
+        turn = 0;
+        cond_signal(&cv);
+    }
+    mutex_unlock(&mu);
+}
+
+static void pong_pipe(void *a)
+{
+    char b;
+
+    (void)a;
+    for (int i = 0; i < NPING; i++) {
+        if (read(pp[0], &b, 1) != 1)
+            break;
+        write(pq[1], &b, 1);
+    }
+}
+
+static void test_handoff(void)
+{
+    char b = 0;
+
+    printf("\n=== Test 3: Two-thread handoff ===\n");
+
+    turn = 0;
+    int tid = thread_create(pong_cond, 0);
+    if (tid < 0) {
+        printf("  FAIL: thread_create\n");
+        return;
+    }
+    int t0 = timer_start();
+    mutex_lock(&mu);
+    for (int i = 0; i < NPING; i++) {
+        turn = 1;
+        cond_signal(&cv);
+        while (turn != 0)
+            cond_wait(&cv, &mu);
+    }
+    mutex_unlock(&mu);
+    int dt = timer_elapsed(t0);
+    thread_join(tid);
+    printf("  condvar  round trips=%d  ticks=%d\n", NPING, dt);
+
+    if (pipe(pp) < 0 || pipe(pq) < 0) {
+        printf("  FAIL: pipe\n");
+        return;
+    }
+    tid = thread_create(pong_pipe, 0);
+    if (tid < 0) {
+        printf("  FAIL: thread_create\n");
+        return;
+    }
+    t0 = timer_start();
+    for (int i = 0; i < NPING; i++) {
+        write(pp[1], &b, 1);
+        if (read(pq[0], &b, 1) != 1)
+            break;
+    }
+    dt = timer_elapsed(t0);
+    thread_join(tid);
+    printf("  pipe     round trips=%d  ticks=%d\n", NPING, dt);
+    close(pp[0]);
+    close(pp[1]);
+    close(pq[0]);
+    close(pq[1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("===== LOCK CONTENTION BENCHMARK =====\n");
+
+    test_uncontended();
+    test_contended();
+    test_handoff();
+
+    printf("\n===== BENCHMARK DONE =====\n");
+    exit(0);
+}
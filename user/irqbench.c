@@ -0,0 +1,142 @@
+// Disk interrupt routing benchmark.
+// NP processes each rewrite their own small file, so every write
+// commits the log and waits for disk writes, with the disk's
+// interrupt routed to every hart, to hart 0 only, and to one other
+// hart; then to every hart again with the completion work done in
+// the interrupt handler instead of deferred.  For each it prints
+// the ticks, the disk requests and their latency (mean, standard
+// deviation, worst) from irqstat(), the time spent in interrupt
+// handlers with interrupts off (total and worst) and in deferred
+// work, and how many disk interrupts each hart took.  Run it at
+// CPUS=4 (make qemu CPUS=4); on one CPU there is nowhere else to
+// route to.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/memlayout.h"
+#include "kernel/irqstat.h"
+#include "user/user.h"
+
+#define NP       4
+#define NWRITE   100        // overwrites per process
+#define WSZ      1024
+
+static char buf[WSZ];
+static struct irqstat a, b;
+static int fail;
+
+// ---- timing helpers ----
+static int timer_start(void) { return uptime(); }
+static int timer_elapsed(int start) { return uptime() - start; }
+
+static uint64 isqrt(uint64 x)
+{
+    uint64 r = x, s;
+
+    if (x < 2)
+        return x;
+    for (;;) {
+        s = (r + x / r) / 2;
+        if (s >= r)
+            return r;
+        r = s;
+    }
+}
+
+static void writer(int id)
+{
+    char name[16];
+    int fd;
+
+    strcpy(name, "irqbench.0");
+    name[9] = '0' + id;
+    for (int i = 0; i < NWRITE; i++) {
+        if ((fd = open(name, O_CREATE | O_WRONLY | O_TRUNC)) < 0 ||
+            write(fd, buf, WSZ) != WSZ)
+            exit(1);
+        close(fd);
+    }
+    unlink(name);
+    exit(0);
+}
+
+static int run(void)
+{
+    int st, t0 = timer_start();
+
+    for (int i = 0; i < NP; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("  FAIL: fork\n");
+            exit(1);
+        }
+        if (pid == 0)
+            writer(i);
+    }
+    for (int i = 0; i < NP; i++) {
+        if (wait(&st) < 0 || st != 0)
+            fail = 1;
+    }
+    return timer_elapsed(t0);
+}
+
+static void test(const char *title, int mask, int defer)
+{
+    printf("\n=== %s ===\n", title);
+    irqaffinity(VIRTIO0_IRQ, mask);
+    irqstat(&a, defer);
+    int dt = run();
+    irqstat(&b, -1);
+
+    uint64 n = b.nio - a.nio;
+    uint64 mean = 0, sd = 0;
+    if (n > 0) {
+        mean = (b.iotime - a.iotime) / n;
+        uint64 sq = (b.iotime2 - a.iotime2) / n;
+        sd = sq > mean * mean ? isqrt(sq - mean * mean) : 0;
+    }
+    printf("  ticks=%d  ios=%d  mean_us=%d  sd_us=%d  max_us=%d\n",
+           dt, (int)n, (int)(mean / 10), (int)(sd / 10), (int)(b.iomax / 10));
+    printf("  irqoff_us=%d  irqoff_max_us=%d  deferred=%d  deferred_us=%d\n",
+           (int)((b.hardtime - a.hardtime) / 10), (int)(b.hardmax / 10),
+           (int)(b.nsoft - a.nsoft), (int)((b.softtime - a.softtime) / 10));
+    printf("  disk irqs by hart:");
+    for (int c = 0; c < NCPU; c++) {
+        uint64 k = b.count[c][VIRTIO0_IRQ] - a.count[c][VIRTIO0_IRQ];
+        if (k > 0)
+            printf("  %d:%d", c, (int)k);
+    }
+    printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    int old, h;
+
+    printf("===== DISK INTERRUPT ROUTING BENCHMARK (%d procs) =====\n", NP);
+    memset(buf, 'x', sizeof(buf));
+    if ((old = irqaffinity(VIRTIO0_IRQ, 0)) < 0) {
+        printf("  FAIL: irqaffinity\n");
+        exit(1);
+    }
+
+    test("Test 1: disk interrupt to every hart", ALLHARTS, 1);
+    test("Test 2: disk interrupt to hart 0", 1 << 0, 1);
+    // the highest-numbered hart that is up.
+    for (h = NCPU - 1; h > 0; h--)
+        if (irqaffinity(VIRTIO0_IRQ, 1 << h) >= 0)
+            break;
+    if (h > 0)
+        test("Test 3: disk interrupt to the last hart", 1 << h, 1);
+    test("Test 4: every hart, work done in the handler", ALLHARTS, 0);
+
+    irqstat(0, 1);
+    irqaffinity(VIRTIO0_IRQ, old);
+    if (fail)
+        printf("\n  FAIL: a process failed\n");
+    printf("\n===== BENCHMARK DONE =====\n");
+    exit(fail);
+}
@@ -0,0 +1,201 @@
+// ktrace: record kernel tracepoints to a file.
+//
+//   ktrace on cats             enable categories, e.g. sched,syscall
+//   ktrace off                 disable all categories
+//   ktrace dump file           move what the rings hold into file
+//   ktrace run file cats cmd ...
+//                              record cats while cmd runs, into file
+//   ktrace print file          print file as text, one record per
+//                              line, for host/trace2json
+//
+// Categories are sched, wakeup, fault, bio, virtio, syscall and
+// all.  The records of each CPU's ring are written in order, one
+// ring after another; trace2json sorts them by time.  See
+// kernel/trace.h for the record format.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+#define NREC 128
+#define NELEM(x) (sizeof(x)/sizeof((x)[0]))
+
+struct tracerec recs[NREC];
+
+struct {
+  char *name;
+  int mask;
+} cats[] = {
+  { "sched",   TC_SCHED },
+  { "wakeup",  TC_WAKEUP },
+  { "fault",   TC_FAULT },
+  { "bio",     TC_BIO },
+  { "virtio",  TC_VIRTIO },
+  { "syscall", TC_SYSCALL },
+  { "all",     TC_ALL },
+};
+
+void
+usage(void)
+{
+  fprintf(2, "usage: ktrace on cats | off | dump file | run file cats cmd ... | print file\n");
+  exit(1);
+}
+
+// parse a comma-separated list of category names.
+int
+parsecats(char *s)
+{
+  int mask = 0, i, n;
+
+  while(*s){
+    for(n = 0; s[n] && s[n] != ','; n++)
+      ;
+    for(i = 0; i < NELEM(cats); i++)
+      if(strlen(cats[i].name) == n && memcmp(cats[i].name, s, n) == 0)
+        break;
+    if(i == NELEM(cats)){
+      fprintf(2, "ktrace: unknown category in %s\n", s);
+      exit(1);
+    }
+    mask |= cats[i].mask;
+    s += n;
+    if(*s == ',')
+      s++;
+  }
+  return mask;
+}
+
+int
+create(char *file)
+{
+  int fd;
+
+  if((fd = open(file, O_CREATE | O_WRONLY | O_TRUNC)) < 0){
+    fprintf(2, "ktrace: cannot create %s\n", file);
+    exit(1);
+  }
+  return fd;
+}
+
+// copy records from every CPU's ring to fd.  if follow, keep going
+// until tracing is off and the rings are empty; otherwise make one
+// pass.  a short read ends a CPU's turn, since with syscall tracing
+// on every read adds records of its own.
+int
+drain(int fd, int follow)
+{
+  int c, n, got, live, total = 0;
+
+  for(;;){
+    got = live = 0;
+    for(c = 0; c < NCPU; c++){
+      do {
+        if((n = ktrace(KTRACE_READ, c, recs, NREC)) < 0)
+          break;
+        live = 1;
+        if(write(fd, recs, n * sizeof(struct tracerec)) != n * sizeof(struct tracerec)){
+          fprintf(2, "ktrace: write error\n");
+          exit(1);
+        }
+        got += n;
+      } while(n == NREC);
+    }
+    total += got;
+    if(!follow || !live)
+      break;
+    if(got < NREC)
+      pause(1);
+  }
+  return total;
+}
+
+int
+dropped(void)
+{
+  int c, n = 0;
+
+  for(c = 0; c < NCPU; c++)
+    n += ktrace(KTRACE_DROPPED, c, 0, 0);
+  return n;
+}
+
+void
+run(char *file, int mask, char **argv)
+{
+  int fd, drainer, pid, n;
+
+  fd = create(file);
+  ktrace(KTRACE_ENABLE, mask, 0, 0);
+
+  // a second process empties the rings while cmd runs, so that
+  // a long run doesn't overflow them.  its own system calls show
+  // up in the trace too.
+  if((drainer = fork()) == 0){
+    n = drain(fd, 1);
+    printf("ktrace: %d records, %d dropped\n", n, dropped());
+    exit(0);
+  }
+  close(fd);
+
+  if((pid = fork()) == 0){
+    exec(argv[0], argv);
+    fprintf(2, "ktrace: exec %s failed\n", argv[0]);
+    exit(1);
+  }
+  if(pid > 0)
+    wait(0);
+  ktrace(KTRACE_ENABLE, 0, 0, 0);
+  if(drainer > 0)
+    wait(0);
+}
+
+void
+print(char *file)
+{
+  int fd, n, i;
+
+  if((fd = open(file, O_RDONLY)) < 0){
+    fprintf(2, "ktrace: cannot open %s\n", file);
+    exit(1);
+  }
+  printf("# ev cpu pid ts a b\n");
+  while((n = read(fd, recs, sizeof(recs))) > 0){
+    for(i = 0; i < n / sizeof(struct tracerec); i++){
+      struct tracerec *t = &recs[i];
+      printf("tr %d %d %d %lu %lx %lx\n",
+             t->ev, t->cpu, t->pid, t->ts, t->a, t->b);
+    }
+  }
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, n;
+
+  if(argc < 2)
+    usage();
+
+  if(strcmp(argv[1], "on") == 0 && argc == 3){
+    ktrace(KTRACE_ENABLE, parsecats(argv[2]), 0, 0);
+  } else if(strcmp(argv[1], "off") == 0){
+    ktrace(KTRACE_ENABLE, 0, 0, 0);
+  } else if(strcmp(argv[1], "dump") == 0 && argc == 3){
+    fd = create(argv[2]);
+    n = drain(fd, 0);
+    close(fd);
+    printf("ktrace: %d records, %d dropped\n", n, dropped());
+  } else if(strcmp(argv[1], "run") == 0 && argc >= 5){
+    run(argv[2], parsecats(argv[3]), argv + 4);
+  } else if(strcmp(argv[1], "print") == 0 && argc == 3){
+    print(argv[2]);
+  } else {
+    usage();
+  }
+  exit(0);
+}
@@ -0,0 +1,144 @@
+// Sleep-lock benchmark.
+// Runs workloads that hammer buffer locks (bget) and inode locks
+// (ilock) from 4 processes, once with sleep locks blocking at once
+// and once spinning first on a running holder, and prints the
+// ticks and the sleepstat() counters for each.  Run it at CPUS=4
+// (make qemu CPUS=4); on one CPU a holder is never running while
+// someone waits, so nothing spins.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/sleepstat.h"
+#include "user/user.h"
+
+#define NP       4
+#define FILESZ   (16*1024)
+#define NREAD    200        // passes over the file per process, test 1
+#define NOPEN    2000       // open/fstat/close per process, test 2
+#define NWRITE   200        // small overwrites per process, test 3
+
+static char buf[4096];
+static char *file = "lockbench.tmp";
+
+// ---- timing helpers ----
+static int timer_start(void) { return uptime(); }
+static int timer_elapsed(int start) { return uptime() - start; }
+
+static void make_file(void)
+{
+    int fd = open(file, O_CREATE | O_WRONLY | O_TRUNC);
+    if (fd < 0) {
+        printf("  FAIL: create %s\n", file);
+        exit(1);
+    }
+    memset(buf, 'x', sizeof(buf));
+    for (int n = 0; n < FILESZ; n += sizeof(buf)) {
+        if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+            printf("  FAIL: write %s\n", file);
+            exit(1);
+        }
+    }
+    close(fd);
+}
+
+// every block read is a bget/brelse of a buffer the others want.
+static void reader(void)
+{
+    for (int i = 0; i < NREAD; i++) {
+        int fd = open(file, O_RDONLY);
+        if (fd < 0)
+            exit(1);
+        while (read(fd, buf, sizeof(buf)) > 0)
+            ;
+        close(fd);
+    }
+    exit(0);
+}
+
+// open takes the inode lock exclusive; fstat shared.
+static void opener(void)
+{
+    struct stat st;
+
+    for (int i = 0; i < NOPEN; i++) {
+        int fd = open(file, O_RDONLY);
+        if (fd < 0 || fstat(fd, &st) < 0)
+            exit(1);
+        close(fd);
+    }
+    exit(0);
+}
+
+// overwrite the first block: exclusive ilock, bget, and the log.
+static void writer(void)
+{
+    for (int i = 0; i < NWRITE; i++) {
+        int fd = open(file, O_WRONLY);
+        if (fd < 0 || write(fd, buf, 64) != 64)
+            exit(1);
+        close(fd);
+    }
+    exit(0);
+}
+
+// run fn in NP processes; return ticks taken.
+static int run(void (*fn)(void))
+{
+    int st, n = 0, bad = 0;
+
+    int t0 = timer_start();
+    for (int i = 0; i < NP; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("  FAIL: fork\n");
+            break;
+        }
+        if (pid == 0)
+            fn();
+        n++;
+    }
+    for (int i = 0; i < n; i++) {
+        if (wait(&st) < 0 || st != 0)
+            bad = 1;
+    }
+    if (bad)
+        printf("  FAIL: a process failed\n");
+    return timer_elapsed(t0);
+}
+
+static void test(const char *title, void (*fn)(void))
+{
+    struct sleepstat a, b;
+
+    printf("\n=== %s ===\n", title);
+    for (int spin = 0; spin <= 1; spin++) {
+        sleepstat(&a, spin);
+        int dt = run(fn);
+        sleepstat(&b, -1);
+        printf("  spin=%s  ticks=%d  acquires=%d  contended=%d  sleeps=%d",
+               spin ? "on " : "off", dt, (int)(b.acquires - a.acquires),
+               (int)(b.contended - a.contended), (int)(b.sleeps - a.sleeps));
+        if (spin)
+            printf("  spins=%d  spinwins=%d  spin_us=%d",
+                   (int)(b.spins - a.spins), (int)(b.spinwins - a.spinwins),
+                   (int)((b.spintime - a.spintime) / 10));
+        printf("\n");
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("===== SLEEP LOCK BENCHMARK (%d procs) =====\n", NP);
+    make_file();
+
+    test("Test 1: read one 16 KB file (bget)", reader);
+    test("Test 2: open, fstat, close one file (ilock)", opener);
+    test("Test 3: overwrite one block (ilock, bget, log)", writer);
+
+    sleepstat(0, 1);
+    unlink(file);
+    printf("\n===== BENCHMARK DONE =====\n");
+    exit(0);
+}
@@ -4,6 +4,8 @@
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
 
+#define NDS 32   // entries per dirstat() call
+
 char*
 fmtname(char *path)
 {
@@ -27,9 +29,8 @@ fmtname(char *path)
 void
 ls(char *path)
 {
-  char buf[512], *p;
-  int fd;
-  struct dirent de;
+  static struct dirstat ds[NDS];
+  int fd, i, n;
   struct stat st;
 
   if((fd = open(path, O_RDONLY)) < 0){
@@ -50,24 +51,14 @@ ls(char *path)
     break;
 
   case T_DIR:
-    if(strlen(path) + 1 + DIRSIZ + 1 > sizeof buf){
-      printf("ls: path too long\n");
-      break;
-    }
-    strcpy(buf, path);
-    p = buf+strlen(buf);
-    *p++ = '/';
-    while(read(fd, &de, sizeof(de)) == sizeof(de)){
-      if(de.inum == 0)
-        continue;
-      memmove(p, de.name, DIRSIZ);
-      p[DIRSIZ] = 0;
-      if(stat(buf, &st) < 0){
-        printf("ls: cannot stat %s\n", buf);
-        continue;
-      }
-      printf("%s %d %d %d\n", fmtname(buf), st.type, st.ino, (int) st.size);
+    // the names and stats of a batch of entries per call.
+    while((n = dirstat(fd, ds, NDS)) > 0){
+      for(i = 0; i < n; i++)
+        printf("%s %d %d %d\n", fmtname(ds[i].name), ds[i].st.type,
+               ds[i].st.ino, (int) ds[i].st.size);
     }
+    if(n < 0)
+      printf("ls: cannot read %s\n", path);
     break;
   }
   close(fd);
@@ -0,0 +1,178 @@
+// Directory listing benchmark.
+// Lists a directory the way ls does, three ways: read() of raw
+// dirents and a stat() (open, fstat, close) per name, as ls used
+// to; getdents() and a stat() per name; and dirstat(), which
+// returns the names and stats together.  Runs on a 100-file
+// directory on the disk and a 1000-file one in /tmp.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NBATCH   32         // entries per getdents/dirstat call
+
+// ---- timing helpers ----
+static int timer_start(void) { return uptime(); }
+static int timer_elapsed(int start) { return uptime() - start; }
+
+static int fail;
+static char path[64];
+static struct dirent des[NBATCH];
+static struct dirstat dss[NBATCH];
+
+// path = dir/name; name is a dirent name, maybe not NUL-terminated.
+static void mkpath(const char *dir, const char *name)
+{
+    char *p;
+
+    strcpy(path, dir);
+    p = path + strlen(path);
+    *p++ = '/';
+    memmove(p, name, DIRSIZ);
+    p[DIRSIZ] = 0;
+}
+
+static void setup(const char *dir, int n)
+{
+    char name[DIRSIZ];
+    int fd;
+
+    if (mkdir(dir) < 0) {
+        printf("  FAIL: mkdir %s\n", dir);
+        exit(1);
+    }
+    for (int i = 0; i < n; i++) {
+        name[0] = 'f';
+        name[1] = '0' + i / 1000 % 10;
+        name[2] = '0' + i / 100 % 10;
+        name[3] = '0' + i / 10 % 10;
+        name[4] = '0' + i % 10;
+        name[5] = 0;
+        mkpath(dir, name);
+        if ((fd = open(path, O_CREATE | O_WRONLY)) < 0) {
+            printf("  FAIL: create %s\n", path);
+            exit(1);
+        }
+        close(fd);
+    }
+}
+
+static void cleanup(const char *dir, int n)
+{
+    char name[DIRSIZ];
+
+    for (int i = 0; i < n; i++) {
+        name[0] = 'f';
+        name[1] = '0' + i / 1000 % 10;
+        name[2] = '0' + i / 100 % 10;
+        name[3] = '0' + i / 10 % 10;
+        name[4] = '0' + i % 10;
+        name[5] = 0;
+        mkpath(dir, name);
+        unlink(path);
+    }
+    unlink(dir);
+}
+
+// each returns the number of entries listed.
+static int by_read(const char *dir)
+{
+    struct dirent de;
+    struct stat st;
+    int fd, n = 0;
+
+    if ((fd = open(dir, O_RDONLY)) < 0)
+        return -1;
+    while (read(fd, &de, sizeof(de)) == sizeof(de)) {
+        if (de.inum == 0)
+            continue;
+        mkpath(dir, de.name);
+        if (stat(path, &st) < 0)
+            fail = 1;
+        n++;
+    }
+    close(fd);
+    return n;
+}
+
+static int by_getdents(const char *dir)
+{
+    struct stat st;
+    int fd, k, n = 0;
+
+    if ((fd = open(dir, O_RDONLY)) < 0)
+        return -1;
+    while ((k = getdents(fd, des, NBATCH)) > 0) {
+        for (int i = 0; i < k; i++) {
+            mkpath(dir, des[i].name);
+            if (stat(path, &st) < 0)
+                fail = 1;
+        }
+        n += k;
+    }
+    close(fd);
+    return n;
+}
+
+static int by_dirstat(const char *dir)
+{
+    int fd, k, n = 0;
+
+    if ((fd = open(dir, O_RDONLY)) < 0)
+        return -1;
+    while ((k = dirstat(fd, dss, NBATCH)) > 0) {
+        for (int i = 0; i < k; i++)
+            if (dss[i].st.type == 0)
+                fail = 1;
+        n += k;
+    }
+    close(fd);
+    return n;
+}
+
+static void test(const char *title, const char *dir, int nfile, int reps)
+{
+    static struct {
+        const char *name;
+        int (*fn)(const char *);
+    } ways[] = {
+        { "read+stat    ", by_read },
+        { "getdents+stat", by_getdents },
+        { "dirstat      ", by_dirstat },
+    };
+
+    printf("\n=== %s ===\n", title);
+    setup(dir, nfile);
+    for (int w = 0; w < 3; w++) {
+        int n = 0;
+        int t0 = timer_start();
+        for (int r = 0; r < reps; r++)
+            n += ways[w].fn(dir);
+        int dt = timer_elapsed(t0);
+        if (n != reps * (nfile + 2)) {
+            printf("  FAIL: %s listed %d entries\n", ways[w].name, n);
+            fail = 1;
+        }
+        printf("  %s  entries=%d  ticks=%d", ways[w].name, n, dt);
+        if (dt > 0)
+            printf("  per_sec=%d", n * 10 / dt);
+        printf("\n");
+    }
+    cleanup(dir, nfile);
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("===== DIRECTORY LISTING BENCHMARK =====\n");
+
+    test("Test 1: 100 files on the disk", "lsbench.d", 100, 20);
+    test("Test 2: 1000 files in /tmp", "/tmp/lsbench.d", 1000, 5);
+
+    if (fail)
+        printf("\n  FAIL: a listing was wrong\n");
+    printf("\n===== BENCHMARK DONE =====\n");
+    exit(fail);
+}
@@ -0,0 +1,238 @@
+// malloc benchmark: the size-class allocator in umalloc.c against
+// the K&R first-fit free list it replaced (copied below).
+//
+// Each workload runs in a fresh child for each allocator, so both
+// start from an empty heap.  Reports ops/sec (a tick is ~100 ms),
+// the heap size at its peak, and what is left after freeing
+// everything.  Heap size is sbrk(0) growth, which bounds RSS: lazily
+// allocated pages are only resident once touched.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NSLOT   1024
+#define NOPS    100000
+
+// ---- the old allocator ----
+typedef long Align;
+
+union header {
+    struct {
+        union header *ptr;
+        uint size;
+    } s;
+    Align x;
+};
+
+typedef union header Header;
+
+static Header base;
+static Header *freep;
+
+static void kr_free(void *ap)
+{
+    Header *bp, *p;
+
+    bp = (Header*)ap - 1;
+    for (p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
+        if (p >= p->s.ptr && (bp > p || bp < p->s.ptr))
+            break;
+    if (bp + bp->s.size == p->s.ptr) {
+        bp->s.size += p->s.ptr->s.size;
+        bp->s.ptr = p->s.ptr->s.ptr;
+    } else
+        bp->s.ptr = p->s.ptr;
+    if (p + p->s.size == bp) {
+        p->s.size += bp->s.size;
+        p->s.ptr = bp->s.ptr;
+    } else
+        p->s.ptr = bp;
+    freep = p;
+}
+
+static Header *morecore(uint nu)
+{
+    char *p;
+    Header *hp;
+
+    if (nu < 4096)
+        nu = 4096;
+    p = sbrk(nu * sizeof(Header));
+    if (p == SBRK_ERROR)
+        return 0;
+    hp = (Header*)p;
+    hp->s.size = nu;
+    kr_free((void*)(hp + 1));
+    return freep;
+}
+
+static void *kr_malloc(uint nbytes)
+{
+    Header *p, *prevp;
+    uint nunits;
+
+    nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+    if ((prevp = freep) == 0) {
+        base.s.ptr = freep = prevp = &base;
+        base.s.size = 0;
+    }
+    for (p = prevp->s.ptr; ; prevp = p, p = p->s.ptr) {
+        if (p->s.size >= nunits) {
+            if (p->s.size == nunits)
+                prevp->s.ptr = p->s.ptr;
+            else {
+                p->s.size -= nunits;
+                p += p->s.size;
+                p->s.size = nunits;
+            }
+            freep = prevp;
+            return (void*)(p + 1);
+        }
+        if (p == freep)
+            if ((p = morecore(nunits)) == 0)
+                return 0;
+    }
+}
+
+// ---- harness ----
+struct allocator {
+    const char *name;
+    void *(*alloc)(uint);
+    void (*release)(void *);
+};
+
+static struct allocator allocs[] = {
+    {"k&r",   kr_malloc, kr_free},
+    {"class", malloc,    free},
+};
+#define NALLOC 2
+
+static uint64 rnd_state = 1;
+
+static uint rnd(void)
+{
+    rnd_state = rnd_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return rnd_state >> 33;
+}
+
+// mostly small, now and then a few pages.
+static uint rnd_size(void)
+{
+    uint r = rnd();
+    if (r % 16 == 0)
+        return 1024 + r % (16 * 1024);
+    return 8 + r % 504;
+}
+
+static void *slot[NSLOT];
+static char *heap0, *heap_peak;
+
+static void note_peak(void)
+{
+    char *p = sbrk(0);
+    if (p > heap_peak)
+        heap_peak = p;
+}
+
+// Test 1: malloc/free pairs of one small size.
+static int w_pairs(struct allocator *a)
+{
+    for (int i = 0; i < NOPS; i++) {
+        char *p = a->alloc(32);
+        p[0] = i;
+        a->release(p);
+    }
+    note_peak();
+    return 2 * NOPS;
+}
+
+// Test 2: random sizes, replacing random slots of a live set.
+static int w_churn(struct allocator *a)
+{
+    for (int i = 0; i < NSLOT; i++) {
+        slot[i] = a->alloc(rnd_size());
+        *(char *)slot[i] = 1;
+    }
+    for (int i = 0; i < NOPS; i++) {
+        int k = rnd() % NSLOT;
+        a->release(slot[k]);
+        slot[k] = a->alloc(rnd_size());
+        *(char *)slot[k] = 1;
+        if (i % 4096 == 0)
+            note_peak();
+    }
+    for (int i = 0; i < NSLOT; i++)
+        a->release(slot[i]);
+    return NSLOT * 2 + NOPS * 2;
+}
+
+// Test 3: build up a big live set in phases of growing blocks,
+// freeing every other block each time, then free it all.
+static int w_phases(struct allocator *a)
+{
+    int ops = 0;
+
+    for (int ph = 0; ph < 4; ph++) {
+        uint sz = 64 << (2 * ph);  // 64, 256, 1K, 4K
+        for (int i = 0; i < NSLOT; i++) {
+            if (slot[i] && (i & 1) == 0)
+                continue;
+            if (slot[i]) {
+                a->release(slot[i]);
+                ops++;
+            }
+            slot[i] = a->alloc(sz);
+            memset(slot[i], 0, sz);
+            ops++;
+        }
+        note_peak();
+    }
+    for (int i = 0; i < NSLOT; i++) {
+        a->release(slot[i]);
+        slot[i] = 0;
+        ops++;
+    }
+    return ops;
+}
+
+static void run(const char *wname, int (*w)(struct allocator *))
+{
+    printf("\n=== %s ===\n", wname);
+    for (int k = 0; k < NALLOC; k++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("  FAIL: fork\n");
+            return;
+        }
+        if (pid == 0) {
+            heap0 = heap_peak = sbrk(0);
+            int t0 = uptime();
+            int ops = w(&allocs[k]);
+            int dt = uptime() - t0;
+            int peak = (heap_peak - heap0) / 1024;
+            int left = ((char *)sbrk(0) - heap0) / 1024;
+            printf("  %s  ops=%d  ticks=%d  ", allocs[k].name, ops, dt);
+            if (dt > 0)
+                printf("ops/s=%d  ", ops * 10 / dt);
+            else
+                printf("ops/s=(too fast)  ");
+            printf("peak=%dKB  after=%dKB\n", peak, left);
+            exit(0);
+        }
+        wait(0);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("===== MALLOC BENCHMARK =====\n");
+
+    run("Test 1: malloc/free pairs, 32 bytes", w_pairs);
+    run("Test 2: random sizes, live set of 1024", w_churn);
+    run("Test 3: growing phases, then free all", w_phases);
+
+    printf("\n===== BENCHMARK DONE =====\n");
+    exit(0);
+}
@@ -0,0 +1,142 @@
+// Bandwidth benchmark for memmove / memset / memcmp.
+//
+// Reports MB/s by transfer size and by (dst, src) misalignment for the
+// ulib routines, then for the kernel's copyin/copyout path (which uses
+// kernel/string.c memmove) through the slab_write / slab_read syscalls.
+// A tick is ~100 ms, so each case moves enough bytes to span many ticks.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define MAXSZ   65536
+#define TOTAL   (32*1024*1024)  // bytes moved per case
+#define KTOTAL  (8*1024*1024)   // bytes per kernel copy case
+
+static char *bufa, *bufb;
+
+static int sizes[] = {16, 256, 4096, 65536};
+#define NSIZES 4
+
+static struct { int doff, soff; } aligns[] = {
+    {0, 0},   // both 8-byte aligned
+    {3, 3},   // same misalignment (word loop after head)
+    {0, 1},   // mismatched (byte loop)
+    {5, 2},
+};
+#define NALIGNS 4
+
+enum { OP_MEMMOVE, OP_MEMSET, OP_MEMCMP };
+static const char *opnames[] = {"memmove", "memset", "memcmp"};
+
+// bytes per second -> MB/s, given bytes moved over dt ticks.
+static void print_rate(int size, int doff, int soff, uint64 bytes, int dt)
+{
+    printf("  size=%6d  dst+%d src+%d  ", size, doff, soff);
+    if (dt <= 0) {
+        printf("(too fast to time)\n");
+        return;
+    }
+    uint64 mbps = (bytes * 10) / ((uint64)dt * 1024 * 1024);
+    printf("ticks=%4d  %ld MB/s\n", dt, mbps);
+}
+
+static void bench_op(int op)
+{
+    printf("\n=== %s ===\n", opnames[op]);
+
+    for (int a = 0; a < NALIGNS; a++) {
+        // memset has no source; skip rows that repeat a dst offset.
+        if (op == OP_MEMSET && a > 0 && aligns[a].doff == aligns[0].doff)
+            continue;
+
+        char *d = bufa + aligns[a].doff;
+        char *s = bufb + aligns[a].soff;
+
+        for (int z = 0; z < NSIZES; z++) {
+            int size = sizes[z];
+            int iters = TOTAL / size;
+            volatile int sink = 0;
+
+            // memcmp over equal buffers so it scans the full length.
+            memset(bufa, 'x', MAXSZ + 16);
+            memset(bufb, 'x', MAXSZ + 16);
+
+            int t0 = uptime();
+            for (int i = 0; i < iters; i++) {
+                switch (op) {
+                case OP_MEMMOVE: memmove(d, s, size); break;
+                case OP_MEMSET:  memset(d, i, size); break;
+                case OP_MEMCMP:  sink += memcmp(d, s, size); break;
+                }
+            }
+            int dt = uptime() - t0;
+            (void)sink;
+            print_rate(size, aligns[a].doff,
+                       op == OP_MEMSET ? 0 : aligns[a].soff,
+                       (uint64)iters * size, dt);
+        }
+    }
+}
+
+// copyin/copyout between a user buffer and a kmalloc'd kernel buffer.
+static void bench_kernel(void)
+{
+    int ksizes[] = {64, 512, 4096};
+    uint64 kbuf;
+
+    printf("\n=== kernel copyin/copyout (slab_write/slab_read) ===\n");
+
+    kmem_init(0);
+    kbuf = kmalloc(4096);
+    if (!kbuf) {
+        printf("  FAIL: kmalloc\n");
+        return;
+    }
+
+    for (int a = 0; a < 3; a++) {
+        char *u = bufa + aligns[a].soff;
+        for (int z = 0; z < 3; z++) {
+            int size = ksizes[z];
+            int iters = KTOTAL / size;
+
+            int t0 = uptime();
+            for (int i = 0; i < iters; i++)
+                slab_write(kbuf, u, size);
+            int dt = uptime() - t0;
+            printf("  in  ");
+            print_rate(size, 0, aligns[a].soff, (uint64)iters * size, dt);
+
+            t0 = uptime();
+            for (int i = 0; i < iters; i++)
+                slab_read(u, kbuf, size);
+            dt = uptime() - t0;
+            printf("  out ");
+            print_rate(size, aligns[a].soff, 0, (uint64)iters * size, dt);
+        }
+    }
+
+    kfree(kbuf);
+}
+
+int
+main(int argc, char *argv[])
+{
+    bufa = malloc(MAXSZ + 16);
+    bufb = malloc(MAXSZ + 16);
+    if (!bufa || !bufb) {
+        printf("membench: malloc failed\n");
+        exit(1);
+    }
+    // malloc returns 16-byte aligned blocks; offsets above are relative.
+
+    printf("===== MEMORY BANDWIDTH BENCHMARK =====\n");
+
+    bench_op(OP_MEMMOVE);
+    bench_op(OP_MEMSET);
+    bench_op(OP_MEMCMP);
+    bench_kernel();
+
+    printf("\n===== BENCHMARK DONE =====\n");
+    exit(0);
+}
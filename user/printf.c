@@ -6,17 +6,54 @@
 
 static char digits[] = "0123456789ABCDEF";
 
+// output is collected here and written once per call, rather
+// than with a system call per character.
+struct out {
+  int fd;
+  int n;
+  char buf[128];
+};
+
+static void
+putc(struct out *o, char c)
+{
+  if(o->n == sizeof(o->buf)){
+    write(o->fd, o->buf, o->n);
+    o->n = 0;
+  }
+  o->buf[o->n++] = c;
+}
+
+static void
+flush(struct out *o)
+{
+  if(o->n > 0)
+    write(o->fd, o->buf, o->n);
+  o->n = 0;
+}
+
+// put the n characters of s, padded with spaces to width,
+// on the left unless left.
 static void
-putc(int fd, char c)
+putpad(struct out *o, const char *s, int n, int width, int left)
 {
-  write(fd, &c, 1);
+  int i;
+
+  if(!left)
+    for(i = n; i < width; i++)
+      putc(o, ' ');
+  for(i = 0; i < n; i++)
+    putc(o, s[i]);
+  if(left)
+    for(i = n; i < width; i++)
+      putc(o, ' ');
 }
 
 static void
-printint(int fd, long long xx, int base, int sgn)
+printint(struct out *o, long long xx, int base, int sgn, int width, int left)
 {
-  char buf[20];
-  int i, neg;
+  char buf[24], tmp[24];
+  int i, n, neg;
   unsigned long long x;
 
   neg = 0;
@@ -29,88 +66,103 @@ printint(int fd, long long xx, int base, int sgn)
 
   i = 0;
   do{
-    buf[i++] = digits[x % base];
+    tmp[i++] = digits[x % base];
   }while((x /= base) != 0);
   if(neg)
-    buf[i++] = '-';
+    tmp[i++] = '-';
 
-  while(--i >= 0)
-    putc(fd, buf[i]);
+  for(n = 0; --i >= 0; n++)
+    buf[n] = tmp[i];
+  putpad(o, buf, n, width, left);
 }
 
 static void
-printptr(int fd, uint64 x) {
+printptr(struct out *o, uint64 x) {
   int i;
-  putc(fd, '0');
-  putc(fd, 'x');
+  putc(o, '0');
+  putc(o, 'x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    putc(fd, digits[x >> (sizeof(uint64) * 8 - 4)]);
+    putc(o, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
-// Print to the given fd. Only understands %d, %x, %p, %c, %s.
+// Print to the given fd. Only understands %d, %x, %p, %c, %s,
+// with l/ll and u variants, and a field width, e.g. %8d or %-12s.
 void
 vprintf(int fd, const char *fmt, va_list ap)
 {
+  struct out o;
   char *s;
-  int c0, c1, c2, i, state;
+  int c0, c1, c2, i, state, width, left;
 
-  state = 0;
+  o.fd = fd;
+  o.n = 0;
+  state = width = left = 0;
   for(i = 0; fmt[i]; i++){
     c0 = fmt[i] & 0xff;
     if(state == 0){
       if(c0 == '%'){
         state = '%';
+        width = left = 0;
       } else {
-        putc(fd, c0);
+        putc(&o, c0);
       }
     } else if(state == '%'){
+      if(c0 == '-' && width == 0 && !left){
+        left = 1;
+        continue;
+      }
+      if(c0 >= '0' && c0 <= '9'){
+        width = width*10 + c0 - '0';
+        continue;
+      }
       c1 = c2 = 0;
       if(c0) c1 = fmt[i+1] & 0xff;
       if(c1) c2 = fmt[i+2] & 0xff;
       if(c0 == 'd'){
-        printint(fd, va_arg(ap, int), 10, 1);
+        printint(&o, va_arg(ap, int), 10, 1, width, left);
       } else if(c0 == 'l' && c1 == 'd'){
-        printint(fd, va_arg(ap, uint64), 10, 1);
+        printint(&o, va_arg(ap, uint64), 10, 1, width, left);
         i += 1;
       } else if(c0 == 'l' && c1 == 'l' && c2 == 'd'){
-        printint(fd, va_arg(ap, uint64), 10, 1);
+        printint(&o, va_arg(ap, uint64), 10, 1, width, left);
         i += 2;
       } else if(c0 == 'u'){
-        printint(fd, va_arg(ap, uint32), 10, 0);
+        printint(&o, va_arg(ap, uint32), 10, 0, width, left);
       } else if(c0 == 'l' && c1 == 'u'){
-        printint(fd, va_arg(ap, uint64), 10, 0);
+        printint(&o, va_arg(ap, uint64), 10, 0, width, left);
         i += 1;
       } else if(c0 == 'l' && c1 == 'l' && c2 == 'u'){
-        printint(fd, va_arg(ap, uint64), 10, 0);
+        printint(&o, va_arg(ap, uint64), 10, 0, width, left);
         i += 2;
       } else if(c0 == 'x'){
-        printint(fd, va_arg(ap, uint32), 16, 0);
+        printint(&o, va_arg(ap, uint32), 16, 0, width, left);
       } else if(c0 == 'l' && c1 == 'x'){
-        printint(fd, va_arg(ap, uint64), 16, 0);
+        printint(&o, va_arg(ap, uint64), 16, 0, width, left);
         i += 1;
       } else if(c0 == 'l' && c1 == 'l' && c2 == 'x'){
-        printint(fd, va_arg(ap, uint64), 16, 0);
+        printint(&o, va_arg(ap, uint64), 16, 0, width, left);
         i += 2;
       } else if(c0 == 'p'){
-        printptr(fd, va_arg(ap, uint64));
+        printptr(&o, va_arg(ap, uint64));
       } else if(c0 == 'c'){
-        putc(fd, va_arg(ap, uint32));
+        char c = va_arg(ap, uint32);
+        putpad(&o, &c, 1, width, left);
       } else if(c0 == 's'){
         if((s = va_arg(ap, char*)) == 0)
           s = "(null)";
-        for(; *s; s++)
-          putc(fd, *s);
+        putpad(&o, s, strlen(s), width, left);
       } else if(c0 == '%'){
-        putc(fd, '%');
+        putc(&o, '%');
       } else {
         // Unknown % sequence.  Print it to draw attention.
-        putc(fd, '%');
-        putc(fd, c0);
+        putc(&o, '%');
+        putc(&o, c0);
       }
 
       state = 0;
     }
   }
+  flush(&o);
 }
 
 void
@@ -0,0 +1,180 @@
+// Parallel performance test for slab allocator.
+// Runs the slabperf workloads from several threads of one process
+// at once, to see how the allocator scales with CPUS>1.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define MAXT    8
+#define NOPS    2048    // alloc/free pairs per thread
+#define NHELD   64      // objects each thread keeps live in Test 2
+
+// ---- timing helpers ----
+static int timer_start(void) { return uptime(); }
+static int timer_elapsed(int start) { return uptime() - start; }
+
+// threads wait for go, so they all start together.
+static volatile int go;
+static volatile int ready;
+static volatile int failed;
+
+struct targ {
+    int id;
+    kmem_cache_t cache;     // Test 3: shared or private cache
+};
+
+static void wait_for_go(void)
+{
+    __sync_fetch_and_add(&ready, 1);
+    while (!go)
+        ;
+}
+
+// ---- Test 1: alloc/free pairs, mixed sizes ----
+static void worker_pairs(void *a)
+{
+    static const int sizes[] = {16, 32, 64, 128, 256, 512, 1024};
+
+    (void)a;
+    wait_for_go();
+    for (int i = 0; i < NOPS; i++) {
+        uint64 p = kmalloc(sizes[i % 7]);
+        if (!p) { failed = 1; return; }
+        kfree(p);
+    }
+}
+
+// ---- Test 2: bulk alloc then bulk free ----
+static void worker_bulk(void *a)
+{
+    uint64 held[NHELD];
+
+    (void)a;
+    wait_for_go();
+    for (int r = 0; r < NOPS / NHELD; r++) {
+        for (int i = 0; i < NHELD; i++) {
+            held[i] = kmalloc(64);
+            if (!held[i]) { failed = 1; return; }
+        }
+        for (int i = NHELD - 1; i >= 0; i--)
+            kfree(held[i]);
+    }
+}
+
+// ---- Test 3: one cache, shared or per-thread ----
+static void worker_cache(void *a)
+{
+    struct targ *t = a;
+
+    wait_for_go();
+    for (int i = 0; i < NOPS; i++) {
+        uint64 p = kmem_cache_alloc(t->cache);
+        if (!p) { failed = 1; return; }
+        kmem_cache_free(t->cache, p);
+    }
+}
+
+// run fn in nt threads; returns elapsed ticks, or -1.
+static int run(void (*fn)(void *), struct targ *args, int nt)
+{
+    int tids[MAXT];
+    int n = 0;
+
+    go = 0;
+    ready = 0;
+    failed = 0;
+    for (int i = 0; i < nt; i++) {
+        tids[i] = thread_create(fn, &args[i]);
+        if (tids[i] < 0) {
+            printf("  FAIL: thread_create\n");
+            break;
+        }
+        n++;
+    }
+    while (ready < n)
+        ;
+
+    int t0 = timer_start();
+    go = 1;
+    for (int i = 0; i < n; i++)
+        thread_join(tids[i]);
+    int dt = timer_elapsed(t0);
+
+    if (n < nt || failed)
+        return -1;
+    return dt;
+}
+
+static void report(int nt, int dt)
+{
+    if (dt < 0) {
+        printf("  threads=%d  FAIL\n", nt);
+        return;
+    }
+    printf("  threads=%d  ops=%d  ticks=%d", nt, nt * NOPS, dt);
+    if (dt > 0)
+        printf("  ops/tick=%d", nt * NOPS / dt);
+    printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const int counts[] = {1, 2, 4, 8};
+    struct targ args[MAXT];
+    int maxt = MAXT;
+
+    if (argc > 1)
+        maxt = atoi(argv[1]);
+    if (maxt < 1 || maxt > MAXT)
+        maxt = MAXT;
+
+    // Initialize slab
+    kmem_init(0);
+
+    for (int i = 0; i < MAXT; i++)
+        args[i].id = i;
+
+    printf("===== PARALLEL SLAB PERFORMANCE TESTS =====\n");
+
+    printf("\n=== Test 1: Alloc/free pairs, mixed sizes ===\n");
+    for (int c = 0; c < 4 && counts[c] <= maxt; c++)
+        report(counts[c], run(worker_pairs, args, counts[c]));
+
+    printf("\n=== Test 2: Bulk alloc + bulk free (%d live) ===\n", NHELD);
+    for (int c = 0; c < 4 && counts[c] <= maxt; c++)
+        report(counts[c], run(worker_bulk, args, counts[c]));
+
+    printf("\n=== Test 3: One shared cache ===\n");
+    kmem_cache_t shared = kmem_cache_create("pslab_shared", 48, 0, 0);
+    if (!shared) {
+        printf("  FAIL: cache create\n");
+    } else {
+        for (int i = 0; i < MAXT; i++)
+            args[i].cache = shared;
+        for (int c = 0; c < 4 && counts[c] <= maxt; c++)
+            report(counts[c], run(worker_cache, args, counts[c]));
+        kmem_cache_destroy(shared);
+    }
+
+    printf("\n=== Test 4: A cache per thread ===\n");
+    int ok = 1;
+    for (int i = 0; i < maxt; i++) {
+        args[i].cache = kmem_cache_create("pslab_private", 48, 0, 0);
+        if (!args[i].cache)
+            ok = 0;
+    }
+    if (!ok) {
+        printf("  FAIL: cache create\n");
+    } else {
+        for (int c = 0; c < 4 && counts[c] <= maxt; c++)
+            report(counts[c], run(worker_cache, args, counts[c]));
+    }
+    for (int i = 0; i < maxt; i++)
+        if (args[i].cache)
+            kmem_cache_destroy(args[i].cache);
+
+    printf("\n===== ALL PARALLEL PERFORMANCE TESTS DONE =====\n");
+    exit(0);
+}
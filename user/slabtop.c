@@ -0,0 +1,189 @@
+// slabtop: show the kernel's slab caches, refreshed periodically.
+//
+//   slabtop [-s key] [-d ticks] [-n count]
+//
+// Every ticks clock ticks (default 10) it clears the screen and
+// prints a summary, the free blocks of each order in the buddy
+// allocator slab pages come from, and one line per cache sorted by
+// key, largest first:
+//
+//   size    bytes of slab pages held (default)
+//   objs    total objects
+//   active  objects in use
+//   allocs  allocations since the cache was made
+//   rate    allocations since the last refresh
+//   name    cache name, alphabetically
+//
+// -n stops after count refreshes; -n 1 prints once, without
+// clearing the screen.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/slabstat.h"
+#include "user/user.h"
+
+#define NELEM(x) (sizeof(x)/sizeof((x)[0]))
+
+enum { K_SIZE, K_OBJS, K_ACTIVE, K_ALLOCS, K_RATE, K_NAME };
+
+char *keys[] = { "size", "objs", "active", "allocs", "rate", "name" };
+
+struct row {
+  struct slabstat *st;
+  uint64 bytes;
+  uint64 rate;
+};
+
+struct slabstat *cur, *prev;
+struct row *rows;
+int cap, nprev;
+int key = K_SIZE;
+
+void
+usage(void)
+{
+  fprintf(2, "usage: slabtop [-s size|objs|active|allocs|rate|name] [-d ticks] [-n count]\n");
+  exit(1);
+}
+
+// fetch every cache, growing the buffers until they all fit.
+int
+snapshot(void)
+{
+  int n;
+
+  for(;;){
+    if((n = slabstat(cur, cap)) < 0){
+      fprintf(2, "slabtop: slabstat failed\n");
+      exit(1);
+    }
+    if(n < cap)
+      return n;
+    free(cur);
+    free(prev);
+    free(rows);
+    cap = cap ? cap * 2 : 64;
+    cur = malloc(cap * sizeof(struct slabstat));
+    prev = malloc(cap * sizeof(struct slabstat));
+    rows = malloc(cap * sizeof(struct row));
+    if(cur == 0 || prev == 0 || rows == 0){
+      fprintf(2, "slabtop: out of memory\n");
+      exit(1);
+    }
+    nprev = 0;
+  }
+}
+
+// allocations since the last snapshot, matching caches by name
+// and object size.
+uint64
+rate(struct slabstat *s)
+{
+  for(int i = 0; i < nprev; i++)
+    if(prev[i].obj_size == s->obj_size && strcmp(prev[i].name, s->name) == 0)
+      return s->allocs >= prev[i].allocs ? s->allocs - prev[i].allocs : 0;
+  return 0;
+}
+
+uint64
+keyval(struct row *r)
+{
+  switch(key){
+  case K_OBJS:   return r->st->total_objs;
+  case K_ACTIVE: return r->st->active_objs;
+  case K_ALLOCS: return r->st->allocs;
+  case K_RATE:   return r->rate;
+  }
+  return r->bytes;
+}
+
+// true if a belongs before b.
+int
+before(struct row *a, struct row *b)
+{
+  if(key == K_NAME)
+    return strcmp(a->st->name, b->st->name) < 0;
+  return keyval(a) > keyval(b);
+}
+
+void
+show(int n, int clear)
+{
+  struct buddystat bs;
+  struct row t;
+  uint64 held = 0;
+  int i, j, active = 0, total = 0;
+
+  for(i = 0; i < n; i++){
+    rows[i].st = &cur[i];
+    rows[i].bytes = (uint64)cur[i].slabs * ((uint64)BLOCK_SIZE << cur[i].slab_order);
+    rows[i].rate = rate(&cur[i]);
+    held += rows[i].bytes;
+    active += cur[i].active_objs;
+    total += cur[i].total_objs;
+  }
+  // insertion sort; there are tens of caches.
+  for(i = 1; i < n; i++){
+    t = rows[i];
+    for(j = i; j > 0 && before(&t, &rows[j-1]); j--)
+      rows[j] = rows[j-1];
+    rows[j] = t;
+  }
+
+  if(clear)
+    printf("\033[H\033[J");
+  printf("caches: %d  objects: %d / %d active  slab memory: %lu KB  sort: %s\n",
+         n, active, total, held / 1024, keys[key]);
+  if(buddystat(&bs) == 0 && bs.total_size){
+    printf("buddy: %lu KB  free blocks by order:", bs.total_size / 1024);
+    for(i = 0; i <= bs.max_order && i < BUDDYSTAT_ORDERS; i++)
+      printf(" %d", bs.nfree[i]);
+    printf("\n");
+  }
+  printf("\n%-20s %7s %7s %7s %5s %6s %8s %9s %7s %3s\n",
+         "NAME", "OBJSIZE", "ACTIVE", "OBJS", "USE%", "SLABS", "SIZE_KB",
+         "ALLOCS", "RATE", "ERR");
+  for(i = 0; i < n; i++){
+    struct slabstat *s = rows[i].st;
+    printf("%-20s %7lu %7d %7d %4d%% %6d %8lu %9lu %7lu %3d\n",
+           s->name, s->obj_size, s->active_objs, s->total_objs,
+           s->total_objs ? s->active_objs * 100 / s->total_objs : 0,
+           s->slabs, rows[i].bytes / 1024, s->allocs, rows[i].rate, s->error);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, delay = 10, count = 0;
+  struct slabstat *t;
+
+  for(i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-s") == 0 && i + 1 < argc){
+      i++;
+      for(key = 0; key < NELEM(keys); key++)
+        if(strcmp(argv[i], keys[key]) == 0)
+          break;
+      if(key == NELEM(keys))
+        usage();
+    } else if(strcmp(argv[i], "-d") == 0 && i + 1 < argc){
+      delay = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc){
+      count = atoi(argv[++i]);
+    } else {
+      usage();
+    }
+  }
+
+  for(i = 0; count == 0 || i < count; i++){
+    n = snapshot();
+    show(n, count != 1);
+    t = prev;
+    prev = cur;
+    cur = t;
+    nprev = n;
+    if(count == 0 || i + 1 < count)
+      pause(delay);
+  }
+  exit(0);
+}
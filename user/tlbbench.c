@@ -0,0 +1,128 @@
+// Syscall latency and context-switch benchmark.
+//
+// Every trap switches satp between the user and kernel page tables.
+// Without ASIDs that flushes the TLB, so a process that touches a
+// spread-out working set between syscalls pays for a page-table walk
+// on every page afterwards.  Compare the "touch" rows against the
+// plain syscall row to see the refill cost.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NSYS    200000
+#define NPING   20000
+
+// microseconds per op, given ticks (~100 ms each) for n ops.
+static void report(const char *what, int n, int dt)
+{
+    printf("  %s  N=%d  ticks=%d", what, n, dt);
+    if (dt > 0)
+        printf("  ~%d ns/op", (int)(((uint64)dt * 100000000UL) / n));
+    printf("\n");
+}
+
+static void bench_syscall(void)
+{
+    printf("\n=== Test 1: getpid() latency ===\n");
+
+    int t0 = uptime();
+    for (int i = 0; i < NSYS; i++)
+        getpid();
+    report("getpid", NSYS, uptime() - t0);
+}
+
+// touch one word on each of npages pages, then make a syscall.
+static void bench_touch(int npages)
+{
+    char *buf = sbrk(npages * PGSIZE);
+    if (buf == SBRK_ERROR) {
+        printf("  FAIL: sbrk\n");
+        return;
+    }
+    for (int p = 0; p < npages; p++)
+        buf[p * PGSIZE] = 1;
+
+    int n = NSYS / 4;
+    volatile int sink = 0;
+    int t0 = uptime();
+    for (int i = 0; i < n; i++) {
+        for (int p = 0; p < npages; p++)
+            sink += buf[p * PGSIZE];
+        getpid();
+    }
+    int dt = uptime() - t0;
+    (void)sink;
+
+    printf("  pages=%3d ", npages);
+    report("touch+getpid", n, dt);
+
+    sbrk(-(npages * PGSIZE));
+}
+
+// round trips of one byte between parent and child over two pipes;
+// each round trip is two context switches.
+static void bench_pingpong(void)
+{
+    int p2c[2], c2p[2];
+    char b = 0;
+
+    printf("\n=== Test 3: pipe ping-pong context switches ===\n");
+
+    if (pipe(p2c) < 0 || pipe(c2p) < 0) {
+        printf("  FAIL: pipe\n");
+        return;
+    }
+
+    int pid = fork();
+    if (pid < 0) {
+        printf("  FAIL: fork\n");
+        return;
+    }
+    if (pid == 0) {
+        close(p2c[1]);
+        close(c2p[0]);
+        for (int i = 0; i < NPING; i++) {
+            if (read(p2c[0], &b, 1) != 1)
+                break;
+            write(c2p[1], &b, 1);
+        }
+        exit(0);
+    }
+
+    close(p2c[0]);
+    close(c2p[1]);
+    int t0 = uptime();
+    for (int i = 0; i < NPING; i++) {
+        write(p2c[1], &b, 1);
+        if (read(c2p[0], &b, 1) != 1) {
+            printf("  FAIL: read\n");
+            break;
+        }
+    }
+    int dt = uptime() - t0;
+    wait(0);
+    close(p2c[1]);
+    close(c2p[0]);
+
+    report("round trip", NPING, dt);
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("===== SYSCALL / CONTEXT SWITCH BENCHMARK =====\n");
+
+    bench_syscall();
+
+    printf("\n=== Test 2: syscall after touching a working set ===\n");
+    bench_touch(1);
+    bench_touch(16);
+    bench_touch(64);
+
+    bench_pingpong();
+
+    printf("\n===== BENCHMARK DONE =====\n");
+    exit(0);
+}
@@ -0,0 +1,92 @@
+// Temporary-file benchmark.
+// Creates, writes, reads back and removes small files, the way
+// pipelines and build steps use scratch files, first in / on the
+// disk and then in /tmp, the RAM file system.  /tmp should need no
+// disk I/O at all.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NFILE    200        // files per test
+#define FSZ      2048       // bytes in each
+
+static char buf[FSZ];
+
+// ---- timing helpers ----
+static int timer_start(void) { return uptime(); }
+static int timer_elapsed(int start) { return uptime() - start; }
+
+static int fail;
+
+static void name(char *p, const char *dir, int i)
+{
+    strcpy(p, dir);
+    p += strlen(p);
+    *p++ = 'f';
+    *p++ = '0' + i / 100 % 10;
+    *p++ = '0' + i / 10 % 10;
+    *p++ = '0' + i % 10;
+    *p = 0;
+}
+
+static void report(const char *dir, const char *what, int dt)
+{
+    printf("  %s  %s=%d  ticks=%d", dir, what, NFILE, dt);
+    if (dt > 0)
+        printf("  per_sec=%d", NFILE * 10 / dt);
+    printf("\n");
+}
+
+// create/unlink only, then with a write and read-back in between.
+static void run(const char *dir)
+{
+    char path[32];
+    int fd, t0;
+
+    t0 = timer_start();
+    for (int i = 0; i < NFILE; i++) {
+        name(path, dir, i);
+        if ((fd = open(path, O_CREATE | O_WRONLY)) < 0) {
+            fail = 1;
+            break;
+        }
+        close(fd);
+        unlink(path);
+    }
+    report(dir, "create+unlink", timer_elapsed(t0));
+
+    t0 = timer_start();
+    for (int i = 0; i < NFILE; i++) {
+        name(path, dir, i);
+        if ((fd = open(path, O_CREATE | O_RDWR)) < 0 ||
+            write(fd, buf, FSZ) != FSZ) {
+            fail = 1;
+            break;
+        }
+        close(fd);
+        if ((fd = open(path, O_RDONLY)) < 0 || read(fd, buf, FSZ) != FSZ)
+            fail = 1;
+        close(fd);
+        unlink(path);
+    }
+    report(dir, "create+write+read+unlink", timer_elapsed(t0));
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("===== TEMPORARY FILE BENCHMARK =====\n");
+    memset(buf, 'x', sizeof(buf));
+
+    printf("\n=== Test 1: disk (/) ===\n");
+    run("/");
+    printf("\n=== Test 2: tmpfs (/tmp) ===\n");
+    run("/tmp/");
+
+    if (fail)
+        printf("\n  FAIL: a file operation failed\n");
+    printf("\n===== BENCHMARK DONE =====\n");
+    exit(fail);
+}
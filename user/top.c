@@ -0,0 +1,217 @@
+// top: show what each thread is costing, refreshed periodically.
+//
+//   top [-s key] [-d ticks] [-n count]
+//
+// Every ticks clock ticks (default 10) it clears the screen and
+// prints one line per thread from procstat(), sorted by key,
+// largest first:
+//
+//   cpu       share of one CPU since the last refresh (default)
+//   time      user plus system time since it started
+//   faults    page faults
+//   syscalls  system calls
+//   csw       context switches
+//   kmem      bytes of kmalloc() not yet given back with kfree()
+//   pid       process id, ascending
+//
+// Counts are totals since the thread started; %CPU is over the
+// last interval, or the thread's lifetime on the first screen.
+// -n stops after count refreshes; -n 1 prints once, without
+// clearing the screen.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/rusage.h"
+#include "user/user.h"
+
+#define NELEM(x) (sizeof(x)/sizeof((x)[0]))
+#define US_PER_TICK 100000    // the timer interrupts ten times a second
+
+enum { K_CPU, K_TIME, K_FAULTS, K_SYSCALLS, K_CSW, K_KMEM, K_PID };
+
+char *keys[] = { "cpu", "time", "faults", "syscalls", "csw", "kmem", "pid" };
+char states[] = "?USRrZ";  // unused, used, sleeping, runnable, running, zombie
+
+struct row {
+  struct procstat *ps;
+  uint64 permille;       // tenths of a percent of one CPU
+};
+
+struct procstat *cur, *prev;
+struct row *rows;
+int cap, nprev;
+int key = K_CPU;
+
+void
+usage(void)
+{
+  fprintf(2, "usage: top [-s cpu|time|faults|syscalls|csw|kmem|pid] [-d ticks] [-n count]\n");
+  exit(1);
+}
+
+uint64
+cputime(struct procstat *ps)
+{
+  return ps->ru.utime + ps->ru.stime;
+}
+
+long
+kmem(struct procstat *ps)
+{
+  return (long)(ps->ru.kmalloc - ps->ru.kfree);
+}
+
+// cpu time over the interval of dt ticks, in tenths of a percent.
+uint64
+permille(struct procstat *ps, int dt)
+{
+  uint64 used = cputime(ps);
+
+  for(int i = 0; i < nprev; i++){
+    if(prev[i].pid == ps->pid){
+      used -= cputime(&prev[i]) <= used ? cputime(&prev[i]) : used;
+      break;
+    }
+  }
+  if(nprev == 0 || dt > ps->ticks)
+    dt = ps->ticks;
+  if(dt <= 0)
+    return 0;
+  return used * 1000 / ((uint64)dt * US_PER_TICK);
+}
+
+long
+keyval(struct row *r)
+{
+  struct procstat *ps = r->ps;
+
+  switch(key){
+  case K_TIME:     return cputime(ps);
+  case K_FAULTS:   return ps->ru.nfault;
+  case K_SYSCALLS: return ps->ru.nsyscall;
+  case K_CSW:      return ps->ru.nvcsw + ps->ru.nivcsw;
+  case K_KMEM:     return kmem(ps);
+  case K_PID:      return -ps->pid;
+  }
+  return r->permille;
+}
+
+void
+show(int n, int dt, int clear)
+{
+  struct row t;
+  int i, j, nrun = 0;
+  uint64 total = 0;
+
+  for(i = 0; i < n; i++){
+    rows[i].ps = &cur[i];
+    rows[i].permille = permille(&cur[i], dt);
+    total += rows[i].permille;
+    if(cur[i].state == 4)
+      nrun++;
+  }
+  for(i = 1; i < n; i++){
+    t = rows[i];
+    for(j = i; j > 0 && keyval(&t) > keyval(&rows[j-1]); j--)
+      rows[j] = rows[j-1];
+    rows[j] = t;
+  }
+
+  if(clear)
+    printf("\033[H\033[J");
+  printf("up %d ticks  threads: %d, %d running  cpu: %d.%d%%  sort: %s\n\n",
+         uptime(), n, nrun, (int)(total / 10), (int)(total % 10), keys[key]);
+  printf("%5s %5s %3s %1s %-12s %6s %9s %9s %7s %7s %7s %9s %8s %7s\n",
+         "PID", "PPID", "TID", "S", "NAME", "%CPU", "UTIME_MS", "STIME_MS",
+         "VCSW", "IVCSW", "FAULTS", "SYSCALLS", "KMEM", "MEM_KB");
+  for(i = 0; i < n; i++){
+    struct procstat *ps = rows[i].ps;
+    int s = ps->state >= 0 && ps->state < sizeof(states) - 1 ? ps->state : 0;
+    printf("%5d %5d %3d %c %-12s %4d.%d %9lu %9lu %7lu %7lu %7lu %9lu %8ld %7lu\n",
+           ps->pid, ps->ppid, ps->tid, states[s], ps->name,
+           (int)(rows[i].permille / 10), (int)(rows[i].permille % 10),
+           ps->ru.utime / 1000, ps->ru.stime / 1000,
+           ps->ru.nvcsw, ps->ru.nivcsw, ps->ru.nfault, ps->ru.nsyscall,
+           kmem(ps), ps->sz / 1024);
+  }
+}
+
+// make room for n threads, keeping prev.
+void
+grow(int n)
+{
+  struct procstat *c, *p;
+  struct row *r;
+
+  c = malloc(n * sizeof(*c));
+  p = malloc(n * sizeof(*p));
+  r = malloc(n * sizeof(*r));
+  if(c == 0 || p == 0 || r == 0){
+    fprintf(2, "top: out of memory\n");
+    exit(1);
+  }
+  if(cap > 0){
+    memmove(p, prev, nprev * sizeof(*p));
+    free(cur);
+    free(prev);
+    free(rows);
+  }
+  cur = c;
+  prev = p;
+  rows = r;
+  cap = n;
+}
+
+// fill cur with every thread's procstat; return how many.
+int
+fetch(void)
+{
+  int n;
+
+  for(;;){
+    if((n = procstat(cur, cap)) < 0){
+      fprintf(2, "top: procstat failed\n");
+      exit(1);
+    }
+    if(n < cap)
+      return n;
+    grow(2 * cap);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, t0, t1, delay = 10, count = 0;
+
+  for(i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-s") == 0 && i + 1 < argc){
+      i++;
+      for(key = 0; key < NELEM(keys); key++)
+        if(strcmp(argv[i], keys[key]) == 0)
+          break;
+      if(key == NELEM(keys))
+        usage();
+    } else if(strcmp(argv[i], "-d") == 0 && i + 1 < argc){
+      delay = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc){
+      count = atoi(argv[++i]);
+    } else {
+      usage();
+    }
+  }
+
+  grow(64);
+  t0 = uptime();
+  for(i = 0; count == 0 || i < count; i++){
+    n = fetch();
+    t1 = uptime();
+    show(n, t1 - t0, count != 1);
+    memmove(prev, cur, n * sizeof(cur[0]));
+    nprev = n;
+    t0 = t1;
+    if(count == 0 || i + 1 < count)
+      pause(delay);
+  }
+  exit(0);
+}
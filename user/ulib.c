@@ -3,6 +3,7 @@
 #include "kernel/fcntl.h"
 #include "kernel/riscv.h"
 #include "kernel/vm.h"
+#include "kernel/param.h"
 #include "user/user.h"
 
 //
@@ -46,14 +47,41 @@ strlen(const char *s)
   return n;
 }
 
+// memset, memmove and memcmp use 8-byte loads and stores when both
+// pointers have the same alignment modulo 8, with byte loops for the
+// unaligned head and tail (see kernel/string.c).
+#define WSIZE  sizeof(uint64)
+#define WMASK  (WSIZE - 1)
+
 void*
 memset(void *dst, int c, uint n)
 {
   char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uint64 w, *wd;
+
+  while(n > 0 && ((uint64)cdst & WMASK)){
+    *cdst++ = c;
+    n--;
+  }
+
+  w = (uchar)c;
+  w |= w << 8;
+  w |= w << 16;
+  w |= w << 32;
+
+  wd = (uint64 *) cdst;
+  for(; n >= 4*WSIZE; n -= 4*WSIZE, wd += 4){
+    wd[0] = w;
+    wd[1] = w;
+    wd[2] = w;
+    wd[3] = w;
   }
+  for(; n >= WSIZE; n -= WSIZE)
+    *wd++ = w;
+
+  cdst = (char *) wd;
+  while(n-- > 0)
+    *cdst++ = c;
   return dst;
 }
 
@@ -114,15 +142,59 @@ memmove(void *vdst, const void *vsrc, int n)
 {
   char *dst;
   const char *src;
+  int wide;
 
+  if(n <= 0)
+    return vdst;
   dst = vdst;
   src = vsrc;
+  wide = (((uint64)dst ^ (uint64)src) & WMASK) == 0;
   if (src > dst) {
+    if (wide) {
+      while(n > 0 && ((uint64)dst & WMASK)){
+        *dst++ = *src++;
+        n--;
+      }
+      uint64 *wd = (uint64 *) dst;
+      const uint64 *ws = (const uint64 *) src;
+      for(; n >= 4*WSIZE; n -= 4*WSIZE, wd += 4, ws += 4){
+        uint64 a = ws[0], b = ws[1], c = ws[2], d = ws[3];
+        wd[0] = a;
+        wd[1] = b;
+        wd[2] = c;
+        wd[3] = d;
+      }
+      for(; n >= WSIZE; n -= WSIZE)
+        *wd++ = *ws++;
+      dst = (char *) wd;
+      src = (const char *) ws;
+    }
     while(n-- > 0)
       *dst++ = *src++;
   } else {
     dst += n;
     src += n;
+    if (wide) {
+      while(n > 0 && ((uint64)dst & WMASK)){
+        *--dst = *--src;
+        n--;
+      }
+      uint64 *wd = (uint64 *) dst;
+      const uint64 *ws = (const uint64 *) src;
+      for(; n >= 4*WSIZE; n -= 4*WSIZE){
+        wd -= 4;
+        ws -= 4;
+        uint64 a = ws[3], b = ws[2], c = ws[1], d = ws[0];
+        wd[3] = a;
+        wd[2] = b;
+        wd[1] = c;
+        wd[0] = d;
+      }
+      for(; n >= WSIZE; n -= WSIZE)
+        *--wd = *--ws;
+      dst = (char *) wd;
+      src = (const char *) ws;
+    }
     while(n-- > 0)
       *--dst = *--src;
   }
@@ -133,6 +205,19 @@ int
 memcmp(const void *s1, const void *s2, uint n)
 {
   const char *p1 = s1, *p2 = s2;
+  if ((((uint64)p1 ^ (uint64)p2) & WMASK) == 0) {
+    while (n > 0 && ((uint64)p1 & WMASK)) {
+      if (*p1 != *p2)
+        return *p1 - *p2;
+      p1++, p2++, n--;
+    }
+    // skip whole equal words; the byte loop finds the mismatch.
+    while (n >= WSIZE && *(uint64 *)p1 == *(uint64 *)p2) {
+      p1 += WSIZE;
+      p2 += WSIZE;
+      n -= WSIZE;
+    }
+  }
   while (n-- > 0) {
     if (*p1 != *p2) {
       return *p1 - *p2;
@@ -159,3 +244,156 @@ sbrklazy(int n) {
   return sys_sbrk(n, SBRK_LAZY);
 }
 
+
+//
+// threads, on top of clone() and join().
+// each thread runs on a TSTACK-byte stack from malloc(),
+// which thread_join() frees.
+//
+
+#define TSTACK (4*PGSIZE)
+
+struct tstart {
+  void (*fn)(void *);
+  void *arg;
+};
+
+// stacks of threads not yet joined.
+static struct {
+  struct mutex lock;
+  int tid[NTHREAD];
+  char *stack[NTHREAD];
+} threads;
+
+static void
+thread_start(void *a)
+{
+  struct tstart *ts = a;
+
+  ts->fn(ts->arg);
+  exit(0);
+}
+
+// start a thread running fn(arg) in this process;
+// returns its thread id, or -1.
+int
+thread_create(void (*fn)(void *), void *arg)
+{
+  char *stack;
+  struct tstart *ts;
+  int i, tid;
+
+  if((stack = malloc(TSTACK)) == 0)
+    return -1;
+  // the new thread finds fn and arg at the top of its stack.
+  ts = (struct tstart *)(stack + TSTACK) - 1;
+  ts->fn = fn;
+  ts->arg = arg;
+
+  // hold the lock until the stack is recorded, in case the
+  // thread exits and someone joins it right away.
+  mutex_lock(&threads.lock);
+  for(i = 0; i < NTHREAD; i++)
+    if(threads.stack[i] == 0)
+      break;
+  if(i == NTHREAD || (tid = clone(thread_start, ts, ts)) < 0){
+    mutex_unlock(&threads.lock);
+    free(stack);
+    return -1;
+  }
+  threads.tid[i] = tid;
+  threads.stack[i] = stack;
+  mutex_unlock(&threads.lock);
+  return tid;
+}
+
+// wait for thread tid (any thread, if tid is 0) to finish;
+// returns its thread id, or -1.
+int
+thread_join(int tid)
+{
+  int i;
+
+  if((tid = join(tid, 0)) < 0)
+    return -1;
+  mutex_lock(&threads.lock);
+  for(i = 0; i < NTHREAD; i++){
+    if(threads.stack[i] && threads.tid[i] == tid){
+      free(threads.stack[i]);
+      threads.stack[i] = 0;
+      break;
+    }
+  }
+  mutex_unlock(&threads.lock);
+  return tid;
+}
+
+//
+// mutexes and condition variables.
+// taking a free mutex or releasing one that nobody waits
+// for is a single atomic instruction, with no system call.
+// (after Drepper, "Futexes Are Tricky".)
+//
+
+void
+mutex_lock(struct mutex *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->v, 0, 1)) == 0)
+    return;
+  // contended: mark it so the holder's unlock wakes us.
+  if(c != 2)
+    c = __sync_lock_test_and_set(&m->v, 2);
+  while(c != 0){
+    futex_wait(&m->v, 2, 0);
+    c = __sync_lock_test_and_set(&m->v, 2);
+  }
+}
+
+// take m if it is free; returns 1 if taken, 0 if not.
+int
+mutex_trylock(struct mutex *m)
+{
+  return __sync_val_compare_and_swap(&m->v, 0, 1) == 0;
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__sync_fetch_and_sub(&m->v, 1) != 1){
+    // there may be waiters.
+    __sync_lock_release(&m->v);
+    futex_wake(&m->v, 1);
+  }
+}
+
+// release m, wait for cond_signal() or cond_broadcast()
+// on c, then take m again.  may return spuriously, so
+// callers should re-check their condition.
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq = *(volatile int *)&c->seq;
+
+  mutex_unlock(m);
+  futex_wait(&c->seq, seq, 0);
+  // other threads may be waiting for m as well, so take it
+  // as contended, to make sure our unlock wakes them.
+  while(__sync_lock_test_and_set(&m->v, 2) != 0)
+    futex_wait(&m->v, 2, 0);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 0x7fffffff);
+}
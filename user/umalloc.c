@@ -2,89 +2,360 @@
 #include "kernel/stat.h"
 #include "user/user.h"
 #include "kernel/param.h"
+#include "kernel/riscv.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+//
+// Memory allocator with segregated size classes.
+//
+// The heap is a sequence of page-aligned extents carved out of
+// memory from sbrklazy(), so pages are only allocated once touched.
+// Every extent starts with a struct ext header.
+//
+// Requests up to 1024 bytes come from one-page runs of equal-sized
+// objects, one list of partly free runs per size class, so malloc
+// and free are a list pop and push.  Each class keeps one empty run
+// around, so a malloc/free loop doesn't keep carving up a new page,
+// until the next large free.  Larger requests get an extent of whole
+// pages of their own.
+//
+// Free extents sit in bins by page count and are merged with free
+// neighbours, using boundary tags: a free extent keeps its page
+// count in its last word, and the extent after it has F_PREVFREE
+// set.  A free extent at the top of the heap bigger than TRIMPAGES
+// is handed back to the kernel with a negative sbrk.
+//
 
-typedef long Align;
+#define EXT_MAGIC  0x6d656d78
 
-union header {
-  struct {
-    union header *ptr;
-    uint size;
-  } s;
-  Align x;
+#define F_FREE      0x1   // on a bin list
+#define F_PREVFREE  0x2   // the extent below is free
+#define F_FIRST     0x4   // first extent of an sbrk segment
+#define F_LAST      0x8   // last extent of an sbrk segment
+#define F_RUN       0x10  // a run of small objects
+
+struct ext {
+  uint magic;
+  uint flags;
+  uint npages;
+  ushort cls;           // size class, if F_RUN
+  ushort nfree;         // free objects, if F_RUN
+  struct ext *next;     // bin list if F_FREE, class list if F_RUN
+  struct ext *prev;
+  void *objs;           // free objects, if F_RUN
+  uint64 pad;           // keep objects 16-byte aligned
 };
 
-typedef union header Header;
+#define HDR sizeof(struct ext)
+
+#define NBIN       32   // bins[n] holds free extents of n pages,
+                        // bins[0] those of NBIN or more
+#define GROWPAGES  16   // least to ask sbrk for
+#define TRIMPAGES  32   // give back a free top bigger than this
+
+static ushort sizes[] = {16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024};
+#define NCLASS (sizeof(sizes)/sizeof(sizes[0]))
+#define MAXSMALL 1024
+
+static struct ext *partial[NCLASS];  // runs with free objects
+static struct ext *bins[NBIN];
+static struct ext *last;             // last extent of the top segment
+static char *top;                    // end of the top segment
+
+// threads share the heap.
+static struct mutex heaplock;
+
+static struct ext*
+nextext(struct ext *e)
+{
+  return (struct ext*)((char*)e + (uint64)e->npages*PGSIZE);
+}
+
+static struct ext*
+prevext(struct ext *e)
+{
+  uint64 n = *((uint64*)e - 1);
+  return (struct ext*)((char*)e - n*PGSIZE);
+}
+
+static void
+push(struct ext **head, struct ext *e)
+{
+  e->prev = 0;
+  e->next = *head;
+  if(*head)
+    (*head)->prev = e;
+  *head = e;
+}
+
+static void
+pull(struct ext **head, struct ext *e)
+{
+  if(e->prev)
+    e->prev->next = e->next;
+  else
+    *head = e->next;
+  if(e->next)
+    e->next->prev = e->prev;
+}
+
+static struct ext**
+bin(uint npages)
+{
+  return &bins[npages < NBIN ? npages : 0];
+}
+
+// mark e free, record its size for the extent above, and bin it.
+static void
+setfree(struct ext *e)
+{
+  e->flags |= F_FREE;
+  *((uint64*)nextext(e) - 1) = e->npages;
+  if(!(e->flags & F_LAST))
+    nextext(e)->flags |= F_PREVFREE;
+  push(bin(e->npages), e);
+}
+
+// give all but one page of the free top extent back to the kernel.
+static void
+trim(struct ext *e)
+{
+  uint n = e->npages - 1;
+
+  if(e != last || e->npages <= TRIMPAGES || sbrklazy(0) != top)
+    return;
+  pull(bin(e->npages), e);
+  if(sbrk(-(int)(n*PGSIZE)) == SBRK_ERROR){
+    push(bin(e->npages), e);
+    return;
+  }
+  top -= (uint64)n*PGSIZE;
+  e->npages = 1;
+  setfree(e);
+}
+
+// return extent e to the free bins, merging it with free neighbours.
+static void
+pgfree(struct ext *e, int dotrim)
+{
+  struct ext *n;
+
+  e->flags &= F_PREVFREE | F_FIRST | F_LAST;
+  if(e->flags & F_PREVFREE){
+    n = prevext(e);
+    pull(bin(n->npages), n);
+    n->npages += e->npages;
+    n->flags = (n->flags & ~F_FREE) | (e->flags & F_LAST);
+    if(last == e)
+      last = n;
+    e = n;
+  }
+  if(!(e->flags & F_LAST) && ((n = nextext(e))->flags & F_FREE)){
+    pull(bin(n->npages), n);
+    e->npages += n->npages;
+    e->flags |= n->flags & F_LAST;
+    if(last == n)
+      last = e;
+  }
+  setfree(e);
+  if(dotrim)
+    trim(e);
+}
+
+// add at least npages pages of fresh memory to the free bins.
+static int
+grow(uint npages)
+{
+  char *cur, *p;
+  struct ext *e;
+  uint64 sz;
+
+  if(npages < GROWPAGES)
+    npages = GROWPAGES;
+  if(npages >= 0x7fffffff / PGSIZE - 1)
+    return -1;
+  sz = (uint64)npages*PGSIZE;
+  // if someone else moved the break, start a new page-aligned segment.
+  cur = sbrklazy(0);
+  if(cur != top)
+    sz += PGROUNDUP((uint64)cur) - (uint64)cur;
+  if((p = sbrklazy(sz)) == SBRK_ERROR)
+    return -1;
+
+  if(p == top && last){
+    // extends the top segment.
+    e = (struct ext*)p;
+    e->flags = F_LAST | ((last->flags & F_FREE) ? F_PREVFREE : 0);
+    last->flags &= ~F_LAST;
+  } else {
+    e = (struct ext*)PGROUNDUP((uint64)p);
+    e->flags = F_FIRST | F_LAST;
+  }
+  top = (char*)PGROUNDDOWN((uint64)(p + sz));
+  e->magic = EXT_MAGIC;
+  e->npages = (top - (char*)e) / PGSIZE;
+  last = e;
+  pgfree(e, 0);
+  return 0;
+}
+
+// take an extent of exactly npages pages from the bins.
+static struct ext*
+pgalloc(uint npages)
+{
+  struct ext *e = 0, *r, *x;
+  uint i;
+
+  for(;;){
+    for(i = npages; i < NBIN && e == 0; i++)
+      e = bins[i];
+    // best fit among the big ones.
+    if(e == 0)
+      for(x = bins[0]; x; x = x->next)
+        if(x->npages >= npages && (e == 0 || x->npages < e->npages))
+          e = x;
+    if(e)
+      break;
+    if(grow(npages) < 0)
+      return 0;
+  }
+
+  pull(bin(e->npages), e);
+  e->flags &= ~F_FREE;
+  if(e->npages > npages){
+    r = (struct ext*)((char*)e + (uint64)npages*PGSIZE);
+    r->magic = EXT_MAGIC;
+    r->npages = e->npages - npages;
+    r->flags = e->flags & F_LAST;
+    e->flags &= ~F_LAST;
+    e->npages = npages;
+    if(last == e)
+      last = r;
+    setfree(r);
+  } else if(!(e->flags & F_LAST)){
+    nextext(e)->flags &= ~F_PREVFREE;
+  }
+  return e;
+}
+
+static int
+sizeclass(uint nbytes)
+{
+  int c;
+
+  for(c = 0; sizes[c] < nbytes; c++)
+    ;
+  return c;
+}
+
+static void*
+smalloc(uint nbytes)
+{
+  int c = sizeclass(nbytes);
+  struct ext *r;
+  char *o;
+  uint i, n;
+
+  if((r = partial[c]) == 0){
+    if((r = pgalloc(1)) == 0)
+      return 0;
+    r->flags |= F_RUN;
+    r->cls = c;
+    n = (PGSIZE - HDR) / sizes[c];
+    r->nfree = n;
+    r->objs = 0;
+    o = (char*)r + HDR + (n-1)*sizes[c];
+    for(i = 0; i < n; i++, o -= sizes[c]){
+      *(void**)o = r->objs;
+      r->objs = o;
+    }
+    push(&partial[c], r);
+  }
+  o = r->objs;
+  r->objs = *(void**)o;
+  if(--r->nfree == 0)
+    pull(&partial[c], r);
+  return o;
+}
+
+// would freeing extent e make a free extent of TRIMPAGES or more?
+static int
+bigneighbour(struct ext *e)
+{
+  uint n = e->npages;
+
+  if(e->flags & F_PREVFREE)
+    n += prevext(e)->npages;
+  if(!(e->flags & F_LAST) && (nextext(e)->flags & F_FREE))
+    n += nextext(e)->npages;
+  return n >= TRIMPAGES;
+}
 
-static Header base;
-static Header *freep;
+static void
+sfree(struct ext *r, void *ap)
+{
+  int c = r->cls;
+
+  *(void**)ap = r->objs;
+  r->objs = ap;
+  if(r->nfree++ == 0)
+    push(&partial[c], r);
+  if(r->nfree < (PGSIZE - HDR) / sizes[c])
+    return;
+  // an empty run goes back, unless it is the class's only one
+  // and isn't holding apart a big stretch of free pages.
+  if(partial[c] != r || r->next != 0 || bigneighbour(r)){
+    pull(&partial[c], r);
+    pgfree(r, 1);
+  }
+}
+
+// give back the empty runs sfree() kept, which would otherwise
+// stop the free space around them from merging and being trimmed.
+static void
+flushruns(void)
+{
+  struct ext *r;
+  uint c;
+
+  for(c = 0; c < NCLASS; c++){
+    r = partial[c];
+    if(r && r->next == 0 && r->nfree == (PGSIZE - HDR) / sizes[c]){
+      pull(&partial[c], r);
+      pgfree(r, 1);
+    }
+  }
+}
 
 void
 free(void *ap)
 {
-  Header *bp, *p;
+  struct ext *e;
 
-  bp = (Header*)ap - 1;
-  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
-    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
-      break;
-  if(bp + bp->s.size == p->s.ptr){
-    bp->s.size += p->s.ptr->s.size;
-    bp->s.ptr = p->s.ptr->s.ptr;
-  } else
-    bp->s.ptr = p->s.ptr;
-  if(p + p->s.size == bp){
-    p->s.size += bp->s.size;
-    p->s.ptr = bp->s.ptr;
-  } else
-    p->s.ptr = bp;
-  freep = p;
-}
-
-static Header*
-morecore(uint nu)
-{
-  char *p;
-  Header *hp;
-
-  if(nu < 4096)
-    nu = 4096;
-  p = sbrk(nu * sizeof(Header));
-  if(p == SBRK_ERROR)
-    return 0;
-  hp = (Header*)p;
-  hp->s.size = nu;
-  free((void*)(hp + 1));
-  return freep;
+  if(ap == 0)
+    return;
+  e = (struct ext*)PGROUNDDOWN((uint64)ap);
+  mutex_lock(&heaplock);
+  if(e->flags & F_RUN){
+    sfree(e, ap);
+  } else {
+    flushruns();
+    pgfree(e, 1);
+  }
+  mutex_unlock(&heaplock);
 }
 
 void*
 malloc(uint nbytes)
 {
-  Header *p, *prevp;
-  uint nunits;
+  struct ext *e;
+  void *p = 0;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
-  if((prevp = freep) == 0){
-    base.s.ptr = freep = prevp = &base;
-    base.s.size = 0;
-  }
-  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
-    if(p->s.size >= nunits){
-      if(p->s.size == nunits)
-        prevp->s.ptr = p->s.ptr;
-      else {
-        p->s.size -= nunits;
-        p += p->s.size;
-        p->s.size = nunits;
-      }
-      freep = prevp;
-      return (void*)(p + 1);
-    }
-    if(p == freep)
-      if((p = morecore(nunits)) == 0)
-        return 0;
+  mutex_lock(&heaplock);
+  if(nbytes <= MAXSMALL){
+    p = smalloc(nbytes);
+  } else if((e = pgalloc(((uint64)nbytes + HDR + PGSIZE - 1) / PGSIZE)) != 0){
+    p = (char*)e + HDR;
   }
+  mutex_unlock(&heaplock);
+  return p;
 }
@@ -1,6 +1,15 @@
 #define SBRK_ERROR ((char *)-1)
 
 struct stat;
+struct rusage;
+struct procstat;
+struct sleepstat;
+struct dirent;
+struct dirstat;
+struct irqstat;
+struct workstat;
+struct slabstat;
+struct buddystat;
 
 // system calls
 int fork(void);
@@ -24,6 +33,16 @@ int getpid(void);
 char* sys_sbrk(int,int);
 int pause(int);
 int uptime(void);
+int getrusage(int, struct rusage*);
+int procstat(struct procstat*, int);
+int dmesg(char*, int);
+int fdlimit(int);
+int sleepstat(struct sleepstat*, int);
+int getdents(int, struct dirent*, int);
+int dirstat(int, struct dirstat*, int);
+int irqaffinity(int, int);
+int irqstat(struct irqstat*, int);
+int workstat(struct workstat*, int, int);
 
 // slab allocator syscalls
 typedef unsigned long uint64;
@@ -43,6 +62,16 @@ uint64 kmalloc(int);
 int kfree(uint64);
 int slab_write(uint64, const void*, int);
 int slab_read(void*, uint64, int);
+int slabstat(struct slabstat*, int);
+int buddystat(struct buddystat*);
+int atrace(int, void*, int);
+int ktrace(int, int, void*, int);
+
+// threads
+int clone(void (*)(void *), void *, void *);
+int join(int, int*);
+int futex_wait(int*, int, int);
+int futex_wake(int*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -58,6 +87,23 @@ int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
 char* sbrk(int);
 char* sbrklazy(int);
+int thread_create(void (*)(void *), void *);
+int thread_join(int);
+
+// ulib.c: locks that sleep in futex_wait() when contended.
+// zero-initialized means unlocked / no waiters.
+struct mutex {
+  int v;    // 0 unlocked, 1 locked, 2 locked and maybe waiters
+};
+struct cond {
+  int seq;  // bumped by every signal
+};
+void mutex_lock(struct mutex*);
+int mutex_trylock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
 
 // printf.c
 void fprintf(int, const char*, ...) __attribute__ ((format (printf, 2, 3)));
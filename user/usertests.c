@@ -7,6 +7,7 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/workqueue.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -789,6 +790,71 @@ pipe1(char *s)
 }
 
 
+// more descriptors than a process's table starts with, a child
+// inheriting them, and the per-process limit.
+void
+manyfds(char *s)
+{
+  enum { N = 100 };
+  int fds[N][2], i, fd, last, old, pid, xstatus;
+  char c;
+
+  for(i = 0; i < N; i++){
+    if(pipe(fds[i]) < 0){
+      printf("%s: pipe %d failed\n", s, i);
+      exit(1);
+    }
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < N; i++){
+      if(write(fds[i][1], "x", 1) != 1){
+        printf("%s: child write %d failed\n", s, i);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  for(i = 0; i < N; i++){
+    if(read(fds[i][0], &c, 1) != 1 || c != 'x'){
+      printf("%s: read %d failed\n", s, i);
+      exit(1);
+    }
+    close(fds[i][0]);
+    close(fds[i][1]);
+  }
+
+  // with a limit of 8, dup() hands out descriptors up to 7.
+  if((old = fdlimit(8)) < 2*N){
+    printf("%s: fdlimit returned %d\n", s, old);
+    exit(1);
+  }
+  last = -1;
+  while((fd = dup(0)) >= 0)
+    last = fd;
+  if(last != 7){
+    printf("%s: last dup got %d, want 7\n", s, last);
+    exit(1);
+  }
+  if(fdlimit(4) != -1){
+    printf("%s: fdlimit below an open descriptor worked\n", s);
+    exit(1);
+  }
+  for(fd = 3; fd <= last; fd++)
+    close(fd);
+  if(fdlimit(old) != 8){
+    printf("%s: fdlimit did not keep the limit\n", s);
+    exit(1);
+  }
+}
+
 // test if child is killed (status = -1)
 void
 killstatus(char *s)
@@ -1701,6 +1767,207 @@ subdir(char *s)
   }
 }
 
+// the RAM file system at /tmp: files bigger than its direct
+// pages, directories, ".." back out of it, and what it refuses.
+void
+tmpfs(char *s)
+{
+  enum { N = 20 };   // 4096-byte pages; past the direct ones
+  int fd, i, j;
+  struct stat st, rst;
+
+  if(stat("/", &rst) < 0 || stat("/tmp", &st) < 0){
+    printf("%s: stat / or /tmp failed\n", s);
+    exit(1);
+  }
+  if(st.type != T_DIR || st.dev == rst.dev){
+    printf("%s: /tmp isn't a separate file system\n", s);
+    exit(1);
+  }
+  if(unlink("/tmp") == 0){
+    printf("%s: unlinked the mount point\n", s);
+    exit(1);
+  }
+
+  if(mkdir("/tmp/tfdir") < 0){
+    printf("%s: mkdir /tmp/tfdir failed\n", s);
+    exit(1);
+  }
+  fd = open("/tmp/tfdir/big", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    memset(buf, i, 4096);
+    if(write(fd, buf, 4096) != 4096){
+      printf("%s: write %d failed\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd);
+  fd = open("/tmp/tfdir/big", O_RDONLY);
+  for(i = 0; i < N; i++){
+    if(read(fd, buf, 4096) != 4096){
+      printf("%s: read %d failed\n", s, i);
+      exit(1);
+    }
+    for(j = 0; j < 4096; j++){
+      if(buf[j] != (char)i){
+        printf("%s: bad data in page %d\n", s, i);
+        exit(1);
+      }
+    }
+  }
+  if(read(fd, buf, 1) != 0){
+    printf("%s: read past end\n", s);
+    exit(1);
+  }
+  if(fstat(fd, &st) < 0 || st.size != N*4096){
+    printf("%s: size %d\n", s, (int)st.size);
+    exit(1);
+  }
+  close(fd);
+
+  if(link("/tmp/tfdir/big", "tfbig") == 0){
+    printf("%s: linked across file systems\n", s);
+    exit(1);
+  }
+
+  if(chdir("/tmp/tfdir") < 0){
+    printf("%s: chdir failed\n", s);
+    exit(1);
+  }
+  if(stat("../..", &st) < 0 || st.dev != rst.dev || st.ino != rst.ino){
+    printf("%s: ../.. from /tmp/tfdir isn't /\n", s);
+    exit(1);
+  }
+  if(unlink("big") < 0 || chdir("/") < 0){
+    printf("%s: unlink or chdir failed\n", s);
+    exit(1);
+  }
+  if(unlink("/tmp/tfdir") < 0 || open("/tmp/tfdir", O_RDONLY) >= 0){
+    printf("%s: rmdir /tmp/tfdir failed\n", s);
+    exit(1);
+  }
+}
+
+// getdents() and dirstat() return what read() and stat() would.
+void
+dirents(char *s)
+{
+  struct dirent de[4];
+  struct dirstat ds[4];
+  struct stat st, rst;
+  int fd, i, n, k, seen;
+
+  if(mkdir("dents") < 0 || (fd = open("dents/a", O_CREATE|O_WRONLY)) < 0){
+    printf("%s: setup failed\n", s);
+    exit(1);
+  }
+  write(fd, "xyz", 3);
+  close(fd);
+  if(mkdir("dents/b") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+
+  // getdents, a few at a time: ., .., a, b.
+  fd = open("dents", O_RDONLY);
+  for(n = seen = 0; (k = getdents(fd, de, 3)) > 0; n += k){
+    for(i = 0; i < k; i++){
+      if(de[i].inum == 0){
+        printf("%s: getdents returned an empty entry\n", s);
+        exit(1);
+      }
+      if(strcmp(de[i].name, "a") == 0 || strcmp(de[i].name, "b") == 0)
+        seen++;
+    }
+  }
+  close(fd);
+  if(k < 0 || n != 4 || seen != 2){
+    printf("%s: getdents got %d entries\n", s, n);
+    exit(1);
+  }
+
+  fd = open("dents", O_RDONLY);
+  n = dirstat(fd, ds, 4);
+  close(fd);
+  if(n != 4){
+    printf("%s: dirstat got %d entries\n", s, n);
+    exit(1);
+  }
+  for(i = 0; i < n; i++){
+    if(strcmp(ds[i].name, "a") == 0 &&
+       (ds[i].st.type != T_FILE || ds[i].st.size != 3)){
+      printf("%s: dirstat of a wrong\n", s);
+      exit(1);
+    }
+    if(strcmp(ds[i].name, "b") == 0 && ds[i].st.type != T_DIR){
+      printf("%s: dirstat of b wrong\n", s);
+      exit(1);
+    }
+  }
+
+  // ".." of /tmp is /, as stat("/tmp/..") says.
+  if(stat("/", &rst) < 0 || (fd = open("/tmp", O_RDONLY)) < 0){
+    printf("%s: open /tmp failed\n", s);
+    exit(1);
+  }
+  st.ino = 0;
+  while((k = dirstat(fd, ds, 4)) > 0)
+    for(i = 0; i < k; i++)
+      if(strcmp(ds[i].name, "..") == 0)
+        st = ds[i].st;
+  close(fd);
+  if(st.ino != rst.ino || st.dev != rst.dev){
+    printf("%s: dirstat of /tmp/.. isn't /\n", s);
+    exit(1);
+  }
+
+  // a file isn't a directory.
+  fd = open("dents/a", O_RDONLY);
+  if(getdents(fd, de, 4) != -1){
+    printf("%s: getdents of a file succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  unlink("dents/a");
+  unlink("dents/b");
+  if(unlink("dents") < 0){
+    printf("%s: unlink failed\n", s);
+    exit(1);
+  }
+}
+
+// every CPU has a worker, and flushing a queue runs something on it.
+void
+workq(char *s)
+{
+  struct workstat a[NCPU], b[NCPU];
+  int i, n;
+
+  if((n = workstat(a, NCPU, 0)) < 1 || workstat(b, NCPU, 1) != n){
+    printf("%s: workstat failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < n; i++){
+    if(b[i].cpu != a[i].cpu || b[i].pid <= 0){
+      printf("%s: bad worker %d\n", s, i);
+      exit(1);
+    }
+    if(b[i].done <= a[i].done){
+      printf("%s: cpu %d's worker ran nothing\n", s, b[i].cpu);
+      exit(1);
+    }
+  }
+  if(workstat((struct workstat*)0xffffffffffL, NCPU, 0) != -1){
+    printf("%s: workstat to a bad address succeeded\n", s);
+    exit(1);
+  }
+}
+
 // test writes that are larger than the log.
 void
 bigwrite(char *s)
@@ -1957,12 +2224,12 @@ iref(char *s)
 }
 
 // test that fork fails gracefully
-// the forktest binary also does this, but it runs out of proc entries first.
+// the forktest binary also does this, but it may run out of proc entries first.
 // inside the bigger usertests binary, we run out of memory first.
 void
 forktest(char *s)
 {
-  enum{ N = 1000 };
+  enum{ N = 10000 };
   int n, pid;
 
   for(n=0; n<N; n++){
@@ -1979,7 +2246,7 @@ forktest(char *s)
   }
 
   if(n == N){
-    printf("%s: fork claimed to work 1000 times!\n", s);
+    printf("%s: fork claimed to work %d times!\n", s, N);
     exit(1);
   }
 
@@ -2771,6 +3038,7 @@ struct test {
   {dirtest, "dirtest"},
   {exectest, "exectest"},
   {pipe1, "pipe1"},
+  {manyfds, "manyfds"},
   {killstatus, "killstatus"},
   {preempt, "preempt"},
   {exitwait, "exitwait"},
@@ -2788,6 +3056,9 @@ struct test {
   {concreate, "concreate"},
   {linkunlink, "linkunlink"},
   {subdir, "subdir"},
+  {tmpfs, "tmpfs"},
+  {dirents, "dirents"},
+  {workq, "workq"},
   {bigwrite, "bigwrite"},
   {bigfile, "bigfile"},
   {fourteen, "fourteen"},
@@ -54,3 +54,21 @@ entry("kmalloc");
 entry("kfree");
 entry("slab_write");
 entry("slab_read");
+entry("clone");
+entry("join");
+entry("futex_wait");
+entry("futex_wake");
+entry("atrace");
+entry("ktrace");
+entry("slabstat");
+entry("buddystat");
+entry("getrusage");
+entry("procstat");
+entry("dmesg");
+entry("fdlimit");
+entry("sleepstat");
+entry("getdents");
+entry("dirstat");
+entry("irqaffinity");
+entry("irqstat");
+entry("workstat");
@@ -0,0 +1,42 @@
+// workstat: print what each CPU's kernel worker thread has done;
+// see kernel/workqueue.c.
+//
+//   workstat [-f]
+//
+// One line per worker: its CPU and pid, the items waiting now and
+// the most ever waiting, the items queued and run, and the time
+// spent running them, and their average and longest wait to
+// start, in microseconds.  -f first flushes each queue,
+// waiting until everything queued so far has run.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/workqueue.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct workstat ws[NCPU];
+  int flush = 0, n;
+
+  if(argc == 2 && strcmp(argv[1], "-f") == 0)
+    flush = 1;
+  else if(argc != 1){
+    fprintf(2, "usage: workstat [-f]\n");
+    exit(1);
+  }
+  if((n = workstat(ws, NCPU, flush)) < 0){
+    fprintf(2, "workstat: failed\n");
+    exit(1);
+  }
+  printf("%3s %5s %5s %5s %9s %9s %10s %8s %8s\n",
+         "CPU", "PID", "DEPTH", "MAX", "QUEUED", "DONE",
+         "RUN_US", "AVGWAIT", "MAXWAIT");
+  for(int i = 0; i < n; i++)
+    printf("%3d %5d %5d %5d %9lu %9lu %10lu %8lu %8lu\n",
+           ws[i].cpu, ws[i].pid, ws[i].depth, ws[i].maxdepth,
+           ws[i].queued, ws[i].done, ws[i].runtime,
+           ws[i].done ? ws[i].waittime / ws[i].done : 0, ws[i].maxwait);
+  exit(0);
+}